@@ -0,0 +1,326 @@
+// Benchmarks of the I/O hot paths.
+//
+// Usage: poppelbench [--out <file>] [--filter <substring>] [--max-bytes <n>] [--min-time <seconds>] [--dir <path>]
+//
+// Results are written as JSON, to stdout or to the --out file. Each result records the timings of one benchmark case,
+// so that results of different releases can be compared case by case.
+// The largest npy transfer is limited by --max-bytes, which defaults to 256 MiB. Use --max-bytes 4294967296 for the full range.
+// Files are written to a new directory under --dir, which defaults to the temporary directory. Only that directory is removed.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <poppel/poppel.hpp>
+
+namespace {
+
+    using namespace poppel;
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        std::filesystem::path out;
+        std::string           filter;
+        std::int64_t          max_bytes = 256 << 20;
+        double                min_time  = 0.2;
+        std::filesystem::path dir       = std::filesystem::temp_directory_path();
+    };
+
+    class Runner {
+    private:
+        const Options& options_;
+        Json           results_ = Json::array();
+
+    public:
+        explicit Runner(const Options& options) : options_(options) {}
+
+        bool enabled(std::string_view name) const {
+            return options_.filter.empty() || name.find(options_.filter) != std::string_view::npos;
+        }
+
+        // Time func repeatedly, for at least min_time and 3 iterations.
+        // If bytes is positive, the throughput is also recorded.
+        void run(const std::string& name, Json params, std::int64_t bytes, const std::function<void()>& func) {
+            if (!enabled(name)) {
+                return;
+            }
+            std::vector<double> times;
+            double total = 0;
+            while (times.size() < 3 || (total < options_.min_time && times.size() < 1000000)) {
+                const auto start = Clock::now();
+                func();
+                const double t = std::chrono::duration<double>(Clock::now() - start).count();
+                times.push_back(t);
+                total += t;
+            }
+            std::sort(times.begin(), times.end());
+
+            Json result;
+            result["name"] = name;
+            result["params"] = std::move(params);
+            result["iterations"] = times.size();
+            result["min_s"] = times.front();
+            result["median_s"] = times[times.size() / 2];
+            result["mean_s"] = total / times.size();
+            if (bytes > 0) {
+                result["bytes"] = bytes;
+                result["bytes_per_s"] = bytes / times[times.size() / 2];
+            }
+            std::cerr << name << ' ' << result["params"].dump() << ": " << result["median_s"].get<double>() * 1e6 << " us\n";
+            results_.push_back(std::move(result));
+        }
+
+        const Json& results() const { return results_; }
+    };
+
+    //----------------------------------
+    // Benchmarks.
+    //----------------------------------
+
+    void bench_npy(Runner& runner, const Options& options) {
+        const auto path = options.dir / "data.npy";
+        core::ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        constexpr std::size_t stripe_size = 1 << 20;
+        for (std::int64_t bytes = 1; bytes <= options.max_bytes; bytes *= (bytes < (1 << 20) ? 32 : 16)) {
+            if (!runner.enabled("npy_save") && !runner.enabled("npy_load")) {
+                break;
+            }
+            std::vector<std::byte> data(bytes, std::byte { 1 });
+            const auto header = npy::create_header<std::uint8_t>(false, { bytes });
+            runner.run("npy_save", { { "bytes", bytes } }, bytes, [&] {
+                npy::save(path, header, data.data());
+            });
+            npy::save(path, header, data.data());
+            runner.run("npy_load", { { "bytes", bytes } }, bytes, [&] {
+                npy::load(path, header, data.data(), false);
+            });
+
+            // The other backends are meant for large arrays only.
+            if (bytes < (1 << 20)) {
+                continue;
+            }
+            for (const auto& [backend, backend_name] : { std::pair { core::IoBackend::Posix, "posix" }, std::pair { core::IoBackend::Direct, "direct" } }) {
+                runner.run("npy_save", { { "bytes", bytes }, { "backend", backend_name } }, bytes, [&] {
+                    core::save_npy(path, header, data.data(), backend);
+                });
+                runner.run("npy_load", { { "bytes", bytes }, { "backend", backend_name } }, bytes, [&] {
+                    core::load_npy(path, header, data.data(), false, backend);
+                });
+            }
+            runner.run("npy_save", { { "bytes", bytes }, { "backend", "parallel" } }, bytes, [&] {
+                core::save_npy_parallel(path, header, data.data(), pool, stripe_size);
+            });
+            runner.run("npy_load", { { "bytes", bytes }, { "backend", "parallel" } }, bytes, [&] {
+                core::load_npy_parallel(path, header, data.data(), false, pool, stripe_size);
+            });
+        }
+    }
+
+    void bench_header(Runner& runner) {
+        for (const std::size_t rank : { 0, 1, 3, 8 }) {
+            const npy::Header header { npy::internal::dtype(float{}), false, std::vector<Size>(rank, 1024) };
+            const auto text = std::string(npy::internal::gen_header(npy::Version { 3, 0 }, header).view());
+            runner.run("header_gen", { { "rank", rank }, { "batch", 1000 } }, 0, [&] {
+                for (int i = 0; i < 1000; ++i) {
+                    auto res = npy::internal::gen_header(npy::Version { 3, 0 }, header);
+                    if (res.length() == 0) {
+                        std::abort();
+                    }
+                }
+            });
+            runner.run("header_parse", { { "rank", rank }, { "batch", 1000 } }, 0, [&] {
+                for (int i = 0; i < 1000; ++i) {
+                    auto res = npy::internal::parse_header(text);
+                    if (res.shape.size() != rank) {
+                        std::abort();
+                    }
+                }
+            });
+        }
+    }
+
+    void bench_require_group(Runner& runner, const Options& options) {
+        if (!runner.enabled("require_group")) {
+            return;
+        }
+        for (const int depth : { 1, 4, 16, 64 }) {
+            File file(options.dir / "groups.poppel", File::Overwrite);
+            std::filesystem::path name;
+            for (int i = 0; i < depth; ++i) {
+                name /= "g" + std::to_string(i);
+            }
+            file.require_group(name);
+            runner.run("require_group", { { "depth", depth } }, 0, [&] {
+                file.require_group(name);
+            });
+        }
+    }
+
+    void bench_lookup(Runner& runner, const Options& options) {
+        if (!runner.enabled("has_dataset") && !runner.enabled("get_dataset")) {
+            return;
+        }
+        for (const int siblings : { 10, 100, 1000 }) {
+            File file(options.dir / "lookup.poppel", File::Overwrite);
+            const std::int32_t val = 0;
+            for (int i = 0; i < siblings; ++i) {
+                file.create_dataset("d" + std::to_string(i), val);
+            }
+            const std::string name = "d" + std::to_string(siblings / 2);
+            runner.run("has_dataset", { { "siblings", siblings } }, 0, [&] {
+                if (!file.has_dataset(name)) {
+                    std::abort();
+                }
+            });
+            runner.run("get_dataset", { { "siblings", siblings } }, 0, [&] {
+                file.get_dataset(name);
+            });
+        }
+    }
+
+    void bench_visit(Runner& runner, const Options& options) {
+        if (!runner.enabled("visit")) {
+            return;
+        }
+        File file(options.dir / "visit.poppel", File::Overwrite);
+        const std::int32_t val = 0;
+        for (int i = 0; i < 1000; ++i) {
+            file.create_dataset("g" + std::to_string(i % 10) + "/d" + std::to_string(i), val);
+        }
+        for (const bool load_headers : { false, true }) {
+            runner.run("visit", { { "nodes", 1010 }, { "headers", load_headers } }, 0, [&] {
+                std::size_t count = 0;
+                file.visit([&](const core::NodeEntry&) { ++count; }, true, load_headers);
+                if (count != 1010) {
+                    std::abort();
+                }
+            });
+        }
+    }
+
+    void bench_create(Runner& runner, const Options& options) {
+        if (!runner.enabled("create_datasets")) {
+            return;
+        }
+        const std::int32_t val = 0;
+        for (const bool batch : { false, true }) {
+            runner.run("create_datasets", { { "nodes", 1010 }, { "batch", batch } }, 0, [&] {
+                File file(options.dir / "create.poppel", File::Overwrite);
+                auto builder = file.batch();
+                for (int i = 0; i < 1000; ++i) {
+                    const auto name = "g" + std::to_string(i % 10) + "/d" + std::to_string(i);
+                    if (batch) {
+                        builder.create_dataset(name, &val, false, {});
+                    } else {
+                        file.create_dataset(name, val);
+                    }
+                }
+                builder.run();
+            });
+        }
+    }
+
+    void bench_attr(Runner& runner, const Options& options) {
+        File file(options.dir / "attr.poppel", File::Overwrite);
+        for (const int num_keys : { 1, 100 }) {
+            Json attr;
+            for (int i = 0; i < num_keys; ++i) {
+                attr["key" + std::to_string(i)] = i;
+            }
+            runner.run("save_attr", { { "keys", num_keys } }, 0, [&] {
+                file.save_attr(attr);
+            });
+            runner.run("load_attr", { { "keys", num_keys } }, 0, [&] {
+                if (file.load_attr().size() != attr.size()) {
+                    std::abort();
+                }
+            });
+            runner.run("attrs_set", { { "keys", num_keys } }, 0, [&] {
+                auto attrs = file.attrs();
+                for (auto& [key, val] : attr.items()) {
+                    attrs.set(key, val);
+                }
+            });
+        }
+    }
+
+    // Create a new directory under base, so that existing files are never touched.
+    std::filesystem::path make_work_dir(const std::filesystem::path& base) {
+        std::random_device rd;
+        for (int attempt = 0; attempt < 100; ++attempt) {
+            const auto dir = base / ("poppelbench." + std::to_string(rd()));
+            if (std::filesystem::create_directory(dir)) {
+                return dir;
+            }
+        }
+        throw Exception("Unable to create a directory under " + base.string());
+    }
+
+    Options parse_options(int argc, char* argv[]) {
+        Options options;
+        for (int i = 1; i < argc; ++i) {
+            const std::string_view arg = argv[i];
+            if (i + 1 >= argc) {
+                throw Exception("Missing value for " + std::string(arg));
+            }
+            const std::string value = argv[++i];
+            if (arg == "--out") {
+                options.out = value;
+            } else if (arg == "--filter") {
+                options.filter = value;
+            } else if (arg == "--max-bytes") {
+                options.max_bytes = std::stoll(value);
+            } else if (arg == "--min-time") {
+                options.min_time = std::stod(value);
+            } else if (arg == "--dir") {
+                options.dir = value;
+            } else {
+                throw Exception("Unknown option " + std::string(arg));
+            }
+        }
+        return options;
+    }
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    try {
+        auto options = parse_options(argc, argv);
+        std::filesystem::create_directories(options.dir);
+        options.dir = make_work_dir(options.dir);
+        core::ScopeGuard cleanup_guard { [&] { std::filesystem::remove_all(options.dir); } };
+
+        Runner runner(options);
+        bench_npy(runner, options);
+        bench_header(runner);
+        bench_require_group(runner, options);
+        bench_lookup(runner, options);
+        bench_visit(runner, options);
+        bench_create(runner, options);
+        bench_attr(runner, options);
+
+        Json report;
+        report["version"] = 1;
+        report["results"] = runner.results();
+        if (options.out.empty()) {
+            std::cout << report.dump(4) << '\n';
+        } else {
+            std::ofstream ofs(options.out);
+            ofs << report.dump(4) << '\n';
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "poppelbench: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef INCLUDE_POPPEL_CORE_CHECKSUM_HPP_
+#define INCLUDE_POPPEL_CORE_CHECKSUM_HPP_
+
+// CRC32C (Castagnoli) checksums of dataset data, for verifying copies without comparing them to the source.
+//
+// The CRC32 instruction of SSE4.2 is used where the processor supports it, checked at run time.
+// Other processors use a table driven implementation, processing 8 bytes per step.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace poppel::core {
+
+    // Continue the checksum of preceding data with the next bytes. Start with zero.
+    // The checksum of the concatenated data is the same however the data is split.
+    std::uint32_t crc32c(std::uint32_t crc, const std::byte* data, std::size_t size);
+
+    inline std::uint32_t crc32c(const std::byte* data, std::size_t size) { return crc32c(0, data, size); }
+
+    // Checksum of the concatenated data from the checksums of both parts and the size of the second part,
+    // so that parts hashed concurrently can be combined in order.
+    std::uint32_t crc32c_combine(std::uint32_t crc1, std::uint32_t crc2, std::uint64_t size2);
+
+} // namespace poppel::core
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef INCLUDE_POPPEL_CORE_CHUNKED_HPP_
+#define INCLUDE_POPPEL_CORE_CHUNKED_HPP_
+
+// Chunked dataset layout.
+//
+// The array is split into fixed-shape chunks, each stored as its own npy file in the dataset directory.
+// The chunk grid is stored in the "layout" object of the dataset's poppel.json.
+// Chunks that have never been written are read as zeros.
+//
+// If the grid has filters, each chunk is instead stored as the filtered raw bytes in a ".bin" file,
+// and is decoded when loaded.
+//
+// Different chunks can be written concurrently by different threads or processes,
+// because writing a chunk does not touch any other file.
+//
+// The sharded layout instead splits the array into disjoint blocks of any shape, listed in the "layout" object,
+// so that each process of a distributed job writes its own block to its own file without gathering the array.
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "npy.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace poppel::core {
+
+    //----------------------------------
+    // Chunk grid metadata.
+    //----------------------------------
+
+    void assert_valid_chunk_grid(const ChunkGrid& grid);
+
+    Json chunk_grid_to_json(const ChunkGrid& grid);
+    ChunkGrid chunk_grid_from_json(const Json& json);
+
+    ChunkGrid read_chunk_grid(const std::filesystem::path& nodepath);
+    // Write the node metadata of a chunked dataset, including the chunk grid.
+    void write_chunk_grid(const std::filesystem::path& nodepath, const ChunkGrid& grid, const FileStates& filestates);
+
+    std::filesystem::path chunk_path(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& chunk_index);
+
+    //----------------------------------
+    // Chunked data transfer.
+    //----------------------------------
+    // Buffers hold data with the item size and index order of the chunk grid.
+    // If a thread pool is given, chunks are transferred concurrently. These must not be called from the tasks of the same pool.
+    // Chunk files are written with write_file(), following the atomic and durable write modes of the file states.
+
+    // Single chunk, with the actual shape of the chunk.
+    void load_chunk(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& chunk_index, std::byte* data);
+    void save_chunk(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& chunk_index, const std::byte* data, const FileStates& filestates);
+
+    // Whole array.
+    void load_chunked(const std::filesystem::path& nodepath, const ChunkGrid& grid, std::byte* data, ThreadPool* pool);
+    void save_chunked(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::byte* data, const FileStates& filestates, ThreadPool* pool);
+    // Whole array, converted chunk by chunk to the data type. See npy::load_convert().
+    void load_chunked_convert(const std::filesystem::path& nodepath, const ChunkGrid& grid, npy::Dtype dtype, std::byte* data, ThreadPool* pool);
+
+    // Hyperslab read, touching only the chunks that intersect the selection.
+    void load_chunked_region(const std::filesystem::path& nodepath, const ChunkGrid& grid, const npy::Hyperslab& slab, std::byte* data, ThreadPool* pool);
+    // Box write with unit stride. Partially covered chunks are read, updated and written back.
+    void save_chunked_region(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& offset, const std::vector<Size>& count, const std::byte* data, const FileStates& filestates, ThreadPool* pool);
+
+    //----------------------------------
+    // Shard map metadata.
+    //----------------------------------
+
+    // Checks the rank and bounds of each shard, and that shards do not overlap.
+    // Maps read from metadata are only checked for bounds.
+    void assert_valid_shard_map(const ShardMap& map);
+
+    Json shard_map_to_json(const ShardMap& map);
+    ShardMap shard_map_from_json(const Json& json);
+
+    ShardMap read_shard_map(const std::filesystem::path& nodepath);
+    // Write the node metadata of a sharded dataset, including the shard map.
+    void write_shard_map(const std::filesystem::path& nodepath, const ShardMap& map, const FileStates& filestates);
+
+    std::filesystem::path shard_path(const std::filesystem::path& nodepath, Size shard_index);
+
+    // Regular decomposition with num_blocks[i] blocks on axis i, as even as possible.
+    // Shards are listed in C order of the block grid, so that shard i can be owned by process i.
+    std::vector<Shard> block_shards(const std::vector<Size>& shape, const std::vector<Size>& num_blocks);
+
+    //----------------------------------
+    // Sharded data transfer.
+    //----------------------------------
+    // Buffers hold data with the item size and index order of the shard map.
+    // If a thread pool is given, shards are transferred concurrently. These must not be called from the tasks of the same pool.
+    // Shard files are written with write_file(), following the atomic and durable write modes of the file states.
+
+    // Single shard, with the shape of the shard. Shards never written are loaded as zeros.
+    void load_shard(const std::filesystem::path& nodepath, const ShardMap& map, Size shard_index, std::byte* data);
+    void save_shard(const std::filesystem::path& nodepath, const ShardMap& map, Size shard_index, const std::byte* data, const FileStates& filestates);
+
+    // Whole array.
+    void load_sharded(const std::filesystem::path& nodepath, const ShardMap& map, std::byte* data, ThreadPool* pool);
+    void save_sharded(const std::filesystem::path& nodepath, const ShardMap& map, const std::byte* data, const FileStates& filestates, ThreadPool* pool);
+
+    // Hyperslab read, touching only the shards that intersect the selection.
+    void load_sharded_region(const std::filesystem::path& nodepath, const ShardMap& map, const npy::Hyperslab& slab, std::byte* data, ThreadPool* pool);
+
+} // namespace poppel::core
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef INCLUDE_POPPEL_CORE_FILTERS_HPP_
+#define INCLUDE_POPPEL_CORE_FILTERS_HPP_
+
+// Filter pipeline applied to the raw bytes of dataset chunks.
+//
+// A pipeline is a JSON array of filter configurations, such as [{"id": "shuffle"}, {"id": "zstd", "level": 3}].
+// Filters are applied in order on save, and in reverse order on load.
+// The pipeline is recorded in the node metadata, so that loading needs no extra information.
+//
+// Built-in filters:
+// - "shuffle": byte shuffle, grouping the n-th bytes of all items together. Always available.
+// - "zstd":    zstd compression, with optional "level". Available if built with POPPEL_WITH_ZSTD.
+// - "lz4":     lz4 compression. Available if built with POPPEL_WITH_LZ4.
+// More filters can be added with register_filter().
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "types.hpp"
+
+namespace poppel::core {
+
+    using FilterBuffer = std::vector<std::byte>;
+
+    class Filter {
+    public:
+        virtual ~Filter() = default;
+        // Transform the bytes of a chunk with the given item size.
+        virtual FilterBuffer encode(FilterBuffer data, Size itemsize) const = 0;
+        // Inverse of encode().
+        virtual FilterBuffer decode(FilterBuffer data, Size itemsize) const = 0;
+    };
+
+    // Creates a filter from its configuration.
+    using FilterFactory = std::function< std::unique_ptr<Filter>(const Json& config) >;
+
+    // Register a filter under the id. Registering an existing id replaces it.
+    void register_filter(const std::string& id, FilterFactory factory);
+    bool has_filter(std::string_view id);
+    std::unique_ptr<Filter> make_filter(const Json& config);
+
+    // Check that all filters of the pipeline are available.
+    void assert_valid_filters(const Json& filters);
+
+    // Apply the whole pipeline.
+    FilterBuffer encode_filters(const Json& filters, FilterBuffer data, Size itemsize);
+    FilterBuffer decode_filters(const Json& filters, FilterBuffer data, Size itemsize);
+
+    // Configurations of built-in filters.
+    inline Json shuffle_filter() { return { { "id", "shuffle" } }; }
+    inline Json zstd_filter(int level = 3) { return { { "id", "zstd" }, { "level", level } }; }
+    inline Json lz4_filter() { return { { "id", "lz4" } }; }
+
+} // namespace poppel::core
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef INCLUDE_POPPEL_CORE_HANDLE_POOL_HPP_
+#define INCLUDE_POPPEL_CORE_HANDLE_POOL_HPP_
+
+// Pool of open npy files with their parsed headers, for repeated reads of the same datasets.
+//
+// Reads go through pread on a shared descriptor, so that concurrent readers of one file need no locking.
+// Handles are implemented with POSIX interfaces. On other platforms, the pool stays disabled.
+
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "npy.hpp"
+
+namespace poppel::core {
+
+    // Read only npy file opened once, with its parsed header.
+    // The descriptor is closed when the handle is destroyed.
+    class NpyFileHandle {
+    private:
+        int                 fd_ = -1;
+        npy::Header         header_;
+        npy::internal::Size data_offset_ = 0;
+        npy::internal::Size file_size_ = 0;
+
+    public:
+        explicit NpyFileHandle(const std::filesystem::path& path);
+        ~NpyFileHandle();
+
+        NpyFileHandle(const NpyFileHandle&) = delete;
+        NpyFileHandle& operator=(const NpyFileHandle&) = delete;
+
+        const auto& header() const noexcept { return header_; }
+        auto data_offset() const noexcept { return data_offset_; }
+
+        // Whether the file still has the size seen on open. Appending changes the size, and the header with it.
+        bool unchanged() const;
+
+        // Read count bytes at the offset from the start of the data portion. Safe to call concurrently.
+        void read_data(std::byte* buffer, npy::internal::Size count, npy::internal::Size offset) const;
+    };
+
+    // Least recently used pool of open npy files, keyed by path. Zero capacity disables the pool.
+    //
+    // Writes through poppel invalidate the handles of the written files.
+    // Changes made by other File instances or processes are not visible, unless they change the file size.
+    class FileHandlePool {
+    public:
+        using HandlePtr = std::shared_ptr<const NpyFileHandle>;
+
+    private:
+        mutable std::mutex mutex_;
+        std::size_t        capacity_ = 0;
+        // Most recently used first. Evicted handles stay open until their last reader releases them.
+        std::list<std::pair<std::string, HandlePtr>>                                    entries_;
+        std::unordered_map<std::string, std::list<std::pair<std::string, HandlePtr>>::iterator> index_;
+
+        void evict_();
+
+    public:
+        bool enabled() const;
+        std::size_t size() const;
+
+        // Set the maximum number of open handles, closing the least recently used ones beyond it.
+        void set_capacity(std::size_t capacity);
+
+        // Get the handle of the file, opening it on a miss. The second value tells whether the file was opened.
+        std::pair<HandlePtr, bool> acquire(const std::filesystem::path& path);
+
+        // Drop the handles of the path and of all files under it.
+        void invalidate(const std::filesystem::path& path);
+        void clear();
+    };
+
+} // namespace poppel::core
+
+#endif
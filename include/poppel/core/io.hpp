@@ -0,0 +1,138 @@
+#ifndef INCLUDE_POPPEL_CORE_IO_HPP_
+#define INCLUDE_POPPEL_CORE_IO_HPP_
+
+// Low level file access that cannot be expressed with iostreams, such as memory mapping.
+// These are implemented with POSIX interfaces. On other platforms, NotImplementedError is thrown,
+// unless a portable fallback is mentioned.
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "npy.hpp"
+#include "types.hpp"
+
+namespace poppel::core {
+
+    //----------------------------------
+    // Memory mapping.
+    //----------------------------------
+
+    // Read-only memory mapping of a whole file.
+    // The mapping is released when the object is destroyed.
+    class MappedFile {
+    private:
+        const std::byte* data_ = nullptr;
+        Size             size_ = 0;
+
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::filesystem::path& path);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept :
+            data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0))
+        {}
+        MappedFile& operator=(MappedFile&& other) noexcept {
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            return *this;
+        }
+
+        auto data() const noexcept { return data_; }
+        auto size() const noexcept { return size_; }
+    };
+
+    //----------------------------------
+    // File copy.
+    //----------------------------------
+
+    // Copy the whole content of src to dst, replacing dst.
+    // On Linux, dst is first made a reflink of src, sharing all extents on copy on write file systems such as btrfs and XFS.
+    // Otherwise data is copied within the kernel with copy_file_range or sendfile where available, which may also share extents on file systems that support it.
+    // Falls back to a buffered copy, and to std::filesystem::copy_file on other platforms.
+    void copy_file_contents(const std::filesystem::path& src, const std::filesystem::path& dst);
+    // Create dst with the content of src, like copy_file_contents(). dst must not exist.
+    // If hard_link is set, dst is made a hard link of src where possible, so that both names share the file and changes in place to either.
+    void clone_file(const std::filesystem::path& src, const std::filesystem::path& dst, bool hard_link);
+
+    //----------------------------------
+    // Streaming npy transfer.
+    //----------------------------------
+
+    // Save or load a whole npy file with the backend, like npy::save() and npy::load().
+    // The Posix and Direct backends are meant for arrays far larger than the page cache, and transfer data in blocks of several MiB.
+    // Other platforms use the Stream backend regardless.
+    // If checksum is not null, it is set to the CRC32C of the data, computed block by block while writing.
+    void save_npy(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, IoBackend backend, std::uint32_t* checksum = nullptr);
+    void load_npy(const std::filesystem::path& path, const npy::Header& header, std::byte* data, bool allow_reshape, IoBackend backend);
+
+    // Save or load a whole npy file like save_npy() and load_npy(), splitting the data into stripes transferred concurrently
+    // with pwrite and pread on the thread pool. The file format is the same.
+    // Stripes are aligned to multiples of stripe_size bytes in the file, so that with the stripe size of a striped parallel file system,
+    // such as Lustre or GPFS, each request covers a single storage target. Each thread takes every pool size-th stripe.
+    // Other platforms transfer serially. If checksum is not null, it is set to the CRC32C of the data, combined from the stripes.
+    void save_npy_parallel(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, ThreadPool& pool, std::size_t stripe_size, std::uint32_t* checksum = nullptr);
+    void load_npy_parallel(const std::filesystem::path& path, const npy::Header& header, std::byte* data, bool allow_reshape, ThreadPool& pool, std::size_t stripe_size);
+
+    //----------------------------------
+    // Strided npy save.
+    //----------------------------------
+
+    // Save an array from a strided buffer, such as a block of a larger matrix, without copying it to a contiguous buffer first.
+    // strides are the distances in items between neighbors on each axis, in the axis order of the header, and can be negative.
+    // Contiguous runs of at least a few KiB are written in place with batched writev. Shorter runs are gathered into a staging buffer.
+    // If checksum is not null, it is set to the CRC32C of the data in file order, computed while writing.
+    void save_npy_strided(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, const std::vector<std::ptrdiff_t>& strides, std::uint32_t* checksum = nullptr);
+
+    //----------------------------------
+    // File status.
+    //----------------------------------
+
+    // Stamp of the file with a single stat call. Returns empty if the file does not exist.
+    std::optional<FileStamp> file_stamp(const std::filesystem::path& path);
+
+    //----------------------------------
+    // File synchronization.
+    //----------------------------------
+
+    // Flush the file data to storage, with fdatasync where available.
+    void sync_file(const std::filesystem::path& path);
+    // Flush the directory entries to storage, so that files created or renamed in it survive a crash.
+    // Does nothing on platforms where directories cannot be synchronized.
+    void sync_directory(const std::filesystem::path& path);
+
+    // Typed, shaped read-only view into the data portion of a memory mapped npy file.
+    // The view owns the mapping, so the data pointer is valid as long as this object is alive.
+    template< typename T >
+    class MappedArray {
+    private:
+        MappedFile  file_;
+        npy::Header header_;
+        const T*    data_ = nullptr;
+
+    public:
+        MappedArray() = default;
+        MappedArray(MappedFile file, npy::Header header, Size data_offset) :
+            file_(std::move(file)),
+            header_(std::move(header)),
+            data_(reinterpret_cast<const T*>(file_.data() + data_offset))
+        {}
+
+        const T* data() const noexcept { return data_; }
+        const T& operator[](Index i) const noexcept { return data_[i]; }
+
+        const auto& header() const noexcept { return header_; }
+        const auto& shape() const noexcept { return header_.shape; }
+        bool fortran_order() const noexcept { return header_.fortran_order; }
+        Size length() const noexcept { return header_.length(); }
+    };
+
+} // namespace poppel::core
+
+#endif
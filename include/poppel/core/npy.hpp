@@ -5,6 +5,7 @@
 // Inspired by https://github.com/llohse/libnpy and https://github.com/pmontalb/NpyCpp.
 
 #include <algorithm>
+#include <array>
 #include <charconv>
 #include <complex>
 #include <cstddef>
@@ -12,8 +13,10 @@
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <initializer_list>
+#include <limits>
+#include <memory_resource>
 #include <new>
-#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -57,13 +60,14 @@ namespace poppel::npy {
         constexpr char char_no_endian = '|';
         constexpr char char_host_endian = (Endian::native == Endian::big ? char_big_endian : char_little_endian);
 
+        // Bytes are default initialized, so that resizing a buffer does not zero memory that is overwritten by loading anyway.
         struct MaxAlignByteAllocator {
             using value_type = std::byte;
             using pointer = value_type*;
 
             template< typename T >
             struct rebind {
-                using other = std::allocator<T>;
+                using other = std::conditional_t<std::is_same_v<T, std::byte>, MaxAlignByteAllocator, std::allocator<T>>;
             };
 
             static constexpr std::align_val_t align_value { alignof(std::max_align_t) };
@@ -74,9 +78,59 @@ namespace poppel::npy {
             void deallocate(pointer p, std::size_t n) {
                 ::operator delete(p, align_value);
             }
+
+            void construct(pointer p) noexcept {
+                ::new (static_cast<void*>(p)) value_type;
+            }
+            void construct(pointer p, value_type val) noexcept {
+                ::new (static_cast<void*>(p)) value_type(val);
+            }
+
+            friend bool operator==(const MaxAlignByteAllocator&, const MaxAlignByteAllocator&) noexcept { return true; }
+            friend bool operator!=(const MaxAlignByteAllocator&, const MaxAlignByteAllocator&) noexcept { return false; }
         };
         using MaxAlignCharVector = std::vector<std::byte, MaxAlignByteAllocator>;
 
+        // Like MaxAlignByteAllocator, but allocating from a memory resource, such as an arena or a pool of buffers.
+        // The resource must outlive the buffers allocated from it. Like std::pmr::polymorphic_allocator, it does not propagate on assignment.
+        struct PmrMaxAlignByteAllocator {
+            using value_type = std::byte;
+            using pointer = value_type*;
+
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
+            template< typename T >
+            struct rebind {
+                using other = std::conditional_t<std::is_same_v<T, std::byte>, PmrMaxAlignByteAllocator, std::pmr::polymorphic_allocator<T>>;
+            };
+
+            PmrMaxAlignByteAllocator() = default;
+            PmrMaxAlignByteAllocator(std::pmr::memory_resource* resource) noexcept : resource(resource) {}
+
+            pointer allocate(std::size_t n) {
+                return static_cast<pointer>(resource->allocate(n, alignof(std::max_align_t)));
+            }
+            void deallocate(pointer p, std::size_t n) {
+                resource->deallocate(p, n, alignof(std::max_align_t));
+            }
+
+            void construct(pointer p) noexcept {
+                ::new (static_cast<void*>(p)) value_type;
+            }
+            void construct(pointer p, value_type val) noexcept {
+                ::new (static_cast<void*>(p)) value_type(val);
+            }
+
+            // Copies of a buffer use the default resource, instead of sharing the resource of the original.
+            PmrMaxAlignByteAllocator select_on_container_copy_construction() const noexcept { return {}; }
+
+            friend bool operator==(const PmrMaxAlignByteAllocator& lhs, const PmrMaxAlignByteAllocator& rhs) noexcept {
+                return lhs.resource == rhs.resource || lhs.resource->is_equal(*rhs.resource);
+            }
+            friend bool operator!=(const PmrMaxAlignByteAllocator& lhs, const PmrMaxAlignByteAllocator& rhs) noexcept { return !(lhs == rhs); }
+        };
+        using PmrMaxAlignCharVector = std::vector<std::byte, PmrMaxAlignByteAllocator>;
+
     } // namespace internal
 
     template< typename T >
@@ -105,10 +159,108 @@ namespace poppel::npy {
         return !(lhs == rhs);
     }
 
+    // Array shape, with up to inline_capacity dimensions stored without heap allocation.
+    // It behaves as a minimal std::vector<Size>, and converts implicitly from and to it.
+    class Shape {
+    public:
+        using value_type     = internal::Size;
+        using size_type      = std::size_t;
+        using iterator       = value_type*;
+        using const_iterator = const value_type*;
+
+        static constexpr size_type inline_capacity = 8;
+
+    private:
+        std::array<value_type, inline_capacity> inline_ {};
+        std::vector<value_type>                 heap_;
+        size_type                               size_ = 0;
+
+        bool on_heap_() const noexcept { return size_ > inline_capacity; }
+
+    public:
+        Shape() = default;
+        Shape(std::initializer_list<value_type> dims) { assign(dims.begin(), dims.end()); }
+        Shape(const std::vector<value_type>& dims) { assign(dims.data(), dims.data() + dims.size()); }
+        Shape(size_type count, value_type value) { resize(count, value); }
+
+        Shape& operator=(const std::vector<value_type>& dims) {
+            assign(dims.data(), dims.data() + dims.size());
+            return *this;
+        }
+
+        operator std::vector<value_type>() const { return std::vector<value_type>(begin(), end()); }
+
+        void assign(const value_type* first, const value_type* last) {
+            const auto count = static_cast<size_type>(last - first);
+            if (count > inline_capacity) {
+                heap_.assign(first, last);
+            } else {
+                heap_.clear();
+                std::copy(first, last, inline_.begin());
+            }
+            size_ = count;
+        }
+
+        size_type size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+
+        value_type*       data()       noexcept { return on_heap_() ? heap_.data() : inline_.data(); }
+        const value_type* data() const noexcept { return on_heap_() ? heap_.data() : inline_.data(); }
+
+        iterator       begin()       noexcept { return data(); }
+        const_iterator begin() const noexcept { return data(); }
+        iterator       end()         noexcept { return data() + size_; }
+        const_iterator end()   const noexcept { return data() + size_; }
+
+        value_type&       operator[](size_type i)       noexcept { return data()[i]; }
+        const value_type& operator[](size_type i) const noexcept { return data()[i]; }
+        value_type&       front()       noexcept { return data()[0]; }
+        const value_type& front() const noexcept { return data()[0]; }
+        value_type&       back()        noexcept { return data()[size_ - 1]; }
+        const value_type& back()  const noexcept { return data()[size_ - 1]; }
+
+        void resize(size_type count, value_type value = 0) {
+            if (count > inline_capacity) {
+                if (!on_heap_()) {
+                    heap_.assign(inline_.begin(), inline_.begin() + size_);
+                }
+                heap_.resize(count, value);
+            } else {
+                if (on_heap_()) {
+                    std::copy(heap_.begin(), heap_.begin() + count, inline_.begin());
+                    heap_.clear();
+                } else if (count > size_) {
+                    std::fill(inline_.begin() + size_, inline_.begin() + count, value);
+                }
+            }
+            size_ = count;
+        }
+        value_type& emplace_back(value_type value = 0) {
+            resize(size_ + 1, value);
+            return back();
+        }
+        void push_back(value_type value) { emplace_back(value); }
+        void clear() noexcept {
+            heap_.clear();
+            size_ = 0;
+        }
+
+        friend bool operator==(const Shape& lhs, const Shape& rhs) {
+            return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+        }
+        friend bool operator!=(const Shape& lhs, const Shape& rhs) { return !(lhs == rhs); }
+        friend bool operator==(const Shape& lhs, const std::vector<value_type>& rhs) {
+            return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+        }
+        friend bool operator!=(const Shape& lhs, const std::vector<value_type>& rhs) { return !(lhs == rhs); }
+        friend bool operator==(const std::vector<value_type>& lhs, const Shape& rhs) { return rhs == lhs; }
+        friend bool operator!=(const std::vector<value_type>& lhs, const Shape& rhs) { return !(rhs == lhs); }
+    };
+
     struct Header {
         Dtype dtype;
         bool fortran_order = false;
-        std::vector<internal::Size> shape;
+        Shape shape;
 
         auto length() const noexcept {
             internal::Size ret = 1;
@@ -132,9 +284,18 @@ namespace poppel::npy {
         return (lhs.dtype == rhs.dtype) && (lhs.length() == rhs.length());
     }
 
-    struct NumpyArray {
+    // Header and data of a whole array, with the data buffer allocated by Allocator.
+    template< typename Allocator >
+    struct BasicNumpyArray {
         Header header;
-        internal::MaxAlignCharVector rawdata;
+        std::vector<std::byte, Allocator> rawdata;
+
+        BasicNumpyArray() = default;
+        BasicNumpyArray(Header header, std::vector<std::byte, Allocator> rawdata) :
+            header(std::move(header)), rawdata(std::move(rawdata))
+        {}
+        // Empty array with the data buffer allocated by the allocator, such as from a memory resource.
+        explicit BasicNumpyArray(const Allocator& allocator) : rawdata(allocator) {}
 
         template< typename T = std::byte >
         auto data() noexcept {
@@ -145,6 +306,26 @@ namespace poppel::npy {
             return reinterpret_cast<const T*>(rawdata.data());
         }
     };
+    using NumpyArray    = BasicNumpyArray<internal::MaxAlignByteAllocator>;
+    using PmrNumpyArray = BasicNumpyArray<internal::PmrMaxAlignByteAllocator>;
+
+    // Regular selection of a sub-array.
+    // On each axis, the selected indices are offset + i * stride, for i in [0, count).
+    // An empty stride means unit stride on all axes.
+    // Like the header shape, selections of up to Shape::inline_capacity dimensions are held without heap allocation.
+    struct Hyperslab {
+        Shape offset;
+        Shape count;
+        Shape stride;
+
+        auto length() const noexcept {
+            internal::Size ret = 1;
+            for (auto const& c : count) {
+                ret *= c;
+            }
+            return ret;
+        }
+    };
 
 
     namespace internal {
@@ -252,11 +433,67 @@ namespace poppel::npy {
             }
         }
 
+        // Header text in a fixed stack buffer, only spilling to the heap for unusually long headers,
+        // such as those with many dimensions or large padding.
+        class HeaderText {
+        public:
+            static constexpr std::size_t inline_capacity = 256;
+
+        private:
+            std::array<char, inline_capacity> inline_;
+            std::string                       heap_;
+            std::size_t                       length_ = 0;
+
+        public:
+            HeaderText() = default;
+            // Text of the length filled with spaces, to be overwritten through data().
+            explicit HeaderText(std::size_t length) { resize(length, ' '); }
+
+            char* data() noexcept { return length_ > inline_capacity ? heap_.data() : inline_.data(); }
+            const char* data() const noexcept { return length_ > inline_capacity ? heap_.data() : inline_.data(); }
+            std::size_t length() const noexcept { return length_; }
+            std::string_view view() const noexcept { return { data(), length_ }; }
+            operator std::string_view() const noexcept { return view(); }
+
+            void resize(std::size_t length, char ch) {
+                if (length > inline_capacity) {
+                    if (length_ <= inline_capacity) {
+                        heap_.assign(inline_.data(), length_);
+                    }
+                    heap_.resize(length, ch);
+                } else {
+                    if (length_ > inline_capacity) {
+                        std::copy(heap_.data(), heap_.data() + length, inline_.data());
+                        heap_.clear();
+                    } else if (length > length_) {
+                        std::fill(inline_.data() + length_, inline_.data() + length, ch);
+                    }
+                }
+                length_ = length;
+            }
+            void append(std::string_view sv) {
+                const auto old_length = length_;
+                resize(length_ + sv.length(), ' ');
+                std::copy(sv.begin(), sv.end(), data() + old_length);
+            }
+            void append(char ch) { resize(length_ + 1, ch); }
+            void append_integer(Size value) {
+                char buf[24];
+                const auto res = std::to_chars(buf, buf + sizeof(buf), value);
+                append(std::string_view(buf, res.ptr - buf));
+            }
+        };
+
         // No quote.
+        inline void append_descr(HeaderText& text, Dtype dtype) {
+            text.append(dtype.byteorder);
+            text.append(dtype.kind);
+            text.append_integer(dtype.itemsize / kind_size_multiplier(dtype.kind));
+        }
         inline std::string gen_descr(Dtype dtype) {
-            std::ostringstream oss;
-            oss << dtype.byteorder << dtype.kind << (dtype.itemsize / kind_size_multiplier(dtype.kind));
-            return oss.str();
+            HeaderText text;
+            append_descr(text, dtype);
+            return std::string(text.view());
         }
 
         // No quote.
@@ -272,33 +509,39 @@ namespace poppel::npy {
         }
 
         // No parentheses.
-        inline std::string gen_shape(const std::vector<Size>& shape) {
-            if(shape.size() == 0) {
-                return "";
-            }
-            else if(shape.size() == 1) {
-                return std::to_string(shape.front()) + ",";
+        inline void append_shape(HeaderText& text, const Shape& shape) {
+            if(shape.size() == 1) {
+                text.append_integer(shape.front());
+                text.append(',');
             }
             else {
-                std::ostringstream ss;
-                for(Index i = 0; i < shape.size() - 1; ++i) {
-                    ss << shape[i] << ", ";
+                for(std::size_t i = 0; i < shape.size(); ++i) {
+                    if(i > 0) {
+                        text.append(", ");
+                    }
+                    text.append_integer(shape[i]);
                 }
-                ss << shape.back();
-                return ss.str();
             }
         }
+        inline std::string gen_shape(const Shape& shape) {
+            HeaderText text;
+            append_shape(text, shape);
+            return std::string(text.view());
+        }
 
         // No parentheses.
-        inline std::vector<Size> parse_shape(std::string_view sv_shape) {
-            std::vector<Size> shape;
+        inline Shape parse_shape(std::string_view sv_shape) {
+            Shape shape;
             while(!sv_shape.empty()) {
                 auto loc_comma = sv_shape.find(',');
                 // loc_comma can be npos.
                 auto sv_this_shape = trim(sv_shape.substr(0, loc_comma));
                 if(!sv_this_shape.empty()) {
                     auto& this_shape = shape.emplace_back();
-                    std::from_chars(sv_this_shape.data(), sv_this_shape.data() + sv_this_shape.size(), this_shape);
+                    const auto res = std::from_chars(sv_this_shape.data(), sv_this_shape.data() + sv_this_shape.size(), this_shape);
+                    if(res.ec != std::errc {} || res.ptr != sv_this_shape.data() + sv_this_shape.size()) {
+                        throw std::runtime_error("invalid shape in header");
+                    }
                 }
                 if(loc_comma == std::string_view::npos) {
                     break;
@@ -308,29 +551,32 @@ namespace poppel::npy {
             return shape;
         }
 
-        inline std::string gen_header(Version version, const Header& header) {
-            std::ostringstream ss;
-            ss << '{';
-
-            ss << "'descr': '" << gen_descr(header.dtype) << "', ";
-            ss << "'fortran_order': " << (header.fortran_order ? "True" : "False") << ", ";
-            ss << "'shape': (" << gen_shape(header.shape) << "), ";
-
-            ss << '}';
-
-            auto ret = ss.str();
-
-            const auto expected_length = preamble_length(version) + ret.length() + 1;
-            const auto padding_length = (expected_length % header_alignment == 0 ? 0 : header_alignment - expected_length % header_alignment);
-            ret.resize(ret.length() + padding_length, ' ');
-            ret.push_back('\n');
+        // The header is padded with spaces to be at least min_length long, including the trailing newline.
+        inline HeaderText gen_header(Version version, const Header& header, Size min_length = 0) {
+            HeaderText ret;
+            ret.append("{'descr': '");
+            append_descr(ret, header.dtype);
+            ret.append("', 'fortran_order': ");
+            ret.append(header.fortran_order ? "True" : "False");
+            ret.append(", 'shape': (");
+            append_shape(ret, header.shape);
+            ret.append("), }");
+
+            const Size length = ret.length();
+            const auto expected_length = preamble_length(version) + length + 1;
+            const auto padding_length = std::max<Size>(
+                expected_length % header_alignment == 0 ? 0 : header_alignment - expected_length % header_alignment,
+                min_length - length - 1
+            );
+            ret.resize(length + padding_length, ' ');
+            ret.append('\n');
             return ret;
         }
 
         inline Header parse_header(std::string_view sv) {
 
             // Remove trailing newline, as well as sandwiching whitespaces.
-            if (sv.back() != '\n') {
+            if (sv.empty() || sv.back() != '\n') {
                 throw std::runtime_error("invalid header");
             }
             sv.remove_suffix(1);
@@ -403,27 +649,44 @@ namespace poppel::npy {
                 os.write(reinterpret_cast<char *>(header_len_le32), 4);
             }
 
-            os << header;
+            os.write(header.data(), header.length());
         }
 
-        inline std::string read_header(std::istream &is) {
+        // Write the preamble and the header to a buffer of at least preamble_length(version) + header.length() bytes.
+        inline void write_header(std::byte* buffer, Version version, std::string_view header) {
+            const auto bytes = reinterpret_cast<unsigned char*>(buffer);
+            std::memcpy(bytes, magic_string, magic_string_length);
+            bytes[magic_string_length] = version.major;
+            bytes[magic_string_length + 1] = version.minor;
+
+            const auto header_len = static_cast<std::uint32_t>(header.length());
+            bytes[magic_string_length + 2] = (header_len >> 0) & 0xff;
+            bytes[magic_string_length + 3] = (header_len >> 8) & 0xff;
+            if (version != Version {1, 0}) {
+                bytes[magic_string_length + 4] = (header_len >> 16) & 0xff;
+                bytes[magic_string_length + 5] = (header_len >> 24) & 0xff;
+            }
+            std::memcpy(bytes + preamble_length(version), header.data(), header.length());
+        }
+
+        inline HeaderText read_header(std::istream &is) {
             // check magic bytes an version number
             const auto version = read_magic(is);
 
             std::uint32_t header_length;
             if (version == Version {1, 0}) {
-                char header_len_le16[2];
-                is.read(header_len_le16, 2);
+                unsigned char header_len_le16[2];
+                is.read(reinterpret_cast<char*>(header_len_le16), 2);
                 header_length = (header_len_le16[0] << 0) | (header_len_le16[1] << 8);
 
                 if ((preamble_length(version) + header_length) % header_alignment != 0) {
                     // TODO: display warning
                 }
             } else if (version == Version {2, 0} || version == Version {3, 0}) {
-                char header_len_le32[4];
-                is.read(header_len_le32, 4);
+                unsigned char header_len_le32[4];
+                is.read(reinterpret_cast<char*>(header_len_le32), 4);
 
-                header_length = (header_len_le32[0] << 0) | (header_len_le32[1] << 8) | (header_len_le32[2] << 16) | (header_len_le32[3] << 24);
+                header_length = (header_len_le32[0] << 0) | (header_len_le32[1] << 8) | (header_len_le32[2] << 16) | (static_cast<std::uint32_t>(header_len_le32[3]) << 24);
 
                 if ((preamble_length(version) + header_length) % header_alignment != 0) {
                     // TODO: display warning
@@ -432,11 +695,46 @@ namespace poppel::npy {
                 throw std::runtime_error("unsupported file format version");
             }
 
-            std::string header(header_length, 0);
+            if (!is) {
+                throw std::runtime_error("io error: failed reading file");
+            }
+
+            HeaderText header(header_length);
             is.read(header.data(), header_length);
+            if (!is) {
+                throw std::runtime_error("io error: failed reading file");
+            }
 
             return header;
         }
+
+        // Locate the header in an in-memory file image.
+        // Returns the header string and the offset of the data portion.
+        inline std::pair<std::string_view, Size> split_header(const std::byte* image, Size size) {
+            const auto bytes = reinterpret_cast<const unsigned char*>(image);
+            if (size < magic_string_length + 2 || 0 != std::memcmp(bytes, magic_string, magic_string_length)) {
+                throw std::runtime_error("this file does not have a valid npy format.");
+            }
+
+            const Version version { bytes[magic_string_length], bytes[magic_string_length + 1] };
+            if (version != Version {1, 0} && version != Version {2, 0} && version != Version {3, 0}) {
+                throw std::runtime_error("unsupported file format version");
+            }
+
+            const auto preamble = preamble_length(version);
+            if (size < preamble) {
+                throw std::runtime_error("io error: failed reading file");
+            }
+            std::uint32_t header_length = bytes[magic_string_length + 2] | (bytes[magic_string_length + 3] << 8);
+            if (version != Version {1, 0}) {
+                header_length |= (static_cast<std::uint32_t>(bytes[magic_string_length + 4]) << 16) | (static_cast<std::uint32_t>(bytes[magic_string_length + 5]) << 24);
+            }
+            if (size < preamble + header_length) {
+                throw std::runtime_error("io error: failed reading file");
+            }
+
+            return { std::string_view(reinterpret_cast<const char*>(image) + preamble, header_length), preamble + header_length };
+        }
     } // namespace internal
 
     // Helper to create header with compile-time type information.
@@ -454,6 +752,33 @@ namespace poppel::npy {
         os.write(reinterpret_cast<const char*>(data), data_len);
     }
 
+    namespace internal {
+        // The axis along which an appendable array grows, so that appended data is contiguous to existing data.
+        // It is the first axis in C order, and the last axis in Fortran order.
+        inline Size growth_axis(const Header& header) {
+            if (header.shape.empty()) {
+                throw std::runtime_error("0-dimensional array cannot be appended");
+            }
+            return header.fortran_order ? header.shape.size() - 1 : 0;
+        }
+
+        // Header length that can hold any length on the growth axis.
+        inline Size growable_header_length(Version version, Header header) {
+            header.shape[growth_axis(header)] = std::numeric_limits<Size>::max();
+            return gen_header(version, header).length();
+        }
+    } // namespace internal
+
+    // Core function to save data that can be appended later.
+    // The header is padded so that the length of the growth axis can be rewritten in place.
+    inline void save_appendable(std::ostream& os, const Header& header, const std::byte* data) {
+        const Version version { 3, 0 };
+        internal::write_header(os, version, internal::gen_header(version, header, internal::growable_header_length(version, header)));
+
+        const auto data_len = header.numbytes();
+        os.write(reinterpret_cast<const char*>(data), data_len);
+    }
+
     // Core function to load header only.
     // Precondition:
     // - is points to the beginning of the file.
@@ -461,23 +786,46 @@ namespace poppel::npy {
         return internal::parse_header(internal::read_header(is));
     }
 
+    // Core function to load header from an in-memory file image, such as a memory mapped file.
+    // Returns the header and the offset of the data portion.
+    inline std::pair<Header, internal::Size> load_header(const std::byte* image, internal::Size size) {
+        const auto [sv_header, data_offset] = internal::split_header(image, size);
+        return { internal::parse_header(sv_header), data_offset };
+    }
+
     // Core function to load data portion only.
     // Precondition:
     // - is points to the start of the data portion.
     // - data points to a buffer of at least numbytes bytes.
+    // Throws if fewer than numbytes bytes are read, such as from a truncated file.
     inline void load_data(std::istream& is, std::byte* data, internal::Size numbytes) {
         is.read(reinterpret_cast<char*>(data), numbytes);
+        if (!is || is.gcount() != numbytes) {
+            throw std::runtime_error("io error: failed reading file");
+        }
+    }
+
+    // Core function to load all data to the array, reusing the capacity of its buffer.
+    // The buffer is resized without zeroing, and only grows if the data does not fit in its capacity.
+    template< typename Allocator >
+    inline void load(std::istream& is, BasicNumpyArray<Allocator>& array) {
+        array.header = load_header(is);
+
+        const auto numbytes = array.header.numbytes();
+        array.rawdata.resize(numbytes);
+        load_data(is, array.rawdata.data(), numbytes);
     }
 
     // Core function to load all data to a managed buffer.
     inline NumpyArray load(std::istream& is) {
         NumpyArray ret;
-        ret.header = load_header(is);
-
-        const auto numbytes = ret.header.numbytes();
-        ret.rawdata.resize(numbytes);
-        load_data(is, ret.rawdata.data(), numbytes);
-
+        load(is, ret);
+        return ret;
+    }
+    // Core function to load all data to a buffer allocated from the memory resource.
+    inline PmrNumpyArray load(std::istream& is, std::pmr::memory_resource* resource) {
+        PmrNumpyArray ret { internal::PmrMaxAlignByteAllocator(resource) };
+        load(is, ret);
         return ret;
     }
 
@@ -496,6 +844,329 @@ namespace poppel::npy {
         load_data(is, data, numbytes);
     }
 
+    //----------------------------------
+    // Data type conversion.
+    //----------------------------------
+
+    namespace internal {
+        // Number of elements converted at a time when the file data cannot be read in place.
+        constexpr Size convert_block_length = 8192;
+
+        // Written with shifts so that compilers emit bswap instructions and vectorize the loops below.
+        constexpr std::uint16_t byteswap(std::uint16_t x) {
+            return static_cast<std::uint16_t>((x >> 8) | (x << 8));
+        }
+        constexpr std::uint32_t byteswap(std::uint32_t x) {
+            return ((x & 0x000000ffu) << 24) | ((x & 0x0000ff00u) << 8) | ((x & 0x00ff0000u) >> 8) | ((x & 0xff000000u) >> 24);
+        }
+        constexpr std::uint64_t byteswap(std::uint64_t x) {
+            return (static_cast<std::uint64_t>(byteswap(static_cast<std::uint32_t>(x))) << 32) | byteswap(static_cast<std::uint32_t>(x >> 32));
+        }
+
+        template< typename U >
+        inline void byteswap_words(std::byte* data, Size length) {
+            for (Size i = 0; i < length; ++i) {
+                U word;
+                std::memcpy(&word, data + i * sizeof(U), sizeof(U));
+                word = byteswap(word);
+                std::memcpy(data + i * sizeof(U), &word, sizeof(U));
+            }
+        }
+
+        // Whether data of the dtype has the opposite byte order to the host.
+        constexpr bool is_byteswapped(Dtype dtype) {
+            return dtype.itemsize > 1 && (dtype.byteorder == char_little_endian || dtype.byteorder == char_big_endian) && dtype.byteorder != char_host_endian;
+        }
+
+        // Reverse the bytes of each item in place. Complex items are reversed per component.
+        inline void byteswap_inplace(std::byte* data, Dtype dtype, Size length) {
+            const auto word_size = dtype.kind == 'c' ? dtype.itemsize / 2 : dtype.itemsize;
+            const auto num_words = length * (dtype.itemsize / word_size);
+            switch (word_size) {
+                case 1: break;
+                case 2: byteswap_words<std::uint16_t>(data, num_words); break;
+                case 4: byteswap_words<std::uint32_t>(data, num_words); break;
+                case 8: byteswap_words<std::uint64_t>(data, num_words); break;
+                default: throw std::runtime_error("unsupported item size for byte swapping");
+            }
+        }
+
+        // Call func with a value of the native type of the dtype, regardless of byte order.
+        // Returns false if the dtype has no native type.
+        template< typename Func >
+        inline bool visit_native_type(Dtype dtype, Func&& func) {
+            switch (dtype.kind) {
+                case 'b':
+                    if (dtype.itemsize == 1) { func(bool{}); return true; }
+                    break;
+                case 'i':
+                    switch (dtype.itemsize) {
+                        case 1: func(std::int8_t{});  return true;
+                        case 2: func(std::int16_t{}); return true;
+                        case 4: func(std::int32_t{}); return true;
+                        case 8: func(std::int64_t{}); return true;
+                    }
+                    break;
+                case 'u':
+                    switch (dtype.itemsize) {
+                        case 1: func(std::uint8_t{});  return true;
+                        case 2: func(std::uint16_t{}); return true;
+                        case 4: func(std::uint32_t{}); return true;
+                        case 8: func(std::uint64_t{}); return true;
+                    }
+                    break;
+                case 'f':
+                    switch (dtype.itemsize) {
+                        case 4: func(float{});  return true;
+                        case 8: func(double{}); return true;
+                    }
+                    break;
+                case 'c':
+                    switch (dtype.itemsize) {
+                        case 8:  func(std::complex<float>{});  return true;
+                        case 16: func(std::complex<double>{}); return true;
+                    }
+                    break;
+            }
+            return false;
+        }
+
+        template< typename T > constexpr bool is_complex = false;
+        template< typename T > constexpr bool is_complex<std::complex<T>> = true;
+
+        template< typename To, typename From >
+        inline To convert_value(From x) {
+            if constexpr (is_complex<To> && !is_complex<From>) {
+                return To(static_cast<typename To::value_type>(x));
+            } else {
+                return static_cast<To>(x);
+            }
+        }
+
+        // Whether data of dtype from can be loaded as dtype to.
+        // Same types in either byte order, casts between bool, integer and floating point types,
+        // and from real to complex types are supported. Complex data cannot be narrowed to real.
+        inline bool is_convertible(Dtype from, Dtype to) {
+            bool from_native = false, from_complex = false, to_native = false, to_complex = false;
+            from_native = visit_native_type(from, [&](auto x) { from_complex = is_complex<decltype(x)>; });
+            to_native = visit_native_type(to, [&](auto x) { to_complex = is_complex<decltype(x)>; });
+            if (from == to) {
+                return true;
+            }
+            return from_native && to_native && (to_complex || !from_complex);
+        }
+
+        // Convert length items of native byte order.
+        // Precondition:
+        // - is_convertible(from, to) and neither is byteswapped.
+        inline void convert_data(const std::byte* src, Dtype from, std::byte* dst, Dtype to, Size length) {
+            visit_native_type(from, [&](auto x) {
+                using From = decltype(x);
+                visit_native_type(to, [&](auto y) {
+                    using To = decltype(y);
+                    if constexpr (!is_complex<From> || is_complex<To>) {
+                        for (Size i = 0; i < length; ++i) {
+                            From value;
+                            std::memcpy(&value, src + i * sizeof(From), sizeof(From));
+                            const To converted = convert_value<To>(value);
+                            std::memcpy(dst + i * sizeof(To), &converted, sizeof(To));
+                        }
+                    }
+                });
+            });
+        }
+
+        // Convert length items in any byte order. The source buffer is used as scratch space for byte swapping.
+        // Precondition:
+        // - is_convertible(from, to).
+        inline void convert_buffer(std::byte* src, Dtype from, std::byte* dst, Dtype to, Size length) {
+            if (is_byteswapped(from)) {
+                byteswap_inplace(src, from, length);
+            }
+            convert_data(src, Dtype { char_host_endian, from.kind, from.itemsize }, dst, Dtype { char_host_endian, to.kind, to.itemsize }, length);
+            if (is_byteswapped(to)) {
+                byteswap_inplace(dst, to, length);
+            }
+        }
+
+        // Load length items of dtype from in the stream to the buffer of dtype to.
+        // Items of the same size are read in place. Otherwise they are staged in a small fixed-size block.
+        inline void load_convert_data(std::istream& is, Dtype from, Dtype to, std::byte* data, Size length) {
+            if (from.kind == to.kind && from.itemsize == to.itemsize) {
+                load_data(is, data, length * from.itemsize);
+                if (is_byteswapped(from) != is_byteswapped(to)) {
+                    byteswap_inplace(data, from, length);
+                }
+                return;
+            }
+
+            MaxAlignCharVector block;
+            block.resize(std::min(length, convert_block_length) * from.itemsize);
+            for (Size begin = 0; begin < length; begin += convert_block_length) {
+                const auto block_length = std::min(convert_block_length, length - begin);
+                load_data(is, block.data(), block_length * from.itemsize);
+                convert_buffer(block.data(), from, data + begin * to.itemsize, to, block_length);
+            }
+        }
+    } // namespace internal
+
+    // Core function to load all data to a pre-allocated buffer, converting the data type if needed.
+    // The shape and index order are checked like load(), but the data type of the file only needs to be convertible to that of the header.
+    // Conversions follow static_cast, so out of range values are not checked.
+    inline void load_convert(std::istream& is, Header header, std::byte* data, bool allow_reshape) {
+        const auto loaded_header = load_header(is);
+        const bool shape_match = allow_reshape
+            ? loaded_header.length() == header.length()
+            : (loaded_header.fortran_order == header.fortran_order && loaded_header.shape == header.shape);
+        if (!shape_match) {
+            throw std::runtime_error("header information mismatch");
+        }
+        if (!internal::is_convertible(loaded_header.dtype, header.dtype)) {
+            throw std::runtime_error("array dtype is not convertible");
+        }
+        internal::load_convert_data(is, loaded_header.dtype, header.dtype, data, header.length());
+        if (!is) {
+            throw std::runtime_error("io error: failed reading file");
+        }
+    }
+
+    namespace internal {
+        // Largest gap (in bytes) between selected elements on the fastest axis that is read through instead of seeked past.
+        constexpr Size region_max_gap_read = 4096;
+
+        // Load the selected region of the data portion, in the same index order as the file.
+        // read_at(out, count, offset) reads count bytes at the offset from the start of the data portion, and throws on failure.
+        // Precondition:
+        // - The hyperslab is valid for the header.
+        template< typename ReadAt >
+        inline void load_region_data_at(ReadAt&& read_at, const Header& header, const Hyperslab& slab, std::byte* data) {
+            const Size rank = header.shape.size();
+            const Size itemsize = header.dtype.itemsize;
+
+            // Reorder axes from the slowest varying to the fastest varying in the file.
+            std::vector<Size> dims(rank), off(rank), cnt(rank), str(rank);
+            for (Index i = 0; i < rank; ++i) {
+                const Index axis = header.fortran_order ? rank - 1 - i : i;
+                dims[i] = header.shape[axis];
+                off[i]  = slab.offset[axis];
+                cnt[i]  = slab.count[axis];
+                str[i]  = slab.stride.empty() ? 1 : slab.stride[axis];
+            }
+            std::vector<Size> file_stride(rank);
+            for (Index i = rank - 1, acc = itemsize; i >= 0; --i) {
+                file_stride[i] = acc;
+                acc *= dims[i];
+            }
+
+            // Merge the fastest axes into one contiguous run, as long as each inner axis is fully selected.
+            Size run_length = itemsize;
+            Index num_outer = rank;
+            while (num_outer > 0 && str[num_outer - 1] == 1) {
+                --num_outer;
+                run_length *= cnt[num_outer];
+                if (cnt[num_outer] != dims[num_outer]) {
+                    break;
+                }
+            }
+
+            // If the fastest axis is strided with small gaps, read the span covering it at once, then pick the elements.
+            const bool gather_fastest = num_outer == rank && rank > 0
+                && str[rank - 1] * itemsize - itemsize <= region_max_gap_read;
+            if (gather_fastest) {
+                --num_outer;
+            }
+            const Size span_length = gather_fastest ? ((cnt[rank - 1] - 1) * str[rank - 1] + 1) * itemsize : run_length;
+            std::vector<char> span(gather_fastest ? span_length : 0);
+
+            Size base = 0;
+            for (Index i = 0; i < rank; ++i) {
+                base += off[i] * file_stride[i];
+            }
+
+            std::vector<Size> idx(num_outer, 0);
+            auto out = reinterpret_cast<char*>(data);
+            while (true) {
+                Size target = base;
+                for (Index i = 0; i < num_outer; ++i) {
+                    target += idx[i] * str[i] * file_stride[i];
+                }
+                if (gather_fastest) {
+                    read_at(span.data(), span_length, target);
+                    for (Size j = 0; j < cnt[rank - 1]; ++j) {
+                        std::memcpy(out, span.data() + j * str[rank - 1] * itemsize, itemsize);
+                        out += itemsize;
+                    }
+                } else {
+                    read_at(out, run_length, target);
+                    out += run_length;
+                }
+
+                // Advance the multi-index over outer axes.
+                Index axis = num_outer - 1;
+                for (; axis >= 0; --axis) {
+                    if (++idx[axis] < cnt[axis]) {
+                        break;
+                    }
+                    idx[axis] = 0;
+                }
+                if (axis < 0) {
+                    break;
+                }
+            }
+        }
+
+        // Load the selected region of the data portion from the stream, seeking only where the selection is not contiguous.
+        // Precondition:
+        // - The hyperslab is valid for the header.
+        // - data_start is the stream position of the start of the data portion.
+        inline void load_region_data(std::istream& is, std::streamoff data_start, const Header& header, const Hyperslab& slab, std::byte* data) {
+            std::streamoff pos = -1;
+            load_region_data_at([&](char* out, Size count, Size offset) {
+                const std::streamoff target = data_start + offset;
+                if (target != pos) {
+                    is.seekg(target);
+                }
+                is.read(out, count);
+                if (!is) {
+                    throw std::runtime_error("io error: failed reading file");
+                }
+                pos = target + count;
+            }, header, slab, data);
+        }
+
+        inline void assert_valid_hyperslab(const Header& header, const Hyperslab& slab) {
+            const auto rank = header.shape.size();
+            if (slab.offset.size() != rank || slab.count.size() != rank || (!slab.stride.empty() && slab.stride.size() != rank)) {
+                throw std::runtime_error("hyperslab rank does not match array");
+            }
+            for (std::size_t i = 0; i < rank; ++i) {
+                const Size stride = slab.stride.empty() ? 1 : slab.stride[i];
+                if (slab.offset[i] < 0 || slab.count[i] < 0 || stride < 1) {
+                    throw std::runtime_error("invalid hyperslab");
+                }
+                if (slab.count[i] > 0 && slab.offset[i] + (slab.count[i] - 1) * stride >= header.shape[i]) {
+                    throw std::runtime_error("hyperslab is out of bounds");
+                }
+            }
+        }
+    } // namespace internal
+
+    // Core function to load a hyperslab of the data to a pre-allocated buffer with known type.
+    // Only the selected portion of the data is read. Data is stored in the same index order as the file.
+    // Returns the header describing the loaded region.
+    inline Header load_region(std::istream& is, Dtype dtype, const Hyperslab& slab, std::byte* data) {
+        const auto loaded_header = load_header(is);
+        if (loaded_header.dtype != dtype) {
+            throw std::runtime_error("array dtype is not match");
+        }
+        internal::assert_valid_hyperslab(loaded_header, slab);
+
+        if (slab.length() > 0) {
+            internal::load_region_data(is, is.tellg(), loaded_header, slab, data);
+        }
+        return Header { dtype, loaded_header.fortran_order, slab.count };
+    }
+
     namespace internal {
         inline std::ofstream open_file_for_save(const std::filesystem::path& filename) {
             std::ofstream ofs(filename, std::ios::binary);
@@ -533,6 +1204,15 @@ namespace poppel::npy {
         save(ofs, header, data);
     }
 
+    inline void save_appendable(const std::filesystem::path& filename, const Header& header, const std::byte* data) {
+        auto ofs = internal::open_file_for_save(filename);
+        save_appendable(ofs, header, data);
+    }
+    inline void save_appendable(std::string_view filename, const Header& header, const std::byte* data) {
+        auto ofs = internal::open_file_for_save(filename);
+        save_appendable(ofs, header, data);
+    }
+
     // Save scalar data.
     template< typename T, std::enable_if_t< is_scalar<T> >* = nullptr >
     inline void save(std::ostream& os, T data) {
@@ -582,6 +1262,10 @@ namespace poppel::npy {
     inline NumpyArray load(std::string_view filename) {
         return load(std::filesystem::path(filename));
     }
+    inline PmrNumpyArray load(const std::filesystem::path& filename, std::pmr::memory_resource* resource) {
+        auto ifs = internal::open_file_for_load(filename);
+        return load(ifs, resource);
+    }
     inline void load(const std::filesystem::path& filename, Header header, std::byte* data, bool allow_reshape) {
         auto ifs = internal::open_file_for_load(filename);
         load(ifs, header, data, allow_reshape);
@@ -589,6 +1273,20 @@ namespace poppel::npy {
     inline void load(std::string_view filename, Header header, std::byte* data, bool allow_reshape) {
         load(std::filesystem::path(filename), header, data, allow_reshape);
     }
+    inline void load_convert(const std::filesystem::path& filename, Header header, std::byte* data, bool allow_reshape) {
+        auto ifs = internal::open_file_for_load(filename);
+        load_convert(ifs, header, data, allow_reshape);
+    }
+    inline void load_convert(std::string_view filename, Header header, std::byte* data, bool allow_reshape) {
+        load_convert(std::filesystem::path(filename), header, data, allow_reshape);
+    }
+    inline Header load_region(const std::filesystem::path& filename, Dtype dtype, const Hyperslab& slab, std::byte* data) {
+        auto ifs = internal::open_file_for_load(filename);
+        return load_region(ifs, dtype, slab, data);
+    }
+    inline Header load_region(std::string_view filename, Dtype dtype, const Hyperslab& slab, std::byte* data) {
+        return load_region(std::filesystem::path(filename), dtype, slab, data);
+    }
 
     // Load scalar data.
     template< typename T, std::enable_if_t< is_scalar<T> >* = nullptr >
@@ -639,6 +1337,149 @@ namespace poppel::npy {
         load(ifs, data);
     }
 
+    //----------------------------------
+    // Appending.
+    //----------------------------------
+
+    // Appends data along the growth axis of an existing npy file.
+    // Data is written after the existing data, and only the shape in the header is rewritten.
+    // Appends smaller than the buffer size are batched, and written when the buffer is full, on flush() or on destruction.
+    //
+    // The header must have room for the new shape, which is guaranteed for files written with save_appendable().
+    class Appender {
+    private:
+        std::fstream                 fs_;
+        Version                      version_;
+        Header                       header_;
+        internal::Size               header_length_ = 0;
+        internal::Size               slab_numbytes_ = 0;
+        std::streamoff               data_end_ = 0;
+        internal::MaxAlignCharVector buffer_;
+        internal::Size               buffer_numbytes_ = 0;
+        internal::Size               pending_count_ = 0;
+
+        void write_data(const std::byte* data, internal::Size count) {
+            fs_.seekp(data_end_);
+            fs_.write(reinterpret_cast<const char*>(data), count * slab_numbytes_);
+            data_end_ += count * slab_numbytes_;
+            header_.shape[internal::growth_axis(header_)] += count;
+        }
+        void write_shape() {
+            const auto sv_header = internal::gen_header(version_, header_, header_length_);
+            if (static_cast<internal::Size>(sv_header.length()) != header_length_) {
+                throw std::runtime_error("npy header has no room for the appended shape");
+            }
+            fs_.seekp(0);
+            internal::write_header(fs_, version_, sv_header);
+            fs_.flush();
+            if (!fs_) {
+                throw std::runtime_error("io error: failed writing file");
+            }
+        }
+
+    public:
+        static constexpr internal::Size default_buffer_numbytes = 4 << 20;
+
+        Appender(const std::filesystem::path& filename, Dtype dtype, internal::Size buffer_numbytes = default_buffer_numbytes) :
+            fs_(filename, std::ios::in | std::ios::out | std::ios::binary),
+            buffer_numbytes_(buffer_numbytes)
+        {
+            if (!fs_) {
+                throw std::runtime_error("cannot open file for append");
+            }
+            version_ = internal::read_magic(fs_);
+            fs_.seekg(0);
+            header_ = load_header(fs_);
+            if (header_.dtype != dtype) {
+                throw std::runtime_error("array dtype is not match");
+            }
+            const auto axis = internal::growth_axis(header_);
+
+            const auto data_start = static_cast<std::streamoff>(fs_.tellg());
+            header_length_ = data_start - internal::preamble_length(version_);
+            data_end_ = data_start + header_.numbytes();
+            slab_numbytes_ = dtype.itemsize;
+            for (std::size_t i = 0; i < header_.shape.size(); ++i) {
+                if (static_cast<internal::Size>(i) != axis) {
+                    slab_numbytes_ *= header_.shape[i];
+                }
+            }
+            buffer_.reserve(buffer_numbytes_);
+        }
+
+        Appender(Appender&&) = default;
+        // Batched data of this appender is flushed before taking over the other one.
+        Appender& operator=(Appender&& other) {
+            if (this != &other) {
+                if (fs_.is_open()) {
+                    flush();
+                }
+                fs_ = std::move(other.fs_);
+                version_ = other.version_;
+                header_ = std::move(other.header_);
+                header_length_ = other.header_length_;
+                slab_numbytes_ = other.slab_numbytes_;
+                data_end_ = other.data_end_;
+                buffer_ = std::move(other.buffer_);
+                buffer_numbytes_ = other.buffer_numbytes_;
+                pending_count_ = std::exchange(other.pending_count_, 0);
+            }
+            return *this;
+        }
+
+        ~Appender() {
+            try {
+                if (fs_.is_open()) {
+                    flush();
+                }
+            } catch (...) {
+                // Destructor must not throw. Call flush() explicitly to observe errors.
+            }
+        }
+
+        // Header describing the data, including those not yet flushed.
+        auto header() const {
+            auto ret = header_;
+            ret.shape[internal::growth_axis(ret)] += pending_count_;
+            return ret;
+        }
+
+        // Number of bytes of one slab along the growth axis.
+        auto slab_numbytes() const noexcept { return slab_numbytes_; }
+
+        // Append count slabs. A slab has the shape of the array with the growth axis removed.
+        void append(const std::byte* data, internal::Size count) {
+            const auto numbytes = count * slab_numbytes_;
+            if (static_cast<internal::Size>(buffer_.size()) + numbytes > buffer_numbytes_) {
+                flush();
+            }
+            if (numbytes >= buffer_numbytes_) {
+                write_data(data, count);
+                write_shape();
+            } else {
+                buffer_.insert(buffer_.end(), data, data + numbytes);
+                pending_count_ += count;
+            }
+        }
+        template< typename T, std::enable_if_t< is_scalar<T> >* = nullptr >
+        void append(const T* data, internal::Size count) {
+            if (header_.dtype != internal::dtype(T{})) {
+                throw std::runtime_error("array dtype is not match");
+            }
+            append(reinterpret_cast<const std::byte*>(data), count);
+        }
+
+        // Write all batched data, and update the shape in the header.
+        void flush() {
+            if (pending_count_ > 0) {
+                write_data(buffer_.data(), pending_count_);
+                write_shape();
+                buffer_.clear();
+                pending_count_ = 0;
+            }
+        }
+    };
+
 } // namespace poppel::npy
 
 #endif
@@ -1,6 +1,13 @@
 #ifndef INCLUDE_POPPEL_CORE_OPERATIONS_HPP_
 #define INCLUDE_POPPEL_CORE_OPERATIONS_HPP_
 
+#include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "exceptions.hpp"
+#include "io.hpp"
 #include "npy.hpp"
 #include "types.hpp"
 #include "utilities.hpp"
@@ -14,6 +21,9 @@ namespace poppel::core {
     void assert_file_open(const FileStates& filestates);
     void assert_file_writable(const FileStates& filestates);
 
+    // Get the I/O thread pool of the file, creating it if necessary.
+    ThreadPool& get_io_pool(const FileStates& filestates);
+
     bool is_valid_node_normalized_relpath(const std::filesystem::path& normalized_relpath);
     void assert_is_valid_node_normalized_relpath(const std::filesystem::path& normalized_relpath);
 
@@ -29,12 +39,40 @@ namespace poppel::core {
     void assert_exists_directory(const std::filesystem::path& path);
     void assert_not_exists(const std::filesystem::path& path);
 
+    // Unique temporary file path in the same directory as the path, hidden by a leading dot.
+    std::filesystem::path temp_file_path(const std::filesystem::path& path);
+    // Whether the path has the name of a temporary file from temp_file_path().
+    bool is_temp_file_path(const std::filesystem::path& path);
+    // Replace the file content atomically, by writing a temporary file in the same directory and renaming it.
+    void write_file_atomic(const std::filesystem::path& path, std::string_view content);
+
+    // Write the file with the write function, following the write modes of the file.
+    // With atomic writes, the function writes a temporary file which then replaces the path, so that readers and crashes see either the old or the new content.
+    // With durable writes, the temporary file is also flushed before renaming, and the directory is flushed on commit.
+    // Hard linked files, such as from copy_node(), are unlinked first, so that the other names keep the old content.
+    void write_file(const std::filesystem::path& path, const FileStates& filestates, const std::function<void(const std::filesystem::path&)>& write);
+    // Give a hard linked file its own copy of the content before it is changed in place, such as by appending, so that the other names keep the old content.
+    void unshare_file(const std::filesystem::path& path, const FileStates& filestates);
+    // Flush the directories of durable writes since the last commit, once per directory.
+    void commit_writes(const FileStates& filestates);
+
     //----------------------------------
     // Node operations.
     //----------------------------------
 
+    // Whole content of poppel.json, which may contain layout information besides node metadata.
+    Json read_node_json(const std::filesystem::path& nodepath);
+    void write_node_json(const std::filesystem::path& nodepath, const Json& json);
+
+    // Node metadata access through the metadata cache of the file, if enabled.
     NodeMeta read_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates);
     void write_node_meta(const std::filesystem::path& nodepath, const NodeMeta& meta, const FileStates& filestates);
+    // Returns empty if the directory does not exist. Throws if the directory is not a node.
+    std::optional<NodeMeta> find_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates);
+    // Update cached metadata of the node, if cache is enabled.
+    void cache_node_meta(const std::filesystem::path& nodepath, const NodeMeta& meta, const FileStates& filestates);
+    // Remove cached metadata of the node and all its descendants.
+    void uncache_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates);
 
     Node get_file_node(const std::filesystem::path& name);
     Node create_file_node(const std::filesystem::path& name);
@@ -48,15 +86,119 @@ namespace poppel::core {
     // If the required node does not exist, a new node is created.
     Node require_node(const Node& node, const std::filesystem::path& name, const FileStates& filestates, NodeType nodetype);
     void delete_node (const Node& node, const std::filesystem::path& name, const FileStates& filestates);
+    // Create the named nodes with their missing intermediate groups, returning the nodes in order of names.
+    // All names are checked before any change, and each intermediate group is looked up or created once.
+    // The content of poppel.json of new nodes is serialized once per node type.
+    // If concurrent is set, the nodes of each depth are created on the I/O thread pool.
+    // With durable writes, the new directories are flushed on the next commit.
+    std::vector<Node> create_nodes(const Node& node, const std::vector<std::pair<std::filesystem::path, NodeType>>& names, const FileStates& filestates, bool concurrent = true);
+    // Copy the node src of any type, with its attributes, to name under the group node dst, which may be of another file. Returns the copy.
+    // Data is not decoded. Files are copied with clone_file() concurrently on the I/O thread pool of dst, and flushed with durable writes.
+    // If recursive is not set, child groups of src are not copied. If hard_links is set, data files of contiguous datasets are hard linked where possible.
+    // Writes through poppel unlink or unshare the file first, but changes made in place by other programs are seen by both nodes.
+    // Temporary files of atomic writes are skipped. On failure, the partial copy is removed.
+    Node copy_node(const Node& src, const FileStates& src_states, const Node& dst, const std::filesystem::path& name, const FileStates& dst_states, bool recursive, bool hard_links);
 
     Attribute get_attribute(const Node& node, const FileStates& filestates);
 
+    // Visit the descendant nodes level by level, calling func with each entry in path order within a level.
+    // Each directory is listed once and each poppel.json is parsed at most once. Directories which are not nodes are skipped.
+    // If recursive, groups are descended into. If load_headers is set, headers of datasets are loaded as well.
+    // If concurrent is set, directories of a level are scanned on the I/O thread pool. func is called on the calling thread.
+    void visit_nodes(const Node& node, const FileStates& filestates, const std::function<void(const NodeEntry&)>& func, bool recursive, bool load_headers, bool concurrent = true);
+
+    // Consolidated manifest.
+    //----------------------------------
+    // The manifest holds node types, dataset headers and optionally attributes of the whole tree, in a single file at the root.
+    // It is only used when trusted, because changes made without updating it make it stale.
+
+    inline auto manifest_path(const std::filesystem::path& root) { return root / "poppel.manifest.json"; }
+    // Write the manifest of the tree of the file node, following the write modes of the file.
+    // Headers of contiguous datasets are recorded with the stamps of their data files.
+    void write_manifest(const Node& root, const FileStates& filestates, bool include_attrs);
+    // Load the manifest into the file states and trust it for all lookups. Returns false if there is no manifest.
+    bool read_manifest(const Node& root, FileStates& filestates);
+    // Add headers of the manifest to the header index, checked against the stamps of their data files when used.
+    // Unlike read_manifest(), nothing else is trusted, so this also works before opening the file in read write mode removes the manifest.
+    // Returns false if there is no manifest.
+    bool read_manifest_headers(const Node& root, const FileStates& filestates);
+
+    //----------------------------------
+    // Checksums.
+    //----------------------------------
+    // With checksums enabled in the file states, poppel.json of a contiguous dataset records the CRC32C of its data portion.
+    // The checksum does not depend on the header, so that a copy can be verified against it anywhere.
+
+    // CRC32C of the data portion of the npy file, read in blocks.
+    std::uint32_t npy_data_checksum(const std::filesystem::path& path);
+    // Update the recorded checksum after writing the data file of a contiguous dataset.
+    // With checksums enabled, the checksum is recorded, computed from the written file if not given.
+    // Otherwise a recorded checksum is removed, so that it does not become stale.
+    void update_dataset_checksum(const Node& node, const FileStates& filestates, std::optional<std::uint32_t> checksum = std::nullopt);
+    // Update the recorded checksum after appending numbytes of data to the data file of a contiguous dataset.
+    // A recorded checksum is extended with the appended data, so that the file is not read again. Otherwise it is the same as update_dataset_checksum().
+    void extend_dataset_checksum(const Node& node, const FileStates& filestates, const std::byte* data, Size numbytes);
+    // Remove the recorded checksum, if the node or its cached metadata has one, such as before the data is changed in place.
+    void clear_dataset_checksum(const Node& node, const FileStates& filestates);
+    // Check the data of all datasets with recorded checksums under the node, returning the relative paths of those which do not match
+    // or cannot be read. If concurrent is set, datasets are checked on the I/O thread pool.
+    std::vector<std::filesystem::path> verify_checksums(const Node& node, const FileStates& filestates, bool concurrent = true);
+
     //----------------------------------
     // DataSet operations.
     //----------------------------------
 
     inline auto load_npy_header(const std::filesystem::path& path) { return npy::load_header(path); }
 
+    // Path of the data file of a contiguous dataset.
+    inline auto dataset_data_path(const Node& node) { return node.path() / "data.npy"; }
+
+    // Dataset level transfers of raw data, for any dataset layout.
+    // If concurrent is set, chunks are transferred on the I/O thread pool. It must not be set in the tasks of that pool.
+    //----------------------------------
+
+    // Header describing the whole dataset.
+    npy::Header load_dataset_header(const Node& node, const FileStates& filestates);
+    // Header of the data file of a contiguous dataset. With the header index, the file is only opened if its stamp changed.
+    npy::Header load_indexed_header(const std::filesystem::path& datapath, const FileStates& filestates);
+    // Load data to a pre-allocated buffer. Header must match as in npy::load().
+    void load_dataset(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool allow_reshape, bool concurrent = true);
+    // Load data to a pre-allocated buffer, converting the data type if needed, as in npy::load_convert().
+    void load_dataset_convert(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool allow_reshape, bool concurrent = true);
+    // Save data. Chunked datasets can only be saved with the same header as the chunk grid.
+    void save_dataset(const Node& node, const FileStates& filestates, const npy::Header& header, const std::byte* data, bool concurrent = true);
+    // Save data of a contiguous dataset from a strided buffer, without a contiguous copy. See save_npy_strided().
+    void save_dataset_strided(const Node& node, const FileStates& filestates, const npy::Header& header, const std::byte* data, const std::vector<std::ptrdiff_t>& strides);
+    // Load or save data in the index order of the header, converting from or to the index order of the dataset. See transpose.hpp.
+    // The data type and shape must match exactly. Saving keeps the index order of a chunked dataset, and uses fortran_order for contiguous datasets.
+    void load_dataset_order(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool concurrent = true);
+    void save_dataset_order(const Node& node, const FileStates& filestates, const npy::Header& header, const std::byte* data, bool fortran_order, bool concurrent = true);
+    // Load a hyperslab into a pre-allocated buffer, in the index order of the dataset.
+    npy::Header load_dataset_region(const Node& node, const FileStates& filestates, npy::Dtype dtype, const npy::Hyperslab& slab, std::byte* data, bool concurrent = true);
+
+    // Number of data bytes of a scalar, std::vector or std::string variable, for statistics.
+    template< typename T >
+    std::uint64_t value_numbytes(const T& val) {
+        if constexpr (npy::is_scalar<T>) {
+            return sizeof(T);
+        } else {
+            return val.size() * sizeof(typename T::value_type);
+        }
+    }
+    template< typename Allocator >
+    std::uint64_t value_numbytes(const npy::BasicNumpyArray<Allocator>& val) {
+        return val.rawdata.size();
+    }
+    // Data bytes of a scalar, std::vector or std::string variable as they are saved, for checksums without reading the file back.
+    template< typename T >
+    const std::byte* value_data(const T& val) {
+        if constexpr (npy::is_scalar<T>) {
+            return reinterpret_cast<const std::byte*>(&val);
+        } else {
+            return reinterpret_cast<const std::byte*>(val.data());
+        }
+    }
+
     // Loading data.
     //----------------------------------
 
@@ -78,6 +220,12 @@ namespace poppel::core {
         npy::load(path, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<std::byte*>(data), allow_reshape);
     }
 
+    // Load any dimension scalar data, converting from the data type of the file.
+    template< typename T, std::enable_if_t< npy::is_scalar<T>>* = nullptr >
+    void load_convert_to(T* data, bool fortran_order, std::vector<Size> shape, const std::filesystem::path& path, bool allow_reshape) {
+        npy::load_convert(path, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<std::byte*>(data), allow_reshape);
+    }
+
     // Load std::vector.
     template< typename T, std::enable_if_t< npy::is_scalar<T> && !std::is_same_v<T, bool> >* = nullptr >
     void load_to(std::vector<T>& val, const std::filesystem::path& path) {
@@ -85,6 +233,36 @@ namespace poppel::core {
     }
     // Load std::string.
     void load_to(std::string& val, const std::filesystem::path& path);
+    // Load the whole array into npy::NumpyArray or npy::PmrNumpyArray, reusing the capacity of its buffer.
+    template< typename Allocator >
+    void load_to(npy::BasicNumpyArray<Allocator>& val, const std::filesystem::path& path) {
+        npy::load(path, val);
+    }
+
+    // Load a hyperslab of any dimension scalar data, in the same index order as the file.
+    // Returns the header describing the loaded region.
+    template< typename T, std::enable_if_t< npy::is_scalar<T>>* = nullptr >
+    npy::Header load_slice_to(T* data, const npy::Hyperslab& slab, const std::filesystem::path& path) {
+        return npy::load_region(path, npy::internal::dtype(T{}), slab, reinterpret_cast<std::byte*>(data));
+    }
+
+    // Memory map the npy file for zero-copy read-only access.
+    // The data type must match exactly. The data must be suitably aligned for T.
+    template< typename T, std::enable_if_t< npy::is_scalar<T>>* = nullptr >
+    MappedArray<T> map_npy(const std::filesystem::path& path) {
+        MappedFile file(path);
+        auto [header, data_offset] = npy::load_header(file.data(), file.size());
+        if (header.dtype != npy::internal::dtype(T{})) {
+            throw Exception("array dtype is not match");
+        }
+        if (file.size() - data_offset < header.numbytes()) {
+            throw Exception("npy file is truncated: " + path.string());
+        }
+        if (reinterpret_cast<std::uintptr_t>(file.data() + data_offset) % alignof(T) != 0) {
+            throw Exception("npy data is not aligned for mapping: " + path.string());
+        }
+        return MappedArray<T>(std::move(file), std::move(header), data_offset);
+    }
 
 
     // Saving data.
@@ -116,13 +294,64 @@ namespace poppel::core {
     // Save string.
     void save_from(const std::string& val, const std::filesystem::path& path);
 
+    // Appending data.
+    //----------------------------------
+
+    // Generic saving for any dimension scalar data, reserving header space for appending.
+    template< typename T, std::enable_if_t< npy::is_scalar<T>>* = nullptr >
+    void save_appendable_from(const T* data, bool fortran_order, std::vector<Size> shape, const std::filesystem::path& path) {
+        npy::save_appendable(path, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<const std::byte*>(data));
+    }
+
+    // Append count slabs along the growth axis in a single write. Returns the number of bytes appended.
+    template< typename T, std::enable_if_t< npy::is_scalar<T>>* = nullptr >
+    Size append_from(const T* data, Size count, const std::filesystem::path& path) {
+        npy::Appender appender(path, npy::internal::dtype(T{}), 0);
+        appender.append(data, count);
+        return count * appender.slab_numbytes();
+    }
+
+    // Get an appender that batches small appends.
+    template< typename T, std::enable_if_t< npy::is_scalar<T>>* = nullptr >
+    npy::Appender get_appender(const std::filesystem::path& path, Size buffer_numbytes) {
+        return npy::Appender(path, npy::internal::dtype(T{}), buffer_numbytes);
+    }
+
+    //----------------------------------
+    // Raw operations.
+    //----------------------------------
+    // A raw node holds opaque files, which poppel does not interpret.
+
+    // Path of a file in the raw node. The name must be a plain file name, other than the names reserved by poppel.
+    std::filesystem::path raw_file_path(const Node& node, const std::filesystem::path& name);
+    // Names of the files in the raw node, sorted.
+    std::vector<std::string> list_raw_files(const Node& node);
+
     //----------------------------------
     // Attribute operations.
     //----------------------------------
 
+    // Attribute file of the node directory. An existing file in the preferred encoding, or in any other encoding, is found first.
+    // If none exists, the file of the preferred encoding is returned.
+    Attribute find_attribute(const std::filesystem::path& nodepath, AttributeEncoding preferred);
+
+    // Load or save the attribute file in its encoding.
     Json load_attr(const Attribute& attr);
     void save_attr(const Json& val, const Attribute& attr); 
 
+    // Attributes of the node, which are up to date with open attribute handles.
+    // Missing attribute file is read as an empty object, and is not created until saved.
+    // Saving writes the encoding of the file, and removes attribute files of other encodings.
+    Json load_node_attr(const Node& node, const FileStates& filestates);
+    void save_node_attr(const Json& val, const Node& node, const FileStates& filestates);
+
+    // Get the in-memory attributes of the node, loading them if no handle has them open.
+    std::shared_ptr<AttributeState> open_attribute_state(const Node& node, const FileStates& filestates);
+    // Write back the attributes if they have been changed.
+    void flush_attribute_state(AttributeState& state, const FileStates& filestates);
+    // Write back the attributes of all open handles, and stop further changes. Used when the file is closed.
+    void close_attribute_states(const FileStates& filestates);
+
 } // namespace poppel::core
 
 #endif
@@ -0,0 +1,140 @@
+#ifndef INCLUDE_POPPEL_CORE_STATS_HPP_
+#define INCLUDE_POPPEL_CORE_STATS_HPP_
+
+// Opt-in I/O statistics of a file, telling whether a workload is bound by metadata or by bandwidth.
+//
+// Counters cover the operations of poppel itself: data, metadata and attribute files it opens, poppel.json parses,
+// directory stats of node lookups, and attribute file rewrites. Latencies are recorded per operation type.
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+
+#include <nlohmann/json.hpp>
+
+namespace poppel::core {
+
+    enum class Operation {
+        NodeLookup,
+        DatasetLoad,
+        DatasetSave,
+        AttrLoad,
+        AttrSave,
+    };
+    constexpr std::size_t num_operations = 5;
+    constexpr const char* text(Operation val) {
+        switch (val) {
+            case Operation::NodeLookup:  return "node_lookup";
+            case Operation::DatasetLoad: return "dataset_load";
+            case Operation::DatasetSave: return "dataset_save";
+            case Operation::AttrLoad:    return "attr_load";
+            case Operation::AttrSave:    return "attr_save";
+            default:                     return "";
+        }
+    }
+
+    // Latency histogram with power of two buckets. Bucket i counts latencies in [2^i, 2^(i+1)) nanoseconds.
+    struct LatencyHistogram {
+        static constexpr std::size_t num_buckets = 48;
+
+        std::array<std::atomic<std::uint64_t>, num_buckets> buckets {};
+        std::atomic<std::uint64_t>                          count { 0 };
+        std::atomic<std::uint64_t>                          total_ns { 0 };
+        std::atomic<std::uint64_t>                          max_ns { 0 };
+
+        void record(std::uint64_t ns);
+        // Upper bound of the bucket containing the quantile q in [0, 1]. Zero if nothing is recorded.
+        std::uint64_t quantile_ns(double q) const;
+        void reset();
+        nlohmann::json to_json() const;
+    };
+
+    struct IoStats {
+        std::atomic<std::uint64_t> bytes_read { 0 };
+        std::atomic<std::uint64_t> bytes_written { 0 };
+        std::atomic<std::uint64_t> files_opened { 0 };
+        std::atomic<std::uint64_t> meta_parses { 0 };
+        std::atomic<std::uint64_t> stat_calls { 0 };
+        std::atomic<std::uint64_t> attr_rewrites { 0 };
+
+        std::array<LatencyHistogram, num_operations> latencies;
+
+        auto& latency(Operation op) { return latencies[static_cast<std::size_t>(op)]; }
+        const auto& latency(Operation op) const { return latencies[static_cast<std::size_t>(op)]; }
+
+        void reset();
+        nlohmann::json to_json() const;
+    };
+
+    // Called after each timed operation, with the path of the node and the number of data bytes transferred.
+    // May be called concurrently from the I/O thread pool.
+    using Tracer = std::function<void(Operation op, const std::filesystem::path& path, std::chrono::nanoseconds duration, std::uint64_t bytes)>;
+
+    // Instrumentation of one file. Both stats and tracer are optional, and cost a null check when unused.
+    struct Instrumentation {
+        std::unique_ptr<IoStats> stats;
+        Tracer                   tracer;
+
+        bool enabled() const { return stats || tracer; }
+    };
+
+    // Increment a counter if stats are enabled.
+    // Usage: count(inst, &IoStats::files_opened).
+    inline void count(const Instrumentation& inst, std::atomic<std::uint64_t> IoStats::* counter, std::uint64_t n = 1) {
+        if (inst.stats) {
+            ((*inst.stats).*counter).fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    // Time the scope as an operation, recording the latency and calling the tracer on exit.
+    // The path must outlive the timer.
+    class OperationTimer {
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        const Instrumentation&       inst_;
+        Operation                    op_;
+        const std::filesystem::path& path_;
+        std::uint64_t                bytes_ = 0;
+        Clock::time_point            start_;
+
+    public:
+        OperationTimer(const Instrumentation& inst, Operation op, const std::filesystem::path& path) :
+            inst_(inst), op_(op), path_(path)
+        {
+            if (inst_.enabled()) {
+                start_ = Clock::now();
+            }
+        }
+        OperationTimer(const OperationTimer&) = delete;
+        OperationTimer& operator=(const OperationTimer&) = delete;
+
+        ~OperationTimer() {
+            if (!inst_.enabled()) {
+                return;
+            }
+            const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_);
+            if (inst_.stats) {
+                inst_.stats->latency(op_).record(duration.count());
+            }
+            if (inst_.tracer) {
+                try {
+                    inst_.tracer(op_, path_, duration, bytes_);
+                } catch (...) {
+                    // Destructor must not throw. Tracer errors are ignored.
+                }
+            }
+        }
+
+        // Data bytes transferred by the operation, reported to the tracer.
+        void set_bytes(std::uint64_t bytes) { bytes_ = bytes; }
+    };
+
+} // namespace poppel::core
+
+#endif
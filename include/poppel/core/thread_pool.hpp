@@ -0,0 +1,61 @@
+#ifndef INCLUDE_POPPEL_CORE_THREAD_POOL_HPP_
+#define INCLUDE_POPPEL_CORE_THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace poppel::core {
+
+    // Fixed size thread pool, used to overlap file I/O.
+    // Tasks are run in submission order. Destruction waits for all submitted tasks to finish.
+    class ThreadPool {
+    private:
+        std::vector<std::thread>          workers_;
+        std::deque<std::function<void()>> tasks_;
+        std::mutex                        mutex_;
+        std::condition_variable           cv_;
+        bool                              stopping_ = false;
+
+        void run_worker();
+
+    public:
+        explicit ThreadPool(std::size_t num_threads);
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        auto size() const noexcept { return workers_.size(); }
+
+        // Submit a task. The returned future holds the result or the exception thrown by the task.
+        template< typename Func >
+        auto submit(Func&& func) {
+            using Result = std::invoke_result_t< std::decay_t< Func >>;
+            // std::function requires copyable callables, so the task is shared.
+            auto task = std::make_shared< std::packaged_task< Result() >>(std::forward< Func >(func));
+            auto future = task->get_future();
+            {
+                std::lock_guard lock(mutex_);
+                tasks_.emplace_back([task] { (*task)(); });
+            }
+            cv_.notify_one();
+            return future;
+        }
+    };
+
+    // Run tasks, concurrently if a pool is given. Rethrows the first error after all tasks finish,
+    // so that tasks may refer to the state of the caller.
+    void run_tasks(std::vector<std::function<void()>>& tasks, ThreadPool* pool);
+
+} // namespace poppel::core
+
+#endif
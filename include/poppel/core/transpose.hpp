@@ -0,0 +1,32 @@
+#ifndef INCLUDE_POPPEL_CORE_TRANSPOSE_HPP_
+#define INCLUDE_POPPEL_CORE_TRANSPOSE_HPP_
+
+// Conversion between C and Fortran index order of arrays of the same shape, which reverses the order of axes in memory.
+//
+// Data is copied in small square tiles, so that both sides stay in cache, with fixed size items that compilers vectorize.
+// Large copies are split over the thread pool, if given.
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "npy.hpp"
+#include "thread_pool.hpp"
+#include "types.hpp"
+
+namespace poppel::core {
+
+    // Copy the whole array, converting the index order. from_fortran is the order of src, and dst has the other order.
+    void convert_order(const std::byte* src, std::byte* dst, const std::vector<Size>& shape, bool from_fortran, Size itemsize, ThreadPool* pool = nullptr);
+
+    // Load the npy file to the buffer in the index order of the header, converting from the order of the file if needed.
+    // The data type and shape must match exactly. The file is converted in slabs while reading, without a full size intermediate buffer.
+    void load_npy_order(const std::filesystem::path& path, const npy::Header& header, std::byte* data, ThreadPool* pool = nullptr);
+    // Save the buffer described by the header to an npy file in the index order of fortran_order, converting in slabs while writing.
+    // If checksum is not null, it is set to the CRC32C of the data in file order, computed from each slab as it is written.
+    void save_npy_order(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, bool fortran_order, ThreadPool* pool = nullptr, std::uint32_t* checksum = nullptr);
+
+} // namespace poppel::core
+
+#endif
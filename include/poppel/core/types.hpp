@@ -6,13 +6,28 @@
 // Circular dependencies are not allowed.
 // Functions involving multiple components are not recommended.
 
+#include <algorithm>
 #include <complex>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "handle_pool.hpp"
+#include "npy.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+
 namespace poppel {
 
     using Index = std::int64_t;
@@ -54,9 +69,103 @@ namespace poppel {
             }
         }
 
+        // Storage layout of dataset data.
+        enum class DatasetLayout {
+            Contiguous, // Single data.npy file.
+            Chunked,    // Fixed-shape chunks, each stored as its own file.
+            Sharded,    // Disjoint blocks of any shape, each stored as its own file.
+        };
+        constexpr const char* text(DatasetLayout val) {
+            switch (val) {
+                case DatasetLayout::Chunked: return "chunked";
+                case DatasetLayout::Sharded: return "sharded";
+                default:                     return "contiguous";
+            }
+        }
+        constexpr DatasetLayout dataset_layout(std::string_view name) {
+            if (name == "chunked") {
+                return DatasetLayout::Chunked;
+            } else if (name == "sharded") {
+                return DatasetLayout::Sharded;
+            } else {
+                return DatasetLayout::Contiguous;
+            }
+        }
+
+        // Encoding of attribute files.
+        enum class AttributeEncoding {
+            Json,        // Text, in attributes.json.
+            Cbor,        // Binary, in attributes.cbor.
+            MessagePack, // Binary, in attributes.msgpack.
+        };
+        constexpr const char* attribute_filename(AttributeEncoding val) {
+            switch (val) {
+                case AttributeEncoding::Cbor:        return "attributes.cbor";
+                case AttributeEncoding::MessagePack: return "attributes.msgpack";
+                default:                             return "attributes.json";
+            }
+        }
+
+        // Backend for transferring the data of contiguous datasets.
+        enum class IoBackend {
+            Stream, // File streams, through the stream buffer and the page cache.
+            Posix,  // Large reads and writes of file descriptors, with sequential hints. Transferred pages are dropped from the page cache.
+            Direct, // O_DIRECT with page-aligned buffers, bypassing the page cache. Falls back to Posix where not supported.
+        };
+
         struct NodeMeta {
-            int      version = 1;
-            NodeType type = NodeType::Unknown;
+            int           version = 1;
+            NodeType      type = NodeType::Unknown;
+            DatasetLayout layout = DatasetLayout::Contiguous;
+            // poppel.json records a checksum of the data of the contiguous dataset.
+            bool          checksum = false;
+        };
+
+        // Decomposition of a chunked dataset into fixed-shape chunks.
+        // Chunks on the upper edges are truncated to the array shape.
+        struct ChunkGrid {
+            npy::Header       header;
+            std::vector<Size> chunk_shape;
+            // Filter pipeline applied to each chunk. See filters.hpp.
+            Json              filters = Json::array();
+
+            // Number of chunks on each axis.
+            auto grid_shape() const {
+                std::vector<Size> ret(chunk_shape.size());
+                for (std::size_t i = 0; i < ret.size(); ++i) {
+                    ret[i] = (header.shape[i] + chunk_shape[i] - 1) / chunk_shape[i];
+                }
+                return ret;
+            }
+            // Actual shape of the chunk at the chunk index.
+            auto chunk_shape_at(const std::vector<Size>& chunk_index) const {
+                std::vector<Size> ret(chunk_shape.size());
+                for (std::size_t i = 0; i < ret.size(); ++i) {
+                    ret[i] = std::min(chunk_shape[i], header.shape[i] - chunk_index[i] * chunk_shape[i]);
+                }
+                return ret;
+            }
+        };
+
+        // Block of a sharded dataset, at the offset in the whole array.
+        struct Shard {
+            std::vector<Size> offset;
+            std::vector<Size> shape;
+
+            auto length() const {
+                Size ret = 1;
+                for (auto s : shape) {
+                    ret *= s;
+                }
+                return ret;
+            }
+        };
+
+        // Decomposition of a sharded dataset into disjoint blocks, such as one block per process of a distributed job.
+        // Parts of the array not covered by any shard are read as zeros.
+        struct ShardMap {
+            npy::Header        header;
+            std::vector<Shard> shards;
         };
 
         // Represents a node in tree traversal.
@@ -72,22 +181,129 @@ namespace poppel {
             }
         };
 
+        // Node found by scanning the directory tree, with the path relative to the scanned node.
+        struct NodeEntry {
+            std::filesystem::path      relpath;
+            NodeMeta                   meta;
+            // Header of a dataset, if requested in the scan.
+            std::optional<npy::Header> header;
+        };
+
         enum class FileOpenState {
             ReadOnly,
             ReadWrite,
             Closed,
         };
 
-        // File states that are not a part of the general node state.
-        struct FileStates {
-            FileOpenState open_state = FileOpenState::Closed;
+        // Cache of node metadata, keyed by the node directory path.
+        // An entry with unknown node type means that the directory does not exist.
+        struct NodeMetaCache {
+            bool enabled = false;
+            // All nodes are cached, such as from a trusted manifest, so that a missing entry means that the directory does not exist.
+            bool complete = false;
+            std::unordered_map<std::string, NodeMeta> entries;
+        };
+
+        // Modification time and size of a file, which tell whether it changed since last seen.
+        struct FileStamp {
+            std::int64_t  mtime_ns = 0;
+            std::uint64_t size = 0;
+
+            bool operator==(const FileStamp& other) const { return mtime_ns == other.mtime_ns && size == other.size; }
+            bool operator!=(const FileStamp& other) const { return !(*this == other); }
+        };
+
+        // Headers of the data files of contiguous datasets, keyed by the data file path.
+        // An entry is used while the file keeps the stamp seen when the header was read, so that a lookup costs one stat.
+        struct HeaderIndex {
+            bool enabled = false;
+            std::unordered_map<std::string, std::pair<FileStamp, npy::Header>> entries;
         };
 
+        // Consolidated metadata of the whole tree, keyed by the node directory path.
+        // Node types are loaded into the metadata cache. Headers and attributes are kept here.
+        struct Manifest {
+            bool trusted = false;
+            // Attributes were consolidated as well. A node without an entry has empty attributes.
+            bool has_attrs = false;
+            std::unordered_map<std::string, npy::Header> headers;
+            std::unordered_map<std::string, Json>        attrs;
+        };
 
         struct Attribute {
             std::filesystem::path jsonfile;
+            AttributeEncoding     encoding = AttributeEncoding::Json;
+        };
+
+        // Attributes of a node held in memory, shared by all attribute handles of the node.
+        // Changes are written back to the attribute file of the encoding when flushed.
+        struct AttributeState {
+            std::filesystem::path nodepath;
+            AttributeEncoding     encoding = AttributeEncoding::Json;
+            Json                  value;
+            bool                  dirty  = false;
+            // Set when the file is closed, after which the attributes can no longer be changed.
+            bool                  closed = false;
+            std::mutex            mutex;
+        };
+
+        // File states that are not a part of the general node state.
+        struct FileStates {
+            FileOpenState open_state = FileOpenState::Closed;
+
+            // Node metadata cached across lookups, if enabled.
+            mutable NodeMetaCache               meta_cache;
+
+            // Dataset headers indexed by data file stamp, if enabled. Built lazily, and seeded from the manifest on open.
+            mutable HeaderIndex                 header_index;
+
+            // Thread pool for asynchronous I/O, created on first use.
+            // Zero number of threads means the default number.
+            std::size_t                         io_threads = 0;
+            mutable std::shared_ptr<ThreadPool> io_pool;
+
+            // Encoding of attribute files written by this file. Existing files in any encoding can be read.
+            AttributeEncoding                   attr_encoding = AttributeEncoding::Json;
+
+            // Backend for transferring the data of contiguous datasets.
+            IoBackend                           io_backend = IoBackend::Stream;
+
+            // Saves of contiguous datasets record the CRC32C of the data in poppel.json, and whole loads verify it. Disabled by default.
+            bool                                checksums = false;
+
+            // Data files of contiguous datasets kept open with their headers, for repeated loads. Disabled by default.
+            // Used with the Stream backend only.
+            mutable FileHandlePool              handle_pool;
+
+            // Whole contiguous datasets larger than one stripe are transferred in stripes of this size on the I/O thread pool.
+            // Zero disables striping.
+            std::size_t                         stripe_size = 0;
+
+            // Manifest read on open in read only mode, or written on close in read write mode.
+            Manifest                            manifest;
+            bool                                write_manifest = false;
+            bool                                manifest_attrs = true;
+
+            // Attributes held by open handles, keyed by the node path.
+            mutable std::unordered_map<std::string, std::weak_ptr<AttributeState>> attr_states;
+
+            // Dataset files are replaced by renaming a temporary file, if atomic writes are enabled.
+            // Durable writes also flush the temporary file before renaming, and record the directory to be flushed on commit.
+            bool                                atomic_writes = false;
+            bool                                durable_writes = false;
+            mutable std::unordered_set<std::string> uncommitted_dirs;
+
+            // Opt-in I/O statistics and tracer.
+            Instrumentation                     instrumentation;
+
+            // Guards the mutable states shared by concurrent operations.
+            mutable std::mutex                  mutex;
+
+            FileStates() = default;
+            explicit FileStates(FileOpenState open_state) : open_state(open_state) {}
         };
 
+
     } // namespace core
 
 } // namespace poppel
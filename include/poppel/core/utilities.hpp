@@ -1,6 +1,7 @@
 #ifndef INCLUDE_POPPEL_CORE_UTILTIES_HPP
 #define INCLUDE_POPPEL_CORE_UTILTIES_HPP
 
+#include <cstddef>
 #include <type_traits>
 
 namespace poppel::core {
@@ -26,6 +27,20 @@ namespace poppel::core {
     };
     template< typename Func >
     ScopeGuard(Func) -> ScopeGuard< Func >;
+
+    // Call func with the size as std::integral_constant for 1, 2, 4, 8 and 16 bytes, and as std::size_t otherwise.
+    // Copies of a constant size with memcpy compile to plain loads and stores for any alignment.
+    template< typename Func >
+    void with_fixed_size(std::size_t size, Func&& func) {
+        switch (size) {
+            case 1:  func(std::integral_constant<std::size_t, 1>{}); break;
+            case 2:  func(std::integral_constant<std::size_t, 2>{}); break;
+            case 4:  func(std::integral_constant<std::size_t, 4>{}); break;
+            case 8:  func(std::integral_constant<std::size_t, 8>{}); break;
+            case 16: func(std::integral_constant<std::size_t, 16>{}); break;
+            default: func(size); break;
+        }
+    }
 } // namespace poppel::core
 
 #endif
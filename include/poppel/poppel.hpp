@@ -1,14 +1,23 @@
 #ifndef INCLUDE_POPPEL_POPPEL_HPP_
 #define INCLUDE_POPPEL_POPPEL_HPP_
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string_view>
 #include <vector>
 
+#include "core/checksum.hpp"
+#include "core/chunked.hpp"
 #include "core/exceptions.hpp"
+#include "core/filters.hpp"
 #include "core/operations.hpp"
 
 namespace poppel {
@@ -17,12 +26,109 @@ namespace poppel {
     class Group;
     class File;
     class Dataset;
+    template< typename T, std::size_t Rank > class TypedDataset;
+    class Raw;
+
+    // Handle to the attributes of a node, held in memory for repeated access.
+    //
+    // Handles of the same node share the attributes. Changes are written back to the attribute file atomically,
+    // only when flush() is called, when a handle is destroyed, or when the file is closed.
+    class Attributes {
+    private:
+        std::shared_ptr<core::AttributeState> state_;
+        core::FileStates*                     pstates_ = nullptr;
+
+        void assert_writable_() const {
+            if (state_->closed) {
+                throw Exception("Attributes cannot be changed after the file is closed.");
+            }
+            core::assert_file_writable(*pstates_);
+        }
+
+    public:
+        Attributes(std::shared_ptr<core::AttributeState> state, core::FileStates* pstates):
+            state_(std::move(state)), pstates_(pstates)
+        {}
+        Attributes(const Attributes&) = default;
+        Attributes(Attributes&&) = default;
+        Attributes& operator=(const Attributes&) = default;
+        Attributes& operator=(Attributes&&) = default;
+
+        ~Attributes() {
+            try {
+                if (state_) {
+                    flush();
+                }
+            } catch (...) {
+                // Destructor must not throw. Call flush() explicitly to observe errors.
+            }
+        }
+
+        bool contains(const std::string& key) const {
+            std::lock_guard lock(state_->mutex);
+            return state_->value.contains(key);
+        }
+        // Throws if the key does not exist.
+        Json get(const std::string& key) const {
+            std::lock_guard lock(state_->mutex);
+            return state_->value.at(key);
+        }
+        template< typename T >
+        T get(const std::string& key) const {
+            return get(key).get<T>();
+        }
+        void set(const std::string& key, Json val) {
+            assert_writable_();
+            std::lock_guard lock(state_->mutex);
+            state_->value[key] = std::move(val);
+            state_->dirty = true;
+        }
+        void erase(const std::string& key) {
+            assert_writable_();
+            std::lock_guard lock(state_->mutex);
+            state_->dirty = state_->value.erase(key) > 0 || state_->dirty;
+        }
+
+        // Whole attributes.
+        Json load() const {
+            std::lock_guard lock(state_->mutex);
+            return state_->value;
+        }
+        void save(Json val) {
+            assert_writable_();
+            std::lock_guard lock(state_->mutex);
+            state_->value = std::move(val);
+            state_->dirty = true;
+        }
+
+        // Write back the changes, if any.
+        void flush() {
+            core::flush_attribute_state(*state_, *pstates_);
+        }
+    };
 
     class Dataset {
     private:
         core::Node          node_;
         core::FileStates*   pstates_ = nullptr;
 
+        // Operations on a single data file are not available for chunked or sharded datasets.
+        void assert_contiguous_() const {
+            if (node_.meta.layout != core::DatasetLayout::Contiguous) {
+                throw Exception(std::string("Operation is not supported for ") + core::text(node_.meta.layout) + " datasets.");
+            }
+        }
+        void assert_chunked_() const {
+            if (!is_chunked()) {
+                throw Exception("Dataset is not chunked.");
+            }
+        }
+        void assert_sharded_() const {
+            if (!is_sharded()) {
+                throw Exception("Dataset is not sharded.");
+            }
+        }
+
     public:
         Dataset(core::Node node, core::FileStates* pstates):
             node_(std::move(node)), pstates_(pstates)
@@ -31,14 +137,27 @@ namespace poppel {
         //------------------------------
         // Accessors.
         //------------------------------
-        auto filepath() const { return node_.path() / "data.npy"; }
+        auto filepath() const { return core::dataset_data_path(node_); }
+        bool is_chunked() const { return node_.meta.layout == core::DatasetLayout::Chunked; }
+        bool is_sharded() const { return node_.meta.layout == core::DatasetLayout::Sharded; }
 
         //------------------------------
         // Dataset operations.
         //------------------------------
 
         // Load only the header of the dataset.
-        auto load_npy_header() const { return core::load_npy_header(filepath()); }
+        auto load_npy_header() const { return core::load_dataset_header(node_, *pstates_); }
+
+        // Memory map the data for zero-copy read-only access, without reading the whole file.
+        // The data type must match exactly with the file. The returned array keeps the mapping alive.
+        // Data written by poppel is aligned to 64 bytes, which is suitable for SIMD loads.
+        template< typename T >
+        auto map() const {
+            core::assert_file_open(*pstates_);
+            core::assert_is_node_dataset(node_);
+            assert_contiguous_();
+            return core::map_npy<T>(filepath());
+        }
 
         // Load the data into the variable.
         // Most scalar types and common container types such as std::vector and std::string are supported.
@@ -46,7 +165,14 @@ namespace poppel {
         void load_to(T& val) const {
             core::assert_file_open(*pstates_);
             core::assert_is_node_dataset(node_);
+            assert_contiguous_();
+            const auto nodepath = node_.path();
+            core::OperationTimer timer(pstates_->instrumentation, core::Operation::DatasetLoad, nodepath);
             core::load_to(val, filepath());
+            const auto numbytes = core::value_numbytes(val);
+            timer.set_bytes(numbytes);
+            core::count(pstates_->instrumentation, &core::IoStats::files_opened);
+            core::count(pstates_->instrumentation, &core::IoStats::bytes_read, numbytes);
         }
 
         // Load the data into the buffer, with the knowledge of data type, shape, and index order.
@@ -56,9 +182,25 @@ namespace poppel {
         // To preview the data type (word size), shape and index order, use load_npy_header().
         template< typename T >
         void load_to(T* val, bool fortran_order, std::vector<Size> shape, bool allow_reshape = false) const {
-            core::assert_file_open(*pstates_);
-            core::assert_is_node_dataset(node_);
-            core::load_to(val, fortran_order, std::move(shape), filepath(), allow_reshape);
+            core::load_dataset(node_, *pstates_, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<std::byte*>(val), allow_reshape);
+        }
+
+        // Load the data into the buffer like load_to(), but converting from the data type of the file.
+        //
+        // Data in either byte order is accepted, and numeric types are cast, such as from std::int16_t to float, or from double to float.
+        // The conversion is done in small blocks while reading, without a full size intermediate buffer.
+        template< typename T >
+        void load_convert_to(T* val, bool fortran_order, std::vector<Size> shape, bool allow_reshape = false) const {
+            core::load_dataset_convert(node_, *pstates_, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<std::byte*>(val), allow_reshape);
+        }
+
+        // Load the data into the buffer in the given index order, converting from the index order of the file if it differs.
+        //
+        // The data type and shape must match exactly. The order is converted while reading, as in core::load_npy_order(),
+        // so that C order consumers can read Fortran order files directly, and vice versa.
+        template< typename T >
+        void load_order_to(T* val, bool fortran_order, std::vector<Size> shape) const {
+            core::load_dataset_order(node_, *pstates_, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<std::byte*>(val));
         }
 
         // Load the data into the buffer indicating 1D array, with the knowledge of data size.
@@ -69,21 +211,58 @@ namespace poppel {
             this->load_to(val, false, std::vector { size }, allow_reshape);
         }
 
+        // Load a hyperslab of the data into the buffer, reading only the selected portion of the file.
+        //
+        // On each axis, the selected indices are offset + i * stride, for i in [0, count). An empty stride means unit stride.
+        // The data type must match exactly with the file. The buffer must hold at least the product of count elements.
+        // Data is stored in the same index order as the file. The returned header describes the loaded region.
+        template< typename T >
+        npy::Header load_slice(T* val, std::vector<Size> offset, std::vector<Size> count, std::vector<Size> stride = {}) const {
+            return core::load_dataset_region(
+                node_, *pstates_, npy::internal::dtype(T{}),
+                npy::Hyperslab { std::move(offset), std::move(count), std::move(stride) },
+                reinterpret_cast<std::byte*>(val)
+            );
+        }
+
         // Save the data from the variable.
         // Most scalar types and common container types such as std::vector and std::string are supported.
         template< typename T >
         void save_from(const T& val) const {
             core::assert_file_writable(*pstates_);
             core::assert_is_node_dataset(node_);
-            core::save_from(val, filepath());
+            assert_contiguous_();
+            const auto nodepath = node_.path();
+            core::OperationTimer timer(pstates_->instrumentation, core::Operation::DatasetSave, nodepath);
+            core::write_file(filepath(), *pstates_, [&](const std::filesystem::path& path) {
+                core::save_from(val, path);
+            });
+            const auto numbytes = core::value_numbytes(val);
+            core::update_dataset_checksum(node_, *pstates_, pstates_->checksums ? std::optional(core::crc32c(core::value_data(val), numbytes)) : std::nullopt);
+            timer.set_bytes(numbytes);
+            core::count(pstates_->instrumentation, &core::IoStats::files_opened);
+            core::count(pstates_->instrumentation, &core::IoStats::bytes_written, numbytes);
         }
 
         // Save the data using the buffer, with additional knowledge of data type, shape, and index order.
         template< typename T >
         void save_from(const T* val, bool fortran_order, std::vector<Size> shape) const {
-            core::assert_file_writable(*pstates_);
-            core::assert_is_node_dataset(node_);
-            core::save_from(val, fortran_order, std::move(shape), filepath());
+            core::save_dataset(node_, *pstates_, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<const std::byte*>(val));
+        }
+
+        // Save the data from a strided view of the buffer, such as a block of a larger matrix, without copying it first.
+        // strides are in items for each axis of shape, such as { ld, 1 } for a block of a C order matrix with ld columns.
+        // Only contiguous datasets are supported.
+        template< typename T >
+        void save_from(const T* val, bool fortran_order, std::vector<Size> shape, const std::vector<std::ptrdiff_t>& strides) const {
+            core::save_dataset_strided(node_, *pstates_, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<const std::byte*>(val), strides);
+        }
+
+        // Save the data from the buffer in the given index order, converting to file_fortran_order while writing.
+        // Chunked datasets keep the index order of their chunk grid.
+        template< typename T >
+        void save_order_from(const T* val, bool fortran_order, std::vector<Size> shape, bool file_fortran_order) const {
+            core::save_dataset_order(node_, *pstates_, npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<const std::byte*>(val), file_fortran_order);
         }
 
         // Save 1D array from the buffer, with the knowledge of data size.
@@ -92,16 +271,435 @@ namespace poppel {
             this->save_from(val, false, std::vector { size });
         }
 
+        // Save the data using the buffer, so that more data can be appended later.
+        //
+        // Data grows along the first axis in C order, or the last axis in Fortran order. The length of that axis can be zero.
+        // Header space is reserved so that appending never moves existing data.
+        template< typename T >
+        void save_appendable_from(const T* val, bool fortran_order, std::vector<Size> shape) const {
+            core::assert_file_writable(*pstates_);
+            core::assert_is_node_dataset(node_);
+            assert_contiguous_();
+            const auto numbytes = npy::create_header<T>(fortran_order, shape).numbytes();
+            core::write_file(filepath(), *pstates_, [&](const std::filesystem::path& path) {
+                core::save_appendable_from(val, fortran_order, shape, path);
+            });
+            core::update_dataset_checksum(node_, *pstates_, pstates_->checksums ? std::optional(core::crc32c(reinterpret_cast<const std::byte*>(val), numbytes)) : std::nullopt);
+        }
+
+        // Append count slabs of data along the growth axis.
+        // A slab has the shape of the dataset with the growth axis removed. The data type must match exactly.
+        template< typename T >
+        void append_from(const T* val, Size count) const {
+            core::assert_file_writable(*pstates_);
+            core::assert_is_node_dataset(node_);
+            assert_contiguous_();
+            core::unshare_file(filepath(), *pstates_);
+            const auto numbytes = core::append_from(val, count, filepath());
+            core::extend_dataset_checksum(node_, *pstates_, reinterpret_cast<const std::byte*>(val), numbytes);
+        }
+
+        // Get an appender for streaming writes, which batches small appends into large writes.
+        // The header is updated on each write, so the file stays valid as the appender is flushed or destroyed.
+        // Appenders do not maintain checksums. A recorded checksum is removed when the appender is created.
+        template< typename T >
+        auto appender(Size buffer_numbytes = npy::Appender::default_buffer_numbytes) const {
+            core::assert_file_writable(*pstates_);
+            core::assert_is_node_dataset(node_);
+            assert_contiguous_();
+            core::clear_dataset_checksum(node_, *pstates_);
+            core::unshare_file(filepath(), *pstates_);
+            return core::get_appender<T>(filepath(), buffer_numbytes);
+        }
+
+        // Chunked datasets.
+        //------------------------------
+
+        // Get the chunk grid of a chunked dataset.
+        auto chunk_grid() const {
+            core::assert_file_open(*pstates_);
+            assert_chunked_();
+            return core::read_chunk_grid(node_.path());
+        }
+
+        // Load a single chunk into the buffer, which holds the actual shape of the chunk.
+        // Chunks on upper edges are truncated to the dataset shape. Chunks never written are loaded as zeros.
+        template< typename T >
+        void load_chunk(const std::vector<Size>& chunk_index, T* val) const {
+            core::assert_file_open(*pstates_);
+            const auto grid = chunk_grid();
+            if (grid.header.dtype != npy::internal::dtype(T{})) {
+                throw Exception("array dtype is not match");
+            }
+            core::load_chunk(node_.path(), grid, chunk_index, reinterpret_cast<std::byte*>(val));
+        }
+
+        // Save a single chunk from the buffer, which holds the actual shape of the chunk.
+        // Different chunks can be saved concurrently from different threads or processes.
+        template< typename T >
+        void save_chunk(const std::vector<Size>& chunk_index, const T* val) const {
+            core::assert_file_writable(*pstates_);
+            const auto grid = chunk_grid();
+            if (grid.header.dtype != npy::internal::dtype(T{})) {
+                throw Exception("array dtype is not match");
+            }
+            core::save_chunk(node_.path(), grid, chunk_index, reinterpret_cast<const std::byte*>(val), *pstates_);
+        }
+
+        // Update a box region of a chunked dataset in place. Only the chunks intersecting the region are rewritten.
+        // The buffer holds the region with the shape of count, in the index order of the dataset.
+        template< typename T >
+        void save_region_from(const T* val, const std::vector<Size>& offset, const std::vector<Size>& count) const {
+            core::assert_file_writable(*pstates_);
+            const auto grid = chunk_grid();
+            if (grid.header.dtype != npy::internal::dtype(T{})) {
+                throw Exception("array dtype is not match");
+            }
+            core::save_chunked_region(node_.path(), grid, offset, count, reinterpret_cast<const std::byte*>(val), *pstates_, &core::get_io_pool(*pstates_));
+        }
+
+        // Sharded datasets.
+        //------------------------------
+
+        // Get the shard map of a sharded dataset.
+        auto shard_map() const {
+            core::assert_file_open(*pstates_);
+            assert_sharded_();
+            return core::read_shard_map(node_.path());
+        }
+
+        // Load a single shard into the buffer, which holds the shape of the shard. Shards never written are loaded as zeros.
+        template< typename T >
+        void load_shard(Size shard_index, T* val) const {
+            core::assert_file_open(*pstates_);
+            const auto map = shard_map();
+            if (map.header.dtype != npy::internal::dtype(T{})) {
+                throw Exception("array dtype is not match");
+            }
+            core::load_shard(node_.path(), map, shard_index, reinterpret_cast<std::byte*>(val));
+        }
+
+        // Save a single shard from the buffer, which holds the shape of the shard.
+        // Only the file of the shard is written, so that each process of a distributed job can save its own shard concurrently.
+        template< typename T >
+        void save_shard(Size shard_index, const T* val) const {
+            core::assert_file_writable(*pstates_);
+            const auto map = shard_map();
+            if (map.header.dtype != npy::internal::dtype(T{})) {
+                throw Exception("array dtype is not match");
+            }
+            core::save_shard(node_.path(), map, shard_index, reinterpret_cast<const std::byte*>(val), *pstates_);
+        }
+
         // Attributes.
         auto load_attr() const {
-            return core::load_attr(core::get_attribute(node_, *pstates_));
+            return core::load_node_attr(node_, *pstates_);
         }
         auto save_attr(const Json& val) const {
-            return core::save_attr(val, core::get_attribute(node_, *pstates_));
+            return core::save_node_attr(val, node_, *pstates_);
+        }
+        // Handle for repeated access to attributes, writing back once. See Attributes.
+        Attributes attrs() const {
+            return Attributes(core::open_attribute_state(node_, *pstates_), pstates_);
+        }
+    };
+
+
+    // Dataset handle with the data type and rank fixed at compile time, such as TypedDataset<float, 2>.
+    //
+    // The data type and rank are checked once when the handle is obtained, and the header is kept,
+    // so that loads and saves neither build headers nor allocate shapes on each call.
+    // The shape is that of the dataset when the handle was obtained. Saving through the handle keeps it.
+    template< typename T, std::size_t Rank >
+    class TypedDataset {
+        static_assert(npy::is_scalar<T>, "TypedDataset requires a scalar data type.");
+
+    private:
+        core::Node             node_;
+        core::FileStates*      pstates_ = nullptr;
+        npy::Header            header_;
+        std::array<Size, Rank> shape_ {};
+
+        static npy::Shape to_shape_(const std::array<Size, Rank>& dims) {
+            npy::Shape ret;
+            ret.assign(dims.data(), dims.data() + Rank);
+            return ret;
+        }
+
+    public:
+        TypedDataset(core::Node node, core::FileStates* pstates):
+            node_(std::move(node)), pstates_(pstates),
+            header_(core::load_dataset_header(node_, *pstates_))
+        {
+            if (header_.dtype != npy::internal::dtype(T{})) {
+                throw Exception("array dtype is not match");
+            }
+            if (header_.shape.size() != Rank) {
+                throw Exception("array rank is not match");
+            }
+            std::copy(header_.shape.begin(), header_.shape.end(), shape_.begin());
+        }
+
+        //------------------------------
+        // Accessors.
+        //------------------------------
+        auto dataset() const { return Dataset(node_, pstates_); }
+        const auto& header() const noexcept { return header_; }
+        const auto& shape() const noexcept { return shape_; }
+        bool fortran_order() const noexcept { return header_.fortran_order; }
+        Size length() const noexcept { return header_.length(); }
+
+        //------------------------------
+        // Dataset operations.
+        //------------------------------
+
+        // Load the whole data into the buffer, which holds length() elements in the index order of the dataset.
+        void load(T* val) const {
+            core::load_dataset(node_, *pstates_, header_, reinterpret_cast<std::byte*>(val), false);
+        }
+        // Save the whole data from the buffer, with the shape and index order of the handle.
+        void save(const T* val) const {
+            core::save_dataset(node_, *pstates_, header_, reinterpret_cast<const std::byte*>(val));
+        }
+
+        // Load a hyperslab into the buffer, like Dataset::load_slice().
+        void load_slice(T* val, const std::array<Size, Rank>& offset, const std::array<Size, Rank>& count) const {
+            core::load_dataset_region(
+                node_, *pstates_, header_.dtype,
+                npy::Hyperslab { to_shape_(offset), to_shape_(count), {} },
+                reinterpret_cast<std::byte*>(val)
+            );
+        }
+        void load_slice(T* val, const std::array<Size, Rank>& offset, const std::array<Size, Rank>& count, const std::array<Size, Rank>& stride) const {
+            core::load_dataset_region(
+                node_, *pstates_, header_.dtype,
+                npy::Hyperslab { to_shape_(offset), to_shape_(count), to_shape_(stride) },
+                reinterpret_cast<std::byte*>(val)
+            );
+        }
+
+        // Attributes.
+        auto load_attr() const {
+            return core::load_node_attr(node_, *pstates_);
+        }
+        Attributes attrs() const {
+            return Attributes(core::open_attribute_state(node_, *pstates_), pstates_);
         }
     };
 
 
+    // Request to load a dataset into a pre-allocated buffer, used in batch I/O.
+    // The header information must match exactly with the file, unless reshaping is allowed.
+    struct LoadRequest {
+        std::filesystem::path name;
+        npy::Header           header;
+        std::byte*            data = nullptr;
+        bool                  allow_reshape = false;
+
+        LoadRequest(std::filesystem::path name, npy::Header header, std::byte* data, bool allow_reshape = false) :
+            name(std::move(name)), header(std::move(header)), data(data), allow_reshape(allow_reshape)
+        {}
+        template< typename T >
+        LoadRequest(std::filesystem::path name, T* data, bool fortran_order, std::vector<Size> shape, bool allow_reshape = false) :
+            LoadRequest(std::move(name), npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<std::byte*>(data), allow_reshape)
+        {}
+    };
+
+    // Request to save a dataset from a buffer, used in batch I/O.
+    // The dataset is created if it does not exist.
+    struct SaveRequest {
+        std::filesystem::path name;
+        npy::Header           header;
+        const std::byte*      data = nullptr;
+
+        SaveRequest(std::filesystem::path name, npy::Header header, const std::byte* data) :
+            name(std::move(name)), header(std::move(header)), data(data)
+        {}
+        template< typename T >
+        SaveRequest(std::filesystem::path name, const T* data, bool fortran_order, std::vector<Size> shape) :
+            SaveRequest(std::move(name), npy::create_header<T>(fortran_order, std::move(shape)), reinterpret_cast<const std::byte*>(data))
+        {}
+    };
+
+    // Builder of node creations and dataset writes, which are run together. Get one from Group::batch().
+    //
+    // Running the batch checks all names first, and creates each missing intermediate group once.
+    // Nodes and then datasets are written concurrently on the I/O thread pool, followed by one commit of durable writes.
+    // Unlike one by one creation, creating 100k small datasets does not serialize all file system calls.
+    // Buffers of datasets must stay valid until run() returns.
+    class Batch {
+    private:
+        core::Node          node_;
+        core::FileStates*   pstates_ = nullptr;
+        std::vector<std::pair<std::filesystem::path, core::NodeType>> nodes_;
+        // Dataset writes, with the index of their node.
+        std::vector<std::pair<std::size_t, SaveRequest>>              saves_;
+
+    public:
+        Batch(core::Node node, core::FileStates* pstates):
+            node_(std::move(node)), pstates_(pstates)
+        {}
+
+        Batch& create_group(const std::filesystem::path& name) {
+            nodes_.emplace_back(name, core::NodeType::Group);
+            return *this;
+        }
+        Batch& create_raw(const std::filesystem::path& name) {
+            nodes_.emplace_back(name, core::NodeType::Raw);
+            return *this;
+        }
+        // Create a dataset saved from the buffer of the request.
+        Batch& create_dataset(SaveRequest request) {
+            nodes_.emplace_back(request.name, core::NodeType::Dataset);
+            saves_.emplace_back(nodes_.size() - 1, std::move(request));
+            return *this;
+        }
+        template< typename T >
+        Batch& create_dataset(const std::filesystem::path& name, const T* data, bool fortran_order, std::vector<Size> shape) {
+            return create_dataset(SaveRequest(name, data, fortran_order, std::move(shape)));
+        }
+
+        // Number of named nodes.
+        auto size() const noexcept { return nodes_.size(); }
+
+        // Create all nodes and save all datasets, then empty the batch.
+        // If a name conflicts or exists, nothing is created. If a dataset fails to save, the error is thrown after the other datasets are saved.
+        void run();
+    };
+
+    // Item of an access plan of Prefetcher. Without a hyperslab count, the whole dataset is loaded.
+    // Otherwise the hyperslab is loaded in the index order of the dataset, like Dataset::load_slice().
+    struct PrefetchItem {
+        std::filesystem::path name;
+        npy::Hyperslab        slab;
+
+        PrefetchItem(std::filesystem::path name) : name(std::move(name)) {}
+        PrefetchItem(std::filesystem::path name, std::vector<Size> offset, std::vector<Size> count, std::vector<Size> stride = {}) :
+            name(std::move(name)), slab { std::move(offset), std::move(count), std::move(stride) }
+        {}
+    };
+
+    // Reader of datasets in a known order, which loads the next items on the I/O thread pool while the current one is used.
+    // Get one from Group::prefetch().
+    //
+    // At most depth items are loading or waiting to be taken. Arrays given back with recycle() are reused as buffers of later items.
+    // With a handle pool, see File::set_handle_pool_size(), files visited again are not reopened.
+    // The file must stay open while the prefetcher exists. Pending loads are waited for on destruction.
+    class Prefetcher {
+    private:
+        core::Node                               node_;
+        core::FileStates*                        pstates_ = nullptr;
+        std::vector<PrefetchItem>                plan_;
+        std::size_t                              depth_ = 0;
+        // Index of the next item to take, and of the next item to load.
+        std::size_t                              next_ = 0;
+        std::size_t                              next_load_ = 0;
+        std::deque<std::future<npy::NumpyArray>> pending_;
+        std::vector<npy::NumpyArray>             free_;
+
+        void fill_();
+        void wait_();
+
+    public:
+        Prefetcher(core::Node node, core::FileStates* pstates, std::vector<PrefetchItem> plan, std::size_t depth);
+        ~Prefetcher() { wait_(); }
+
+        Prefetcher(Prefetcher&&) = default;
+        Prefetcher& operator=(Prefetcher&&) = delete;
+
+        // Plan of slabs of count slices of the slowest axis in C order, for reading one dataset from start to end.
+        // shape is the shape of the dataset. The last slab may be shorter.
+        static std::vector<PrefetchItem> slab_plan(const std::filesystem::path& name, const std::vector<Size>& shape, Size count);
+
+        auto size() const noexcept { return plan_.size(); }
+        bool done() const noexcept { return next_ == plan_.size(); }
+        // Index in the plan of the item returned by the next call of next().
+        auto position() const noexcept { return next_; }
+
+        // Take the next item in plan order, waiting for it if it is not loaded yet.
+        // If the item fails to load, the error is thrown here and the following items are still available.
+        npy::NumpyArray next();
+        // Give back an array taken from next() when done with it, so that its buffer is reused.
+        void recycle(npy::NumpyArray array);
+    };
+
+    // A node holding opaque files, such as video, compressed blobs or vendor formats, stored as they are.
+    class Raw {
+    private:
+        core::Node          node_;
+        core::FileStates*   pstates_ = nullptr;
+
+    public:
+        Raw(core::Node node, core::FileStates* pstates):
+            node_(std::move(node)), pstates_(pstates)
+        {}
+
+        //------------------------------
+        // Accessors.
+        //------------------------------
+        // Path of the file with the name. The name must be a plain file name.
+        auto filepath(const std::filesystem::path& name) const { return core::raw_file_path(node_, name); }
+        bool has_file(const std::filesystem::path& name) const { return std::filesystem::is_regular_file(filepath(name)); }
+        auto list_files() const { return core::list_raw_files(node_); }
+
+        //------------------------------
+        // File operations.
+        //------------------------------
+
+        // Streaming access. The file is created or truncated by the writer.
+        std::ifstream open_reader(const std::filesystem::path& name) const {
+            core::assert_file_open(*pstates_);
+            std::ifstream ifs(filepath(name), std::ios::binary);
+            if (!ifs) {
+                throw Exception("Unable to open raw file " + name.string() + " for reading.");
+            }
+            return ifs;
+        }
+        std::ofstream open_writer(const std::filesystem::path& name) const {
+            core::assert_file_writable(*pstates_);
+            std::ofstream ofs(filepath(name), std::ios::binary | std::ios::trunc);
+            if (!ofs) {
+                throw Exception("Unable to open raw file " + name.string() + " for writing.");
+            }
+            return ofs;
+        }
+
+        // Memory map the file for zero-copy read-only access.
+        core::MappedFile map(const std::filesystem::path& name) const {
+            core::assert_file_open(*pstates_);
+            return core::MappedFile(filepath(name));
+        }
+
+        // Copy an external file into the node, or a file of the node to an external path, without passing the data through user space where possible.
+        void import_file(const std::filesystem::path& src, const std::filesystem::path& name) const {
+            core::assert_file_writable(*pstates_);
+            core::copy_file_contents(src, filepath(name));
+        }
+        void export_file(const std::filesystem::path& name, const std::filesystem::path& dst) const {
+            core::assert_file_open(*pstates_);
+            core::copy_file_contents(filepath(name), dst);
+        }
+
+        void delete_file(const std::filesystem::path& name) const {
+            core::assert_file_writable(*pstates_);
+            const auto path = filepath(name);
+            if (!std::filesystem::remove(path)) {
+                throw Exception("Raw file " + name.string() + " does not exist.");
+            }
+        }
+
+        // Attributes.
+        auto load_attr() const {
+            return core::load_node_attr(node_, *pstates_);
+        }
+        auto save_attr(const Json& val) const {
+            return core::save_node_attr(val, node_, *pstates_);
+        }
+        Attributes attrs() const {
+            return Attributes(core::open_attribute_state(node_, *pstates_), pstates_);
+        }
+    };
+
     class Group {
     private:
         core::Node          node_;
@@ -116,6 +714,9 @@ namespace poppel {
         Group& operator=(const Group&) = default;
         Group& operator=(Group&&     ) = default;
 
+        // Underlying node, for core operations.
+        const core::Node& node() const { return node_; }
+
         // Group management.
         bool has_group(const std::filesystem::path& name) const;
         Group get_group(const std::filesystem::path& name) const;
@@ -126,6 +727,11 @@ namespace poppel {
         // Dataset management.
         bool has_dataset(const std::filesystem::path& name) const;
         Dataset get_dataset(const std::filesystem::path& name) const;
+        // Get a dataset handle with the data type and rank checked once, such as get_dataset<float, 2>(name). See TypedDataset.
+        template< typename T, std::size_t Rank >
+        TypedDataset<T, Rank> get_dataset(const std::filesystem::path& name) const {
+            return TypedDataset<T, Rank>(core::get_node(node_, name, *pstates_, core::NodeType::Dataset), pstates_);
+        }
         // Create a dataset by passing args to Dataset::save_from function.
         template< typename... Args >
         Dataset create_dataset(const std::filesystem::path& name, Args&&... args) const {
@@ -142,21 +748,105 @@ namespace poppel {
                 return create_dataset(name, std::forward< Args >(args)...);
             }
         }
+        // Create a chunked dataset with fixed-shape chunks, each stored as its own file.
+        // If val is not null, the whole data is saved from the buffer. Otherwise the data is all zero.
+        // Filters, such as [core::shuffle_filter(), core::zstd_filter()], are applied to each chunk.
+        template< typename T >
+        Dataset create_chunked_dataset(const std::filesystem::path& name, const T* val, bool fortran_order, std::vector<Size> shape, std::vector<Size> chunk_shape, Json filters = Json::array()) const {
+            const core::ChunkGrid grid { npy::create_header<T>(fortran_order, std::move(shape)), std::move(chunk_shape), std::move(filters) };
+            core::assert_valid_chunk_grid(grid);
+            auto node = core::create_node(node_, name, *pstates_, core::NodeType::Dataset);
+            core::write_chunk_grid(node.path(), grid, *pstates_);
+            node.meta.layout = core::DatasetLayout::Chunked;
+
+            Dataset dataset(std::move(node), pstates_);
+            if (val) {
+                dataset.save_from(val, grid.header.fortran_order, grid.header.shape);
+            }
+            return dataset;
+        }
+        // Create a sharded dataset of disjoint blocks, such as from core::block_shards(). No data is written.
+        // For distributed writes, one process creates the dataset. After that, each process opens the file in read write mode
+        // and saves its own shard with Dataset::save_shard(), without gathering the array. Readers see the whole array.
+        template< typename T >
+        Dataset create_sharded_dataset(const std::filesystem::path& name, bool fortran_order, std::vector<Size> shape, std::vector<core::Shard> shards) const {
+            const core::ShardMap map { npy::create_header<T>(fortran_order, std::move(shape)), std::move(shards) };
+            core::assert_valid_shard_map(map);
+            auto node = core::create_node(node_, name, *pstates_, core::NodeType::Dataset);
+            core::write_shard_map(node.path(), map, *pstates_);
+            node.meta.layout = core::DatasetLayout::Sharded;
+            return Dataset(std::move(node), pstates_);
+        }
+        // Create an appendable dataset by passing args to Dataset::save_appendable_from function.
+        template< typename... Args >
+        Dataset create_appendable_dataset(const std::filesystem::path& name, Args&&... args) const {
+            Dataset dataset(core::create_node(node_, name, *pstates_, core::NodeType::Dataset), pstates_);
+            dataset.save_appendable_from(std::forward< Args >(args)...);
+            return dataset;
+        }
         void delete_dataset(const std::filesystem::path& name) const;
 
+        // Raw management.
+        bool has_raw(const std::filesystem::path& name) const;
+        Raw get_raw(const std::filesystem::path& name) const;
+        Raw create_raw(const std::filesystem::path& name) const;
+        Raw require_raw(const std::filesystem::path& name) const;
+        void delete_raw(const std::filesystem::path& name) const;
+
+        // Node iteration.
+        //
+        // Each directory is listed once and each poppel.json is parsed at most once, so indexing a large tree needs no further lookups.
+        // If load_headers is set, headers of datasets are loaded as well, through the header index with File::IndexHeaders.
+        // Child nodes, sorted by name.
+        std::vector<core::NodeEntry> children(bool load_headers = false) const;
+        // Call func with each descendant node level by level, sorted by path within a level. Paths are relative to this group.
+        // Directories of a level are scanned concurrently on the I/O thread pool. func is called on this thread.
+        void visit(const std::function<void(const core::NodeEntry&)>& func, bool recursive = true, bool load_headers = false) const;
+
+        // Batch I/O.
+        //
+        // Datasets are transferred concurrently on the I/O thread pool of the file.
+        // Each future reports the completion or the error of its own dataset.
+        // Buffers must stay valid, and the file must stay open, until the futures are ready.
+        std::vector<std::future<npy::NumpyArray>> load_many(const std::vector<std::filesystem::path>& names) const;
+        std::vector<std::future<void>> load_many(std::vector<LoadRequest> requests) const;
+        std::vector<std::future<void>> save_many(std::vector<SaveRequest> requests) const;
+        // Builder of node creations and dataset writes under this group, run together. See Batch.
+        Batch batch() const { return Batch(node_, pstates_); }
+        // Reader of the items of the plan in order, loading up to depth items ahead on the I/O thread pool. See Prefetcher.
+        // Without a plan, all child datasets are read in name order, such as run/0000 to run/9999.
+        Prefetcher prefetch(std::vector<PrefetchItem> plan, std::size_t depth = 4) const;
+        Prefetcher prefetch(std::size_t depth = 4) const;
+
+        // Copying.
+        //
+        // Files are copied without decoding, concurrently on the I/O thread pool of the destination, which may be in another File.
+        // Reflinks are used on file systems that support them, such as Btrfs and XFS, and in kernel copies elsewhere.
+        // If recursive is not set, child groups are skipped. If hard_links is set, data files of contiguous datasets are hard linked where possible.
+        // Writes through poppel to either copy first give the linked file its own content, so that the other copy is not changed.
+        // Changes made in place by other programs are seen by both copies.
+        // Copy this group, with its attributes, to name under dest. The root group of a File is copied as a Group.
+        Group copy_to(const Group& dest, const std::filesystem::path& name, bool recursive = true, bool hard_links = false) const;
+        // Copy the child node name of any type to dest_name under dest.
+        void copy(const std::filesystem::path& name, const Group& dest, const std::filesystem::path& dest_name, bool recursive = true, bool hard_links = false) const;
+
         // Attributes.
         auto load_attr() const {
-            return core::load_attr(core::get_attribute(node_, *pstates_));
+            return core::load_node_attr(node_, *pstates_);
         }
         auto save_attr(const Json& val) const {
-            return core::save_attr(val, core::get_attribute(node_, *pstates_));
+            return core::save_node_attr(val, node_, *pstates_);
+        }
+        // Handle for repeated access to attributes, writing back once. See Attributes.
+        Attributes attrs() const {
+            return Attributes(core::open_attribute_state(node_, *pstates_), pstates_);
         }
     };
 
 
     class File {
     public:
-        using ModeType = std::int8_t;
+        using ModeType = std::int32_t;
         // File visibility/modification mode. Cannot be write-only.
         static constexpr ModeType Read = 1;
         static constexpr ModeType Write = 2;
@@ -165,6 +855,26 @@ namespace poppel {
         // If file already exists: Preserves if none is set. Fails if Excl is set. Truncate the file is Truncate is set. Cannot be both set.
         static constexpr ModeType Excl = 8;
         static constexpr ModeType Truncate = 16;
+        // Cache node metadata in memory, so that repeated navigation does not touch the file system.
+        // Changes made by other File instances or processes are not visible in cached nodes.
+        static constexpr ModeType CacheMeta = 32;
+        // Replace dataset files, including the files of chunks and shards, atomically, by writing a sibling temporary file and renaming it.
+        // A crash leaves either the old or the new data, never a partial file. Appending is still done in place.
+        static constexpr ModeType Atomic = 64;
+        // Atomic, and also flush each dataset file before renaming it. Directories are flushed once each on commit() or close().
+        static constexpr ModeType Durable = 128;
+        // Use a consolidated manifest of the tree at the root. See core::write_manifest().
+        // In read only mode, the manifest is trusted if it exists, so that lookups, dataset headers and attributes are answered from memory.
+        // In read write mode, the manifest is written on close. Opening in read write mode always removes the manifest, which would become stale.
+        static constexpr ModeType Consolidated = 256;
+        // Index dataset headers in memory, keyed by the modification time and size of the data files, so that repeated
+        // load_npy_header() calls and listings with headers cost one stat per dataset instead of opening and parsing the file.
+        // If a manifest exists on open, its headers seed the index. Written manifests record the stamps for this.
+        static constexpr ModeType IndexHeaders = 512;
+        // Record the CRC32C of the data of contiguous datasets in poppel.json on save, and check it on whole loads into buffers.
+        // Saves compute the checksum from memory as the data is written, and appends extend the recorded checksum, so that files are not read back.
+        // Use verify() to check all datasets, such as after copying the file between sites.
+        static constexpr ModeType Checksums = 1024;
 
         static constexpr ModeType ReadOnly    = Read;
         static constexpr ModeType ReadWrite   = Read | Write;
@@ -185,7 +895,11 @@ namespace poppel {
         }
 
         ~File() {
-            close();
+            try {
+                close();
+            } catch (...) {
+                // Destructor must not throw. Call close() explicitly to observe errors.
+            }
         }
 
         File(File&&) = default;
@@ -196,6 +910,10 @@ namespace poppel {
             // Set pstates_.
             pstates_ = std::make_unique<core::FileStates>();
             pstates_->open_state = (mode & Write) ? core::FileOpenState::ReadWrite : core::FileOpenState::ReadOnly;
+            pstates_->meta_cache.enabled = (mode & CacheMeta);
+            pstates_->atomic_writes = (mode & (Atomic | Durable));
+            pstates_->durable_writes = (mode & Durable);
+            pstates_->checksums = (mode & Checksums);
 
             if(std::filesystem::is_directory(path)) {
                 if(mode & Excl) {
@@ -217,15 +935,113 @@ namespace poppel {
                     throw Exception(path.string() + " does not exist.");
                 }
             }
+
+            if (mode & IndexHeaders) {
+                pstates_->header_index.enabled = true;
+                core::read_manifest_headers(group_.node(), *pstates_);
+            }
+            if (mode & Write) {
+                std::filesystem::remove(core::manifest_path(path));
+                pstates_->write_manifest = (mode & Consolidated);
+            }
+            else if (mode & Consolidated) {
+                core::read_manifest(group_.node(), *pstates_);
+            }
         }
         void close() {
+            if (!pstates_) {
+                // Moved from.
+                return;
+            }
+            // Wait for pending asynchronous I/O.
+            pstates_->io_pool.reset();
+            // Write back attributes held by open handles.
+            core::close_attribute_states(*pstates_);
+            if (pstates_->write_manifest && pstates_->open_state == core::FileOpenState::ReadWrite) {
+                core::write_manifest(group_.node(), *pstates_, pstates_->manifest_attrs);
+                pstates_->io_pool.reset();
+            }
+            core::commit_writes(*pstates_);
+            pstates_->handle_pool.clear();
             pstates_->open_state = core::FileOpenState::Closed;
         }
 
+        // Check the data of all datasets with recorded checksums concurrently on the I/O thread pool, without loading them into memory.
+        // Returns the paths of the datasets whose data does not match or cannot be read. Datasets saved without checksums are skipped.
+        std::vector<std::filesystem::path> verify() const {
+            return core::verify_checksums(group_.node(), *pstates_);
+        }
+
+        // Make durable writes since the last commit survive a crash, by flushing their directories.
+        // Flushing is batched, so that saving many datasets costs one directory flush per directory instead of one per file.
+        void commit() const {
+            core::commit_writes(*pstates_);
+        }
+
+        // Set the number of threads used for asynchronous I/O. Zero means the default number.
+        // Pending asynchronous I/O is finished before the change.
+        void set_io_threads(std::size_t num_threads) {
+            pstates_->io_pool.reset();
+            pstates_->io_threads = num_threads;
+        }
+
+        // Set the encoding of attribute files written from now on, such as binary CBOR for large numeric attributes.
+        // Attribute files in any encoding are read regardless.
+        void set_attr_encoding(core::AttributeEncoding encoding) {
+            pstates_->attr_encoding = encoding;
+        }
+
+        // Set whether attributes are included in the manifest written on close. They are included by default.
+        void set_manifest_attrs(bool include_attrs) {
+            pstates_->manifest_attrs = include_attrs;
+        }
+
+        // Collect I/O statistics from now on, or stop collecting them. See core::IoStats.
+        // Not to be changed while operations are running on other threads.
+        void enable_stats(bool enable = true) {
+            if (!enable) {
+                pstates_->instrumentation.stats.reset();
+            } else if (!pstates_->instrumentation.stats) {
+                pstates_->instrumentation.stats = std::make_unique<core::IoStats>();
+            }
+        }
+        // Statistics collected so far, or null if not enabled.
+        core::IoStats* stats() const {
+            return pstates_->instrumentation.stats.get();
+        }
+        // Set the tracer called after each timed operation. An empty function removes the tracer.
+        // Not to be changed while operations are running on other threads.
+        void set_tracer(core::Tracer tracer) {
+            pstates_->instrumentation.tracer = std::move(tracer);
+        }
+
+        // Keep up to max_handles data files of contiguous datasets open, with their parsed headers, in least recently used order.
+        // Repeated buffer loads, slices and header queries of the same datasets then skip opening the file and parsing the header,
+        // and read with pread, without a shared file position. Zero disables the pool, which is the default.
+        // Writes through this file invalidate the handles. See core::FileHandlePool.
+        void set_handle_pool_size(std::size_t max_handles) {
+            pstates_->handle_pool.set_capacity(max_handles);
+        }
+
+        // Transfer whole contiguous datasets larger than stripe_size bytes from and to buffers in stripes of that size,
+        // concurrently on the I/O thread pool with pread and pwrite. See core::load_npy_parallel().
+        // Use the stripe size of the file system, and set_io_threads() for the number of concurrent requests.
+        // Striping takes precedence over the I/O backend. Zero disables it, which is the default.
+        void set_stripe_size(std::size_t stripe_size) {
+            pstates_->stripe_size = stripe_size;
+        }
+
+        // Set the backend for loading and saving whole contiguous datasets from buffers.
+        // Posix or Direct keeps arrays far larger than memory from evicting the page cache of the host.
+        void set_io_backend(core::IoBackend backend) {
+            pstates_->io_backend = backend;
+        }
+
         // File as a group.
         //------------------------------
         auto load_attr() const { return group_.load_attr(); }
         auto save_attr(const Json& val) const { return group_.save_attr(val); }
+        auto attrs() const { return group_.attrs(); }
 
         bool has_group(const std::filesystem::path& name) const { return group_.has_group(name); }
         auto get_group(const std::filesystem::path& name) const { return group_.get_group(name); }
@@ -235,12 +1051,51 @@ namespace poppel {
 
         bool has_dataset(const std::filesystem::path& name) const { return group_.has_dataset(name); }
         auto get_dataset(const std::filesystem::path& name) const { return group_.get_dataset(name); }
+        template< typename T, std::size_t Rank >
+        auto get_dataset(const std::filesystem::path& name) const { return group_.get_dataset<T, Rank>(name); }
         template< typename... Args >
         auto create_dataset(const std::filesystem::path& name, Args&&... args) const { return group_.create_dataset(name, std::forward<Args>(args)...); }
         template< typename... Args >
         auto require_dataset(const std::filesystem::path& name, Args&&... args) const { return group_.require_dataset(name, std::forward<Args>(args)...); }
+        template< typename... Args >
+        auto create_appendable_dataset(const std::filesystem::path& name, Args&&... args) const { return group_.create_appendable_dataset(name, std::forward<Args>(args)...); }
+        template< typename T >
+        auto create_chunked_dataset(const std::filesystem::path& name, const T* val, bool fortran_order, std::vector<Size> shape, std::vector<Size> chunk_shape, Json filters = Json::array()) const {
+            return group_.create_chunked_dataset(name, val, fortran_order, std::move(shape), std::move(chunk_shape), std::move(filters));
+        }
+        template< typename T >
+        auto create_sharded_dataset(const std::filesystem::path& name, bool fortran_order, std::vector<Size> shape, std::vector<core::Shard> shards) const {
+            return group_.create_sharded_dataset<T>(name, fortran_order, std::move(shape), std::move(shards));
+        }
         void delete_dataset(const std::filesystem::path& name) const { return group_.delete_dataset(name); }
 
+        bool has_raw(const std::filesystem::path& name) const { return group_.has_raw(name); }
+        auto get_raw(const std::filesystem::path& name) const { return group_.get_raw(name); }
+        auto create_raw(const std::filesystem::path& name) const { return group_.create_raw(name); }
+        auto require_raw(const std::filesystem::path& name) const { return group_.require_raw(name); }
+        void delete_raw(const std::filesystem::path& name) const { return group_.delete_raw(name); }
+
+        auto children(bool load_headers = false) const { return group_.children(load_headers); }
+        void visit(const std::function<void(const core::NodeEntry&)>& func, bool recursive = true, bool load_headers = false) const {
+            group_.visit(func, recursive, load_headers);
+        }
+
+        auto load_many(const std::vector<std::filesystem::path>& names) const { return group_.load_many(names); }
+        auto load_many(std::vector<LoadRequest> requests) const { return group_.load_many(std::move(requests)); }
+        auto save_many(std::vector<SaveRequest> requests) const { return group_.save_many(std::move(requests)); }
+        auto batch() const { return group_.batch(); }
+        auto prefetch(std::vector<PrefetchItem> plan, std::size_t depth = 4) const { return group_.prefetch(std::move(plan), depth); }
+        auto prefetch(std::size_t depth = 4) const { return group_.prefetch(depth); }
+
+        // Root group, such as the destination of Group::copy_to().
+        const Group& root() const { return group_; }
+        auto copy_to(const Group& dest, const std::filesystem::path& name, bool recursive = true, bool hard_links = false) const {
+            return group_.copy_to(dest, name, recursive, hard_links);
+        }
+        void copy(const std::filesystem::path& name, const Group& dest, const std::filesystem::path& dest_name, bool recursive = true, bool hard_links = false) const {
+            group_.copy(name, dest, dest_name, recursive, hard_links);
+        }
+
     };
 
 } // namespace poppel
@@ -0,0 +1,129 @@
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #define POPPEL_CRC32C_SSE42
+    #include <nmmintrin.h>
+#endif
+
+#include "poppel/core/checksum.hpp"
+
+namespace poppel::core {
+
+    namespace {
+        // Reflected polynomial of CRC32C.
+        constexpr std::uint32_t crc32c_polynomial = 0x82f63b78;
+
+        // Tables for 8 bytes per step. Entry [k][b] is the CRC of byte b followed by k zero bytes.
+        using Tables = std::array<std::array<std::uint32_t, 256>, 8>;
+
+        Tables make_tables() {
+            Tables ret {};
+            for (std::uint32_t b = 0; b < 256; ++b) {
+                std::uint32_t crc = b;
+                for (int i = 0; i < 8; ++i) {
+                    crc = (crc >> 1) ^ (crc & 1 ? crc32c_polynomial : 0);
+                }
+                ret[0][b] = crc;
+            }
+            for (std::size_t k = 1; k < 8; ++k) {
+                for (std::uint32_t b = 0; b < 256; ++b) {
+                    ret[k][b] = (ret[k - 1][b] >> 8) ^ ret[0][ret[k - 1][b] & 0xff];
+                }
+            }
+            return ret;
+        }
+
+        // Operates on the inverted CRC.
+        std::uint32_t crc32c_table(std::uint32_t crc, const std::byte* data, std::size_t size) {
+            static const Tables tables = make_tables();
+            const auto* p = reinterpret_cast<const unsigned char*>(data);
+            for (; size >= 8; size -= 8, p += 8) {
+                // Bytes in memory order, independent of the byte order of the platform.
+                const std::uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | static_cast<std::uint32_t>(p[3]) << 24);
+                crc = tables[7][lo & 0xff] ^ tables[6][(lo >> 8) & 0xff] ^ tables[5][(lo >> 16) & 0xff] ^ tables[4][lo >> 24]
+                    ^ tables[3][p[4]] ^ tables[2][p[5]] ^ tables[1][p[6]] ^ tables[0][p[7]];
+            }
+            for (; size > 0; --size, ++p) {
+                crc = (crc >> 8) ^ tables[0][(crc ^ *p) & 0xff];
+            }
+            return crc;
+        }
+
+    #ifdef POPPEL_CRC32C_SSE42
+        __attribute__((target("sse4.2")))
+        std::uint32_t crc32c_sse42(std::uint32_t crc, const std::byte* data, std::size_t size) {
+            const auto* p = reinterpret_cast<const unsigned char*>(data);
+            std::uint64_t crc64 = crc;
+            for (; size >= 8; size -= 8, p += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, p, 8);
+                crc64 = _mm_crc32_u64(crc64, word);
+            }
+            crc = static_cast<std::uint32_t>(crc64);
+            for (; size > 0; --size, ++p) {
+                crc = _mm_crc32_u8(crc, *p);
+            }
+            return crc;
+        }
+
+        bool has_sse42() {
+            static const bool ret = __builtin_cpu_supports("sse4.2");
+            return ret;
+        }
+    #endif
+
+        // Square matrices over GF(2) of 32 columns, which advance a CRC over zero bits.
+        using Matrix = std::array<std::uint32_t, 32>;
+
+        std::uint32_t matrix_times(const Matrix& mat, std::uint32_t vec) {
+            std::uint32_t ret = 0;
+            for (std::size_t i = 0; vec; vec >>= 1, ++i) {
+                if (vec & 1) {
+                    ret ^= mat[i];
+                }
+            }
+            return ret;
+        }
+
+        Matrix matrix_square(const Matrix& mat) {
+            Matrix ret;
+            for (std::size_t i = 0; i < 32; ++i) {
+                ret[i] = matrix_times(mat, mat[i]);
+            }
+            return ret;
+        }
+    } // namespace
+
+    std::uint32_t crc32c(std::uint32_t crc, const std::byte* data, std::size_t size) {
+    #ifdef POPPEL_CRC32C_SSE42
+        if (has_sse42()) {
+            return ~crc32c_sse42(~crc, data, size);
+        }
+    #endif
+        return ~crc32c_table(~crc, data, size);
+    }
+
+    std::uint32_t crc32c_combine(std::uint32_t crc1, std::uint32_t crc2, std::uint64_t size2) {
+        if (size2 == 0) {
+            return crc1;
+        }
+        // Advance crc1 over size2 zero bytes by repeated squaring of the one zero bit operator, as in zlib.
+        // This works on the final checksums, since the inversions of both parts cancel.
+        Matrix op;
+        op[0] = crc32c_polynomial;
+        for (std::size_t i = 1; i < 32; ++i) {
+            op[i] = std::uint32_t { 1 } << (i - 1);
+        }
+        // Operator for one zero byte.
+        op = matrix_square(matrix_square(matrix_square(op)));
+        for (; size2 > 0; size2 >>= 1) {
+            if (size2 & 1) {
+                crc1 = matrix_times(op, crc1);
+            }
+            op = matrix_square(op);
+        }
+        return crc1 ^ crc2;
+    }
+
+} // namespace poppel::core
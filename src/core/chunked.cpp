@@ -0,0 +1,649 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include "poppel/core/chunked.hpp"
+#include "poppel/core/exceptions.hpp"
+#include "poppel/core/filters.hpp"
+#include "poppel/core/operations.hpp"
+
+namespace poppel::core {
+
+    namespace {
+
+        // Copy a box between two arrays with the same item size and index order.
+        // If src is null, the box in dst is filled with zeros.
+        // If src_step is not empty, source elements are taken with these steps on each axis.
+        void copy_box(
+            const std::byte* src, const std::vector<Size>& src_shape, const std::vector<Size>& src_offset,
+            std::byte*       dst, const std::vector<Size>& dst_shape, const std::vector<Size>& dst_offset,
+            const std::vector<Size>& count, Size itemsize, bool fortran_order,
+            const std::vector<Size>& src_step = {}
+        ) {
+            const Index rank = count.size();
+            for (auto c : count) {
+                if (c == 0) {
+                    return;
+                }
+            }
+
+            // Reorder axes from the slowest varying to the fastest varying.
+            const auto step = [&](Index axis) { return src_step.empty() ? 1 : src_step[axis]; };
+            std::vector<Size> cnt(rank), src_stride(rank), dst_stride(rank);
+            std::ptrdiff_t src_base = 0, dst_base = 0;
+            for (Index i = rank - 1, src_acc = itemsize, dst_acc = itemsize; i >= 0; --i) {
+                const Index axis = fortran_order ? rank - 1 - i : i;
+                cnt[i] = count[axis];
+                src_stride[i] = src_acc * step(axis);
+                dst_stride[i] = dst_acc;
+                src_base += src_offset[axis] * src_acc;
+                dst_base += dst_offset[axis] * dst_acc;
+                src_acc *= src_shape[axis];
+                dst_acc *= dst_shape[axis];
+            }
+
+            // Merge fastest axes that are contiguous in both arrays.
+            Size run_length = itemsize;
+            Index num_outer = rank;
+            while (num_outer > 0) {
+                const Index axis = fortran_order ? rank - num_outer : num_outer - 1;
+                if (step(axis) != 1) {
+                    break;
+                }
+                --num_outer;
+                run_length *= cnt[num_outer];
+                if (cnt[num_outer] != src_shape[axis] || cnt[num_outer] != dst_shape[axis]) {
+                    break;
+                }
+            }
+
+            std::vector<Size> idx(num_outer, 0);
+            while (true) {
+                std::ptrdiff_t src_pos = src_base, dst_pos = dst_base;
+                for (Index i = 0; i < num_outer; ++i) {
+                    src_pos += idx[i] * src_stride[i];
+                    dst_pos += idx[i] * dst_stride[i];
+                }
+                if (src) {
+                    std::memcpy(dst + dst_pos, src + src_pos, run_length);
+                } else {
+                    std::memset(dst + dst_pos, 0, run_length);
+                }
+
+                Index axis = num_outer - 1;
+                for (; axis >= 0; --axis) {
+                    if (++idx[axis] < cnt[axis]) {
+                        break;
+                    }
+                    idx[axis] = 0;
+                }
+                if (axis < 0) {
+                    break;
+                }
+            }
+        }
+
+        // Call func for each chunk index in the grid, in C order.
+        template< typename Func >
+        void for_each_chunk(const std::vector<Size>& begin, const std::vector<Size>& end, Func&& func) {
+            const Index rank = begin.size();
+            for (Index i = 0; i < rank; ++i) {
+                if (begin[i] >= end[i]) {
+                    return;
+                }
+            }
+            auto idx = begin;
+            while (true) {
+                func(idx);
+                Index axis = rank - 1;
+                for (; axis >= 0; --axis) {
+                    if (++idx[axis] < end[axis]) {
+                        break;
+                    }
+                    idx[axis] = begin[axis];
+                }
+                if (axis < 0) {
+                    break;
+                }
+            }
+        }
+
+        auto chunk_header(const ChunkGrid& grid, const std::vector<Size>& chunk_index) {
+            return npy::Header { grid.header.dtype, grid.header.fortran_order, grid.chunk_shape_at(chunk_index) };
+        }
+
+        // Filtered chunks are stored as raw bytes.
+        bool read_filtered_chunk(const std::filesystem::path& path, const ChunkGrid& grid, const npy::Header& header, std::byte* data) {
+            std::ifstream ifs(path, std::ios::binary);
+            if (!ifs) {
+                return false;
+            }
+            ifs.seekg(0, std::ios::end);
+            FilterBuffer buffer(static_cast<std::size_t>(ifs.tellg()));
+            ifs.seekg(0);
+            ifs.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+            if (!ifs) {
+                throw Exception("Cannot read chunk: " + path.string());
+            }
+            buffer = decode_filters(grid.filters, std::move(buffer), header.dtype.itemsize);
+            if (buffer.size() != static_cast<std::size_t>(header.numbytes())) {
+                throw Exception("Decoded chunk size does not match chunk shape: " + path.string());
+            }
+            std::memcpy(data, buffer.data(), buffer.size());
+            return true;
+        }
+        void write_filtered_chunk(const std::filesystem::path& path, const ChunkGrid& grid, const npy::Header& header, const std::byte* data) {
+            auto buffer = encode_filters(grid.filters, FilterBuffer(data, data + header.numbytes()), header.dtype.itemsize);
+            auto ofs = npy::internal::open_file_for_save(path);
+            ofs.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            if (!ofs) {
+                throw Exception("Cannot write chunk: " + path.string());
+            }
+        }
+
+        void assert_valid_chunk_index(const ChunkGrid& grid, const std::vector<Size>& chunk_index) {
+            const auto grid_shape = grid.grid_shape();
+            if (chunk_index.size() != grid_shape.size()) {
+                throw Exception("Chunk index rank does not match dataset.");
+            }
+            for (std::size_t i = 0; i < grid_shape.size(); ++i) {
+                if (chunk_index[i] < 0 || chunk_index[i] >= grid_shape[i]) {
+                    throw Exception("Chunk index is out of bounds.");
+                }
+            }
+        }
+
+    } // namespace
+
+
+    //----------------------------------
+    // Chunk grid metadata.
+    //----------------------------------
+
+    void assert_valid_chunk_grid(const ChunkGrid& grid) {
+        if (grid.chunk_shape.size() != grid.header.shape.size()) {
+            throw Exception("Chunk shape rank does not match dataset.");
+        }
+        for (std::size_t i = 0; i < grid.chunk_shape.size(); ++i) {
+            if (grid.chunk_shape[i] <= 0 || grid.header.shape[i] < 0) {
+                throw Exception("Invalid chunk shape.");
+            }
+        }
+        assert_valid_filters(grid.filters);
+    }
+
+    Json chunk_grid_to_json(const ChunkGrid& grid) {
+        Json json;
+        json["type"] = text(DatasetLayout::Chunked);
+        json["descr"] = npy::internal::gen_descr(grid.header.dtype);
+        json["fortran_order"] = grid.header.fortran_order;
+        json["shape"] = grid.header.shape;
+        json["chunk_shape"] = grid.chunk_shape;
+        json["filters"] = grid.filters;
+        return json;
+    }
+    ChunkGrid chunk_grid_from_json(const Json& json) {
+        ChunkGrid grid;
+        grid.header.dtype = npy::internal::parse_descr(json["descr"].get<std::string>());
+        grid.header.fortran_order = json["fortran_order"].get<bool>();
+        grid.header.shape = json["shape"].get<std::vector<Size>>();
+        grid.chunk_shape = json["chunk_shape"].get<std::vector<Size>>();
+        grid.filters = json.value("filters", Json::array());
+        assert_valid_chunk_grid(grid);
+        return grid;
+    }
+
+    ChunkGrid read_chunk_grid(const std::filesystem::path& nodepath) {
+        const auto json = read_node_json(nodepath);
+        if (!json.contains("layout") || dataset_layout(json["layout"]["type"].get<std::string>()) != DatasetLayout::Chunked) {
+            throw Exception("Dataset is not chunked.");
+        }
+        return chunk_grid_from_json(json["layout"]);
+    }
+    void write_chunk_grid(const std::filesystem::path& nodepath, const ChunkGrid& grid, const FileStates& filestates) {
+        assert_valid_chunk_grid(grid);
+        const NodeMeta meta { 1, NodeType::Dataset, DatasetLayout::Chunked };
+
+        Json json;
+        json["version"] = meta.version;
+        json["type"] = text(meta.type);
+        json["layout"] = chunk_grid_to_json(grid);
+        write_node_json(nodepath, json);
+        cache_node_meta(nodepath, meta, filestates);
+    }
+
+    std::filesystem::path chunk_path(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& chunk_index) {
+        std::string name = "chunk";
+        for (auto i : chunk_index) {
+            name += '.';
+            name += std::to_string(i);
+        }
+        name += grid.filters.empty() ? ".npy" : ".bin";
+        return nodepath / name;
+    }
+
+
+    //----------------------------------
+    // Chunked data transfer.
+    //----------------------------------
+
+    void load_chunk(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& chunk_index, std::byte* data) {
+        assert_valid_chunk_index(grid, chunk_index);
+        const auto header = chunk_header(grid, chunk_index);
+        const auto path = chunk_path(nodepath, grid, chunk_index);
+        if (!grid.filters.empty()) {
+            if (!read_filtered_chunk(path, grid, header, data)) {
+                std::memset(data, 0, header.numbytes());
+            }
+        } else if (std::filesystem::exists(path)) {
+            npy::load(path, header, data, false);
+        } else {
+            std::memset(data, 0, header.numbytes());
+        }
+    }
+    void save_chunk(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& chunk_index, const std::byte* data, const FileStates& filestates) {
+        assert_valid_chunk_index(grid, chunk_index);
+        const auto header = chunk_header(grid, chunk_index);
+        write_file(chunk_path(nodepath, grid, chunk_index), filestates, [&](const std::filesystem::path& path) {
+            if (grid.filters.empty()) {
+                npy::save(path, header, data);
+            } else {
+                write_filtered_chunk(path, grid, header, data);
+            }
+        });
+    }
+
+    void load_chunked(const std::filesystem::path& nodepath, const ChunkGrid& grid, std::byte* data, ThreadPool* pool) {
+        const auto rank = grid.header.shape.size();
+        load_chunked_region(nodepath, grid, npy::Hyperslab { std::vector<Size>(rank, 0), grid.header.shape, {} }, data, pool);
+    }
+    void save_chunked(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::byte* data, const FileStates& filestates, ThreadPool* pool) {
+        const auto rank = grid.header.shape.size();
+        save_chunked_region(nodepath, grid, std::vector<Size>(rank, 0), grid.header.shape, data, filestates, pool);
+    }
+
+    void load_chunked_convert(const std::filesystem::path& nodepath, const ChunkGrid& grid, npy::Dtype dtype, std::byte* data, ThreadPool* pool) {
+        if (dtype == grid.header.dtype) {
+            load_chunked(nodepath, grid, data, pool);
+            return;
+        }
+        if (!npy::internal::is_convertible(grid.header.dtype, dtype)) {
+            throw Exception("Dataset data type is not convertible.");
+        }
+        const Index rank = grid.header.shape.size();
+        std::vector<std::function<void()>> tasks;
+        for_each_chunk(std::vector<Size>(rank, 0), grid.grid_shape(), [&](const std::vector<Size>& chunk_index) {
+            tasks.push_back([&, chunk_index] {
+                const auto header = chunk_header(grid, chunk_index);
+                std::vector<std::byte> buffer(header.numbytes());
+                std::vector<std::byte> converted(header.length() * dtype.itemsize);
+                load_chunk(nodepath, grid, chunk_index, buffer.data());
+                npy::internal::convert_buffer(buffer.data(), grid.header.dtype, converted.data(), dtype, header.length());
+
+                std::vector<Size> offset(rank);
+                for (Index i = 0; i < rank; ++i) {
+                    offset[i] = chunk_index[i] * grid.chunk_shape[i];
+                }
+                copy_box(
+                    converted.data(), header.shape, std::vector<Size>(rank, 0),
+                    data, grid.header.shape, offset,
+                    header.shape, dtype.itemsize, grid.header.fortran_order
+                );
+            });
+        });
+        run_tasks(tasks, pool);
+    }
+
+    void load_chunked_region(const std::filesystem::path& nodepath, const ChunkGrid& grid, const npy::Hyperslab& slab, std::byte* data, ThreadPool* pool) {
+        npy::internal::assert_valid_hyperslab(grid.header, slab);
+        if (slab.length() == 0) {
+            return;
+        }
+        const Index rank = grid.header.shape.size();
+        const auto stride = [&](Index axis) { return slab.stride.empty() ? 1 : slab.stride[axis]; };
+
+        // Range of chunks touched by the selection.
+        std::vector<Size> chunk_begin(rank), chunk_end(rank);
+        for (Index i = 0; i < rank; ++i) {
+            chunk_begin[i] = slab.offset[i] / grid.chunk_shape[i];
+            chunk_end[i] = (slab.offset[i] + (slab.count[i] - 1) * stride(i)) / grid.chunk_shape[i] + 1;
+        }
+
+        std::vector<std::function<void()>> tasks;
+        for_each_chunk(chunk_begin, chunk_end, [&](const std::vector<Size>& chunk_index) {
+            // Selection within the chunk, and where it goes in the output.
+            npy::Hyperslab local { std::vector<Size>(rank), std::vector<Size>(rank), slab.stride };
+            std::vector<Size> out_offset(rank);
+            for (Index i = 0; i < rank; ++i) {
+                const auto lo = chunk_index[i] * grid.chunk_shape[i];
+                const auto hi = std::min(lo + grid.chunk_shape[i], grid.header.shape[i]);
+                const auto first = lo <= slab.offset[i] ? 0 : (lo - slab.offset[i] + stride(i) - 1) / stride(i);
+                const auto last = std::min(slab.count[i] - 1, (hi - 1 - slab.offset[i]) / stride(i));
+                if (first > last) {
+                    return;
+                }
+                local.offset[i] = slab.offset[i] + first * stride(i) - lo;
+                local.count[i] = last - first + 1;
+                out_offset[i] = first;
+            }
+            tasks.push_back([&, chunk_index, local = std::move(local), out_offset = std::move(out_offset)] {
+                const auto itemsize = grid.header.dtype.itemsize;
+                const auto path = chunk_path(nodepath, grid, chunk_index);
+                std::vector<std::byte> buffer;
+                const std::byte* src = nullptr;
+                if (!grid.filters.empty()) {
+                    // Filtered chunks are decoded whole, then the selection is picked from the decoded chunk.
+                    const auto header = chunk_header(grid, chunk_index);
+                    buffer.resize(header.numbytes());
+                    if (read_filtered_chunk(path, grid, header, buffer.data())) {
+                        copy_box(
+                            buffer.data(), header.shape, local.offset,
+                            data, slab.count, out_offset,
+                            local.count, itemsize, grid.header.fortran_order, local.stride
+                        );
+                        return;
+                    }
+                } else if (std::filesystem::exists(path)) {
+                    buffer.resize(local.length() * itemsize);
+                    npy::load_region(path, grid.header.dtype, local, buffer.data());
+                    src = buffer.data();
+                }
+                copy_box(
+                    src, local.count, std::vector<Size>(rank, 0),
+                    data, slab.count, out_offset,
+                    local.count, itemsize, grid.header.fortran_order
+                );
+            });
+        });
+        run_tasks(tasks, pool);
+    }
+
+    void save_chunked_region(const std::filesystem::path& nodepath, const ChunkGrid& grid, const std::vector<Size>& offset, const std::vector<Size>& count, const std::byte* data, const FileStates& filestates, ThreadPool* pool) {
+        npy::internal::assert_valid_hyperslab(grid.header, npy::Hyperslab { offset, count, {} });
+        const Index rank = grid.header.shape.size();
+        for (auto c : count) {
+            if (c == 0) {
+                return;
+            }
+        }
+
+        std::vector<Size> chunk_begin(rank), chunk_end(rank);
+        for (Index i = 0; i < rank; ++i) {
+            chunk_begin[i] = offset[i] / grid.chunk_shape[i];
+            chunk_end[i] = (offset[i] + count[i] - 1) / grid.chunk_shape[i] + 1;
+        }
+
+        std::vector<std::function<void()>> tasks;
+        for_each_chunk(chunk_begin, chunk_end, [&](const std::vector<Size>& chunk_index) {
+            tasks.push_back([&, chunk_index] {
+                const auto header = chunk_header(grid, chunk_index);
+                const auto itemsize = header.dtype.itemsize;
+
+                // Intersection of the box with the chunk, in chunk and in source coordinates.
+                std::vector<Size> local_offset(rank), local_count(rank), src_offset(rank);
+                bool covered = true;
+                for (Index i = 0; i < rank; ++i) {
+                    const auto lo = chunk_index[i] * grid.chunk_shape[i];
+                    const auto begin = std::max(lo, offset[i]);
+                    const auto end = std::min(lo + header.shape[i], offset[i] + count[i]);
+                    local_offset[i] = begin - lo;
+                    local_count[i] = end - begin;
+                    src_offset[i] = begin - offset[i];
+                    covered = covered && local_count[i] == header.shape[i];
+                }
+
+                std::vector<std::byte> buffer(header.numbytes());
+                if (!covered) {
+                    load_chunk(nodepath, grid, chunk_index, buffer.data());
+                }
+                copy_box(
+                    data, count, src_offset,
+                    buffer.data(), header.shape, local_offset,
+                    local_count, itemsize, header.fortran_order
+                );
+                save_chunk(nodepath, grid, chunk_index, buffer.data(), filestates);
+            });
+        });
+        run_tasks(tasks, pool);
+    }
+
+
+
+    //----------------------------------
+    // Shard map metadata.
+    //----------------------------------
+
+    namespace {
+        void assert_valid_shard_index(const ShardMap& map, Size shard_index) {
+            if (shard_index < 0 || shard_index >= static_cast<Size>(map.shards.size())) {
+                throw Exception("Shard index is out of bounds.");
+            }
+        }
+
+        auto shard_header(const ShardMap& map, Size shard_index) {
+            return npy::Header { map.header.dtype, map.header.fortran_order, map.shards[shard_index].shape };
+        }
+
+        bool shards_overlap(const Shard& a, const Shard& b) {
+            for (std::size_t i = 0; i < a.shape.size(); ++i) {
+                if (a.offset[i] >= b.offset[i] + b.shape[i] || b.offset[i] >= a.offset[i] + a.shape[i]) {
+                    return false;
+                }
+            }
+            return a.length() > 0 && b.length() > 0;
+        }
+
+        // Overlaps are only checked when the map is created, since that takes quadratic time in the number of shards.
+        void assert_valid_shard_bounds(const ShardMap& map) {
+            const auto rank = map.header.shape.size();
+            for (const auto& shard : map.shards) {
+                if (shard.offset.size() != rank || shard.shape.size() != rank) {
+                    throw Exception("Shard rank does not match dataset.");
+                }
+                for (std::size_t i = 0; i < rank; ++i) {
+                    if (shard.offset[i] < 0 || shard.shape[i] < 0 || shard.offset[i] + shard.shape[i] > map.header.shape[i]) {
+                        throw Exception("Shard is out of bounds.");
+                    }
+                }
+            }
+        }
+    } // namespace
+
+    void assert_valid_shard_map(const ShardMap& map) {
+        assert_valid_shard_bounds(map);
+        for (std::size_t i = 0; i < map.shards.size(); ++i) {
+            for (std::size_t j = i + 1; j < map.shards.size(); ++j) {
+                if (shards_overlap(map.shards[i], map.shards[j])) {
+                    throw Exception("Shards " + std::to_string(i) + " and " + std::to_string(j) + " overlap.");
+                }
+            }
+        }
+    }
+
+    Json shard_map_to_json(const ShardMap& map) {
+        Json json;
+        json["type"] = text(DatasetLayout::Sharded);
+        json["descr"] = npy::internal::gen_descr(map.header.dtype);
+        json["fortran_order"] = map.header.fortran_order;
+        json["shape"] = map.header.shape;
+        auto& shards = json["shards"] = Json::array();
+        for (const auto& shard : map.shards) {
+            shards.push_back({ { "offset", shard.offset }, { "shape", shard.shape } });
+        }
+        return json;
+    }
+    ShardMap shard_map_from_json(const Json& json) {
+        ShardMap map;
+        map.header.dtype = npy::internal::parse_descr(json["descr"].get<std::string>());
+        map.header.fortran_order = json["fortran_order"].get<bool>();
+        map.header.shape = json["shape"].get<std::vector<Size>>();
+        for (const auto& shard : json["shards"]) {
+            map.shards.push_back({ shard["offset"].get<std::vector<Size>>(), shard["shape"].get<std::vector<Size>>() });
+        }
+        assert_valid_shard_bounds(map);
+        return map;
+    }
+
+    ShardMap read_shard_map(const std::filesystem::path& nodepath) {
+        const auto json = read_node_json(nodepath);
+        if (!json.contains("layout") || dataset_layout(json["layout"]["type"].get<std::string>()) != DatasetLayout::Sharded) {
+            throw Exception("Dataset is not sharded.");
+        }
+        return shard_map_from_json(json["layout"]);
+    }
+    void write_shard_map(const std::filesystem::path& nodepath, const ShardMap& map, const FileStates& filestates) {
+        assert_valid_shard_map(map);
+        const NodeMeta meta { 1, NodeType::Dataset, DatasetLayout::Sharded };
+
+        Json json;
+        json["version"] = meta.version;
+        json["type"] = text(meta.type);
+        json["layout"] = shard_map_to_json(map);
+        write_node_json(nodepath, json);
+        cache_node_meta(nodepath, meta, filestates);
+    }
+
+    std::filesystem::path shard_path(const std::filesystem::path& nodepath, Size shard_index) {
+        return nodepath / ("shard." + std::to_string(shard_index) + ".npy");
+    }
+
+    std::vector<Shard> block_shards(const std::vector<Size>& shape, const std::vector<Size>& num_blocks) {
+        const Index rank = shape.size();
+        if (static_cast<Index>(num_blocks.size()) != rank) {
+            throw Exception("Number of blocks does not match dataset rank.");
+        }
+        for (Index i = 0; i < rank; ++i) {
+            if (num_blocks[i] <= 0) {
+                throw Exception("Invalid number of blocks.");
+            }
+        }
+
+        // The first shape % n blocks on each axis are one longer.
+        const auto block_begin = [&](Index axis, Size b) {
+            const auto base = shape[axis] / num_blocks[axis];
+            const auto rem = shape[axis] % num_blocks[axis];
+            return b * base + std::min(b, rem);
+        };
+        std::vector<Shard> ret;
+        for_each_chunk(std::vector<Size>(rank, 0), num_blocks, [&](const std::vector<Size>& block_index) {
+            Shard shard { std::vector<Size>(rank), std::vector<Size>(rank) };
+            for (Index i = 0; i < rank; ++i) {
+                shard.offset[i] = block_begin(i, block_index[i]);
+                shard.shape[i] = block_begin(i, block_index[i] + 1) - shard.offset[i];
+            }
+            ret.push_back(std::move(shard));
+        });
+        return ret;
+    }
+
+
+    //----------------------------------
+    // Sharded data transfer.
+    //----------------------------------
+
+    void load_shard(const std::filesystem::path& nodepath, const ShardMap& map, Size shard_index, std::byte* data) {
+        assert_valid_shard_index(map, shard_index);
+        const auto header = shard_header(map, shard_index);
+        const auto path = shard_path(nodepath, shard_index);
+        if (std::filesystem::exists(path)) {
+            npy::load(path, header, data, false);
+        } else {
+            std::memset(data, 0, header.numbytes());
+        }
+    }
+    void save_shard(const std::filesystem::path& nodepath, const ShardMap& map, Size shard_index, const std::byte* data, const FileStates& filestates) {
+        assert_valid_shard_index(map, shard_index);
+        write_file(shard_path(nodepath, shard_index), filestates, [&](const std::filesystem::path& path) {
+            npy::save(path, shard_header(map, shard_index), data);
+        });
+    }
+
+    void load_sharded(const std::filesystem::path& nodepath, const ShardMap& map, std::byte* data, ThreadPool* pool) {
+        const auto rank = map.header.shape.size();
+        load_sharded_region(nodepath, map, npy::Hyperslab { std::vector<Size>(rank, 0), map.header.shape, {} }, data, pool);
+    }
+    void save_sharded(const std::filesystem::path& nodepath, const ShardMap& map, const std::byte* data, const FileStates& filestates, ThreadPool* pool) {
+        const Index rank = map.header.shape.size();
+        std::vector<std::function<void()>> tasks;
+        for (Size s = 0; s < static_cast<Size>(map.shards.size()); ++s) {
+            tasks.push_back([&, s] {
+                const auto header = shard_header(map, s);
+                std::vector<std::byte> buffer(header.numbytes());
+                copy_box(
+                    data, map.header.shape, map.shards[s].offset,
+                    buffer.data(), map.shards[s].shape, std::vector<Size>(rank, 0),
+                    map.shards[s].shape, header.dtype.itemsize, header.fortran_order
+                );
+                write_file(shard_path(nodepath, s), filestates, [&](const std::filesystem::path& path) {
+                    npy::save(path, header, buffer.data());
+                });
+            });
+        }
+        run_tasks(tasks, pool);
+    }
+
+    void load_sharded_region(const std::filesystem::path& nodepath, const ShardMap& map, const npy::Hyperslab& slab, std::byte* data, ThreadPool* pool) {
+        npy::internal::assert_valid_hyperslab(map.header, slab);
+        if (slab.length() == 0) {
+            return;
+        }
+        const Index rank = map.header.shape.size();
+        const auto itemsize = map.header.dtype.itemsize;
+        const auto stride = [&](Index axis) { return slab.stride.empty() ? 1 : slab.stride[axis]; };
+
+        // Shards are disjoint, so they cover the whole array if their sizes add up.
+        Size covered = 0;
+        for (const auto& shard : map.shards) {
+            covered += shard.length();
+        }
+        if (covered != map.header.length()) {
+            std::memset(data, 0, slab.length() * itemsize);
+        }
+
+        std::vector<std::function<void()>> tasks;
+        for (Size s = 0; s < static_cast<Size>(map.shards.size()); ++s) {
+            const auto& shard = map.shards[s];
+            // Selection within the shard, and where it goes in the output.
+            npy::Hyperslab local { std::vector<Size>(rank), std::vector<Size>(rank), slab.stride };
+            std::vector<Size> out_offset(rank);
+            bool intersects = true;
+            for (Index i = 0; i < rank && intersects; ++i) {
+                const auto lo = shard.offset[i];
+                const auto hi = lo + shard.shape[i];
+                if (hi <= slab.offset[i]) {
+                    intersects = false;
+                    break;
+                }
+                const auto first = lo <= slab.offset[i] ? 0 : (lo - slab.offset[i] + stride(i) - 1) / stride(i);
+                const auto last = std::min(slab.count[i] - 1, (hi - 1 - slab.offset[i]) / stride(i));
+                intersects = first <= last;
+                local.offset[i] = slab.offset[i] + first * stride(i) - lo;
+                local.count[i] = last - first + 1;
+                out_offset[i] = first;
+            }
+            if (!intersects) {
+                continue;
+            }
+            tasks.push_back([&, s, local = std::move(local), out_offset = std::move(out_offset)] {
+                const auto path = shard_path(nodepath, s);
+                std::vector<std::byte> buffer;
+                const std::byte* src = nullptr;
+                if (std::filesystem::exists(path)) {
+                    buffer.resize(local.length() * itemsize);
+                    npy::load_region(path, map.header.dtype, local, buffer.data());
+                    src = buffer.data();
+                }
+                copy_box(
+                    src, local.count, std::vector<Size>(rank, 0),
+                    data, slab.count, out_offset,
+                    local.count, itemsize, map.header.fortran_order
+                );
+            });
+        }
+        run_tasks(tasks, pool);
+    }
+
+} // namespace poppel::core
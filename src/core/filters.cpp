@@ -0,0 +1,204 @@
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#ifdef POPPEL_WITH_ZSTD
+    #include <zstd.h>
+#endif
+#ifdef POPPEL_WITH_LZ4
+    #include <lz4.h>
+#endif
+
+#include "poppel/core/exceptions.hpp"
+#include "poppel/core/filters.hpp"
+
+namespace poppel::core {
+
+    namespace {
+
+        class ShuffleFilter : public Filter {
+        public:
+            FilterBuffer encode(FilterBuffer data, Size itemsize) const override {
+                if (itemsize <= 1) {
+                    return data;
+                }
+                const Size n = data.size() / itemsize;
+                FilterBuffer ret(data.size());
+                for (Size b = 0; b < itemsize; ++b) {
+                    for (Size i = 0; i < n; ++i) {
+                        ret[b * n + i] = data[i * itemsize + b];
+                    }
+                }
+                // Trailing bytes not forming a whole item are kept in place.
+                std::copy(data.begin() + n * itemsize, data.end(), ret.begin() + n * itemsize);
+                return ret;
+            }
+            FilterBuffer decode(FilterBuffer data, Size itemsize) const override {
+                if (itemsize <= 1) {
+                    return data;
+                }
+                const Size n = data.size() / itemsize;
+                FilterBuffer ret(data.size());
+                for (Size b = 0; b < itemsize; ++b) {
+                    for (Size i = 0; i < n; ++i) {
+                        ret[i * itemsize + b] = data[b * n + i];
+                    }
+                }
+                std::copy(data.begin() + n * itemsize, data.end(), ret.begin() + n * itemsize);
+                return ret;
+            }
+        };
+
+        #ifdef POPPEL_WITH_ZSTD
+            class ZstdFilter : public Filter {
+            private:
+                int level_;
+            public:
+                explicit ZstdFilter(int level) : level_(level) {}
+
+                FilterBuffer encode(FilterBuffer data, Size) const override {
+                    FilterBuffer ret(ZSTD_compressBound(data.size()));
+                    const auto size = ZSTD_compress(ret.data(), ret.size(), data.data(), data.size(), level_);
+                    if (ZSTD_isError(size)) {
+                        throw Exception(std::string("zstd compression failed: ") + ZSTD_getErrorName(size));
+                    }
+                    ret.resize(size);
+                    return ret;
+                }
+                FilterBuffer decode(FilterBuffer data, Size) const override {
+                    const auto decoded_size = ZSTD_getFrameContentSize(data.data(), data.size());
+                    if (decoded_size == ZSTD_CONTENTSIZE_ERROR || decoded_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+                        throw Exception("zstd decompression failed: invalid frame");
+                    }
+                    FilterBuffer ret(decoded_size);
+                    const auto size = ZSTD_decompress(ret.data(), ret.size(), data.data(), data.size());
+                    if (ZSTD_isError(size) || size != decoded_size) {
+                        throw Exception("zstd decompression failed");
+                    }
+                    return ret;
+                }
+            };
+        #endif
+
+        #ifdef POPPEL_WITH_LZ4
+            // The lz4 block format does not store the decoded size, so it is prefixed as 8 little-endian bytes.
+            class Lz4Filter : public Filter {
+            private:
+                static constexpr std::size_t prefix_length = 8;
+            public:
+                FilterBuffer encode(FilterBuffer data, Size) const override {
+                    if (data.size() > static_cast<std::size_t>(LZ4_MAX_INPUT_SIZE)) {
+                        throw Exception("lz4 compression failed: chunk is too large");
+                    }
+                    const int src_size = static_cast<int>(data.size());
+                    FilterBuffer ret(prefix_length + LZ4_compressBound(src_size));
+                    for (std::size_t i = 0; i < prefix_length; ++i) {
+                        ret[i] = static_cast<std::byte>((static_cast<std::uint64_t>(src_size) >> (8 * i)) & 0xff);
+                    }
+                    const int size = LZ4_compress_default(
+                        reinterpret_cast<const char*>(data.data()), reinterpret_cast<char*>(ret.data() + prefix_length),
+                        src_size, static_cast<int>(ret.size() - prefix_length)
+                    );
+                    if (size <= 0) {
+                        throw Exception("lz4 compression failed");
+                    }
+                    ret.resize(prefix_length + size);
+                    return ret;
+                }
+                FilterBuffer decode(FilterBuffer data, Size) const override {
+                    if (data.size() < prefix_length) {
+                        throw Exception("lz4 decompression failed: invalid block");
+                    }
+                    std::uint64_t decoded_size = 0;
+                    for (std::size_t i = 0; i < prefix_length; ++i) {
+                        decoded_size |= static_cast<std::uint64_t>(data[i]) << (8 * i);
+                    }
+                    FilterBuffer ret(decoded_size);
+                    const int size = LZ4_decompress_safe(
+                        reinterpret_cast<const char*>(data.data() + prefix_length), reinterpret_cast<char*>(ret.data()),
+                        static_cast<int>(data.size() - prefix_length), static_cast<int>(decoded_size)
+                    );
+                    if (size < 0 || static_cast<std::uint64_t>(size) != decoded_size) {
+                        throw Exception("lz4 decompression failed");
+                    }
+                    return ret;
+                }
+            };
+        #endif
+
+        struct FilterRegistry {
+            std::mutex                           mutex;
+            std::map<std::string, FilterFactory, std::less<>> factories;
+
+            FilterRegistry() {
+                factories["shuffle"] = [](const Json&) { return std::make_unique<ShuffleFilter>(); };
+                #ifdef POPPEL_WITH_ZSTD
+                    factories["zstd"] = [](const Json& config) { return std::make_unique<ZstdFilter>(config.value("level", 3)); };
+                #endif
+                #ifdef POPPEL_WITH_LZ4
+                    factories["lz4"] = [](const Json&) { return std::make_unique<Lz4Filter>(); };
+                #endif
+            }
+        };
+        FilterRegistry& filter_registry() {
+            static FilterRegistry registry;
+            return registry;
+        }
+
+    } // namespace
+
+    void register_filter(const std::string& id, FilterFactory factory) {
+        auto& registry = filter_registry();
+        std::lock_guard lock(registry.mutex);
+        registry.factories[id] = std::move(factory);
+    }
+    bool has_filter(std::string_view id) {
+        auto& registry = filter_registry();
+        std::lock_guard lock(registry.mutex);
+        return registry.factories.find(id) != registry.factories.end();
+    }
+    std::unique_ptr<Filter> make_filter(const Json& config) {
+        const auto id = config.at("id").get<std::string>();
+        FilterFactory factory;
+        {
+            auto& registry = filter_registry();
+            std::lock_guard lock(registry.mutex);
+            auto it = registry.factories.find(id);
+            if (it == registry.factories.end()) {
+                throw NotImplementedError("Filter " + id + " is not available.");
+            }
+            factory = it->second;
+        }
+        return factory(config);
+    }
+
+    void assert_valid_filters(const Json& filters) {
+        if (!filters.is_array()) {
+            throw Exception("Filters must be an array.");
+        }
+        for (const auto& config : filters) {
+            if (!config.is_object() || !config.contains("id")) {
+                throw Exception("Filter configuration must be an object with an id.");
+            }
+            if (!has_filter(config["id"].get<std::string>())) {
+                throw NotImplementedError("Filter " + config["id"].get<std::string>() + " is not available.");
+            }
+        }
+    }
+
+    FilterBuffer encode_filters(const Json& filters, FilterBuffer data, Size itemsize) {
+        for (const auto& config : filters) {
+            data = make_filter(config)->encode(std::move(data), itemsize);
+        }
+        return data;
+    }
+    FilterBuffer decode_filters(const Json& filters, FilterBuffer data, Size itemsize) {
+        for (auto it = filters.rbegin(); it != filters.rend(); ++it) {
+            data = make_filter(*it)->decode(std::move(data), itemsize);
+        }
+        return data;
+    }
+
+} // namespace poppel::core
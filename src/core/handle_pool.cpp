@@ -0,0 +1,194 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "poppel/core/exceptions.hpp"
+#include "poppel/core/handle_pool.hpp"
+#include "poppel/core/utilities.hpp"
+
+namespace poppel::core {
+
+    //----------------------------------
+    // Npy file handle.
+    //----------------------------------
+
+#ifndef _WIN32
+
+    namespace {
+        // Size of the first read, which should contain the whole npy header.
+        constexpr std::size_t header_probe_size = 64 << 10;
+
+        std::size_t pread_some(int fd, std::byte* buffer, std::size_t count, off_t offset) {
+            std::size_t done = 0;
+            while (done < count) {
+                const ssize_t n = ::pread(fd, buffer + done, count - done, offset + done);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw Exception(std::string("Unable to read file: ") + std::strerror(errno));
+                }
+                if (n == 0) {
+                    break;
+                }
+                done += n;
+            }
+            return done;
+        }
+
+        npy::internal::Size file_size(int fd) {
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                throw Exception(std::string("Unable to stat file: ") + std::strerror(errno));
+            }
+            return st.st_size;
+        }
+    } // namespace
+
+    NpyFileHandle::NpyFileHandle(const std::filesystem::path& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            throw Exception("Unable to open " + path.string() + ": " + std::strerror(errno));
+        }
+        bool opened = false;
+        ScopeGuard close_guard { [&] {
+            if (!opened) {
+                ::close(fd_);
+            }
+        } };
+
+        file_size_ = file_size(fd_);
+        std::vector<std::byte> buffer(std::min<std::size_t>(header_probe_size, file_size_));
+        const auto n = pread_some(fd_, buffer.data(), buffer.size(), 0);
+        auto [header, data_offset] = npy::load_header(buffer.data(), n);
+        header_ = std::move(header);
+        data_offset_ = data_offset;
+        opened = true;
+    }
+
+    NpyFileHandle::~NpyFileHandle() {
+        ::close(fd_);
+    }
+
+    bool NpyFileHandle::unchanged() const {
+        return file_size(fd_) == file_size_;
+    }
+
+    void NpyFileHandle::read_data(std::byte* buffer, npy::internal::Size count, npy::internal::Size offset) const {
+        if (pread_some(fd_, buffer, count, data_offset_ + offset) < static_cast<std::size_t>(count)) {
+            throw std::runtime_error("io error: failed reading file");
+        }
+    }
+
+#else
+
+    NpyFileHandle::NpyFileHandle(const std::filesystem::path& path) {
+        throw NotImplementedError("Open file handles are not implemented on this platform.");
+    }
+    NpyFileHandle::~NpyFileHandle() {}
+    bool NpyFileHandle::unchanged() const { return false; }
+    void NpyFileHandle::read_data(std::byte* buffer, npy::internal::Size count, npy::internal::Size offset) const {
+        throw NotImplementedError("Open file handles are not implemented on this platform.");
+    }
+
+#endif
+
+
+    //----------------------------------
+    // File handle pool.
+    //----------------------------------
+
+    bool FileHandlePool::enabled() const {
+        #ifndef _WIN32
+            std::lock_guard lock(mutex_);
+            return capacity_ > 0;
+        #else
+            return false;
+        #endif
+    }
+
+    std::size_t FileHandlePool::size() const {
+        std::lock_guard lock(mutex_);
+        return entries_.size();
+    }
+
+    void FileHandlePool::evict_() {
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    void FileHandlePool::set_capacity(std::size_t capacity) {
+        std::lock_guard lock(mutex_);
+        capacity_ = capacity;
+        evict_();
+    }
+
+    std::pair<FileHandlePool::HandlePtr, bool> FileHandlePool::acquire(const std::filesystem::path& path) {
+        const auto key = path.string();
+        HandlePtr cached;
+        {
+            std::lock_guard lock(mutex_);
+            if (auto it = index_.find(key); it != index_.end()) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                cached = it->second->second;
+            }
+        }
+        // Checked without the lock, so that concurrent readers do not wait for each other's fstat.
+        if (cached) {
+            if (cached->unchanged()) {
+                return { std::move(cached), false };
+            }
+            std::lock_guard lock(mutex_);
+            if (auto it = index_.find(key); it != index_.end() && it->second->second == cached) {
+                entries_.erase(it->second);
+                index_.erase(it);
+            }
+        }
+
+        // Opened without the lock, so that other readers are not blocked. Concurrent misses of one path open it twice, keeping the last.
+        auto handle = std::make_shared<const NpyFileHandle>(path);
+        std::lock_guard lock(mutex_);
+        if (capacity_ > 0) {
+            if (auto it = index_.find(key); it != index_.end()) {
+                entries_.erase(it->second);
+            }
+            entries_.emplace_front(key, handle);
+            index_[key] = entries_.begin();
+            evict_();
+        }
+        return { std::move(handle), true };
+    }
+
+    void FileHandlePool::invalidate(const std::filesystem::path& path) {
+        const auto key = path.string();
+        std::lock_guard lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ) {
+            const auto& entry = it->first;
+            const bool is_descendant = entry.compare(0, key.size(), key) == 0
+                && (entry.size() == key.size() || entry[key.size()] == std::filesystem::path::preferred_separator);
+            if (is_descendant) {
+                index_.erase(entry);
+                it = entries_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void FileHandlePool::clear() {
+        std::lock_guard lock(mutex_);
+        index_.clear();
+        entries_.clear();
+    }
+
+} // namespace poppel::core
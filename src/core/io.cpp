@@ -0,0 +1,892 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <linux/fs.h>
+        #include <sys/ioctl.h>
+        #include <sys/sendfile.h>
+    #endif
+#endif
+
+#include "poppel/core/checksum.hpp"
+#include "poppel/core/exceptions.hpp"
+#include "poppel/core/io.hpp"
+#include "poppel/core/utilities.hpp"
+
+namespace poppel::core {
+
+    //----------------------------------
+    // Memory mapping.
+    //----------------------------------
+
+#ifndef _WIN32
+
+    MappedFile::MappedFile(const std::filesystem::path& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw Exception("Unable to open " + path.string() + " for mapping: " + std::strerror(errno));
+        }
+        ScopeGuard close_guard { [&] { ::close(fd); } };
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            throw Exception("Unable to stat " + path.string() + ": " + std::strerror(errno));
+        }
+        if (st.st_size == 0) {
+            // Empty files cannot be mapped. Keep an empty view.
+            return;
+        }
+
+        void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            throw Exception("Unable to map " + path.string() + ": " + std::strerror(errno));
+        }
+        data_ = static_cast<const std::byte*>(addr);
+        size_ = st.st_size;
+    }
+
+    MappedFile::~MappedFile() {
+        if (data_) {
+            ::munmap(const_cast<std::byte*>(data_), size_);
+        }
+    }
+
+#else
+
+    MappedFile::MappedFile(const std::filesystem::path& path) {
+        throw NotImplementedError("Memory mapping is not implemented on this platform.");
+    }
+
+    MappedFile::~MappedFile() {}
+
+#endif
+
+
+    //----------------------------------
+    // File copy.
+    //----------------------------------
+
+#ifndef _WIN32
+
+    namespace {
+        // Copy count bytes from the current offsets. Returns false if kernel copy is not supported for these files.
+        bool copy_in_kernel(int in_fd, int out_fd, std::size_t count) {
+            #ifdef __linux__
+                bool use_copy_file_range = true;
+                while (count > 0) {
+                    ssize_t n = -1;
+                    if (use_copy_file_range) {
+                        n = ::copy_file_range(in_fd, nullptr, out_fd, nullptr, count, 0);
+                        if (n < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                            use_copy_file_range = false;
+                            continue;
+                        }
+                    } else {
+                        n = ::sendfile(out_fd, in_fd, nullptr, count);
+                        if (n < 0 && (errno == ENOSYS || errno == EINVAL)) {
+                            return false;
+                        }
+                    }
+                    if (n < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        throw Exception(std::string("Unable to copy file: ") + std::strerror(errno));
+                    }
+                    if (n == 0) {
+                        break;
+                    }
+                    count -= n;
+                }
+                return true;
+            #else
+                return false;
+            #endif
+        }
+
+        void copy_buffered(int in_fd, int out_fd) {
+            std::vector<char> buffer(1 << 20);
+            while (true) {
+                const ssize_t n = ::read(in_fd, buffer.data(), buffer.size());
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw Exception(std::string("Unable to read file: ") + std::strerror(errno));
+                }
+                if (n == 0) {
+                    return;
+                }
+                for (ssize_t written = 0; written < n; ) {
+                    const ssize_t m = ::write(out_fd, buffer.data() + written, n - written);
+                    if (m < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        throw Exception(std::string("Unable to write file: ") + std::strerror(errno));
+                    }
+                    written += m;
+                }
+            }
+        }
+    } // namespace
+
+    void copy_file_contents(const std::filesystem::path& src, const std::filesystem::path& dst) {
+        const int in_fd = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in_fd < 0) {
+            throw Exception("Unable to open " + src.string() + ": " + std::strerror(errno));
+        }
+        ScopeGuard in_guard { [&] { ::close(in_fd); } };
+
+        struct stat st;
+        if (::fstat(in_fd, &st) != 0) {
+            throw Exception("Unable to stat " + src.string() + ": " + std::strerror(errno));
+        }
+
+        const int out_fd = ::open(dst.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (out_fd < 0) {
+            throw Exception("Unable to open " + dst.string() + ": " + std::strerror(errno));
+        }
+        ScopeGuard out_guard { [&] { ::close(out_fd); } };
+
+        #ifdef FICLONE
+            // Reflink, sharing all extents, on copy on write file systems such as btrfs and XFS.
+            if (::ioctl(out_fd, FICLONE, in_fd) == 0) {
+                return;
+            }
+        #endif
+        if (!copy_in_kernel(in_fd, out_fd, st.st_size)) {
+            copy_buffered(in_fd, out_fd);
+        }
+    }
+
+    void clone_file(const std::filesystem::path& src, const std::filesystem::path& dst, bool hard_link) {
+        if (hard_link) {
+            std::error_code ec;
+            std::filesystem::create_hard_link(src, dst, ec);
+            if (!ec) {
+                return;
+            }
+            // Such as across file systems. Copy instead.
+        }
+        copy_file_contents(src, dst);
+    }
+
+#else
+
+    void copy_file_contents(const std::filesystem::path& src, const std::filesystem::path& dst) {
+        std::filesystem::copy_file(src, dst, std::filesystem::copy_options::overwrite_existing);
+    }
+
+    void clone_file(const std::filesystem::path& src, const std::filesystem::path& dst, bool hard_link) {
+        if (hard_link) {
+            std::error_code ec;
+            std::filesystem::create_hard_link(src, dst, ec);
+            if (!ec) {
+                return;
+            }
+        }
+        copy_file_contents(src, dst);
+    }
+
+#endif
+
+
+    //----------------------------------
+    // Streaming npy transfer.
+    //----------------------------------
+
+#ifndef _WIN32
+
+    namespace {
+        // Alignment of offsets, lengths and buffers for O_DIRECT, which covers the logical block size of common devices.
+        constexpr std::size_t direct_alignment = 4096;
+        // Size of each transfer. Large enough to reach the device bandwidth, small enough to keep the bounce buffer cheap.
+        constexpr std::size_t stream_block_size = 8 << 20;
+        // Size of the first read without O_DIRECT, which should contain the whole npy header.
+        constexpr std::size_t header_probe_size = 64 << 10;
+
+        struct FreeDeleter {
+            void operator()(std::byte* p) const { std::free(p); }
+        };
+        using AlignedBuffer = std::unique_ptr<std::byte[], FreeDeleter>;
+
+        AlignedBuffer make_aligned_buffer(std::size_t size) {
+            void* p = nullptr;
+            if (::posix_memalign(&p, direct_alignment, size) != 0) {
+                throw std::bad_alloc();
+            }
+            return AlignedBuffer(static_cast<std::byte*>(p));
+        }
+
+        std::size_t round_up(std::size_t n) {
+            return (n + direct_alignment - 1) / direct_alignment * direct_alignment;
+        }
+
+        // Open the file, with O_DIRECT if requested and supported. Sets direct to whether O_DIRECT is in effect.
+        int open_stream_fd(const std::filesystem::path& path, int flags, bool& direct) {
+            [[maybe_unused]] const bool requested = direct;
+            #ifdef O_DIRECT
+                if (direct) {
+                    const int fd = ::open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0666);
+                    if (fd >= 0) {
+                        return fd;
+                    }
+                    if (errno != EINVAL) {
+                        throw Exception("Unable to open " + path.string() + ": " + std::strerror(errno));
+                    }
+                    // File system does not support direct I/O.
+                }
+            #endif
+            direct = false;
+            const int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0666);
+            if (fd < 0) {
+                throw Exception("Unable to open " + path.string() + ": " + std::strerror(errno));
+            }
+            #ifdef F_NOCACHE
+                // Bypass the cache without alignment requirements.
+                if (requested) {
+                    ::fcntl(fd, F_NOCACHE, 1);
+                }
+            #endif
+            return fd;
+        }
+
+        // Read up to count bytes. Returns the number of bytes read, which is less than count only at the end of file.
+        std::size_t pread_full(int fd, std::byte* buffer, std::size_t count, off_t offset) {
+            std::size_t done = 0;
+            while (done < count) {
+                const ssize_t n = ::pread(fd, buffer + done, count - done, offset + done);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw Exception(std::string("Unable to read file: ") + std::strerror(errno));
+                }
+                if (n == 0) {
+                    break;
+                }
+                done += n;
+            }
+            return done;
+        }
+
+        void pwrite_full(int fd, const std::byte* buffer, std::size_t count, off_t offset) {
+            std::size_t done = 0;
+            while (done < count) {
+                const ssize_t n = ::pwrite(fd, buffer + done, count - done, offset + done);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw Exception(std::string("Unable to write file: ") + std::strerror(errno));
+                }
+                done += n;
+            }
+        }
+
+        // Start writeback of the block just written, and drop the previous block from the page cache once it is written.
+        // Without this, dirty pages of a large write fill the page cache before the kernel writes them back.
+        void release_written(int fd, off_t prev_offset, off_t prev_length, off_t offset, off_t length) {
+            #ifdef __linux__
+                ::sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
+                if (prev_length > 0) {
+                    ::sync_file_range(fd, prev_offset, prev_length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+                }
+            #endif
+            #ifdef POSIX_FADV_DONTNEED
+                if (prev_length > 0) {
+                    ::posix_fadvise(fd, prev_offset, prev_length, POSIX_FADV_DONTNEED);
+                }
+            #endif
+        }
+    } // namespace
+
+    void save_npy(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, IoBackend backend, std::uint32_t* checksum) {
+        const std::size_t numbytes = header.numbytes();
+        if (checksum) {
+            *checksum = 0;
+        }
+        if (backend == IoBackend::Stream) {
+            if (!checksum) {
+                npy::save(path, header, data);
+                return;
+            }
+            // Each block is hashed right before it is written, while it is still in cache.
+            auto ofs = npy::internal::open_file_for_save(path);
+            const npy::Version version { 3, 0 };
+            npy::internal::write_header(ofs, version, npy::internal::gen_header(version, header).view());
+            for (std::size_t done = 0; done < numbytes; ) {
+                const std::size_t count = std::min(stream_block_size, numbytes - done);
+                *checksum = crc32c(*checksum, data + done, count);
+                ofs.write(reinterpret_cast<const char*>(data + done), count);
+                done += count;
+            }
+            if (!ofs) {
+                throw std::runtime_error("io error: failed writing file");
+            }
+            return;
+        }
+
+        const npy::Version version { 3, 0 };
+        const auto text = npy::internal::gen_header(version, header);
+        const std::size_t header_size = npy::internal::preamble_length(version) + text.length();
+
+        bool direct = (backend == IoBackend::Direct);
+        const int fd = open_stream_fd(path, O_WRONLY | O_CREAT | O_TRUNC, direct);
+        ScopeGuard close_guard { [&] { ::close(fd); } };
+
+        if (!direct) {
+            // Header and data are written separately, without copying the data.
+            std::vector<std::byte> head(header_size);
+            npy::internal::write_header(head.data(), version, text.view());
+            pwrite_full(fd, head.data(), head.size(), 0);
+
+            off_t prev_offset = 0, prev_length = 0;
+            for (std::size_t done = 0; done < numbytes; ) {
+                const std::size_t count = std::min(stream_block_size, numbytes - done);
+                const off_t offset = header_size + done;
+                if (checksum) {
+                    *checksum = crc32c(*checksum, data + done, count);
+                }
+                pwrite_full(fd, data + done, count, offset);
+                release_written(fd, prev_offset, prev_length, offset, count);
+                prev_offset = offset;
+                prev_length = count;
+                done += count;
+            }
+            release_written(fd, prev_offset, prev_length, 0, 0);
+            return;
+        }
+
+        // Data is copied through an aligned buffer, since the header shifts it from aligned file offsets.
+        // The last block is padded to the alignment, and the padding is truncated afterwards.
+        const auto buffer = make_aligned_buffer(stream_block_size);
+        npy::internal::write_header(buffer.get(), version, text.view());
+        std::size_t filled = header_size;
+        off_t offset = 0;
+        for (std::size_t done = 0; done < numbytes || filled > 0; ) {
+            const std::size_t count = std::min(stream_block_size - filled, numbytes - done);
+            std::memcpy(buffer.get() + filled, data + done, count);
+            if (checksum) {
+                *checksum = crc32c(*checksum, buffer.get() + filled, count);
+            }
+            filled += count;
+            done += count;
+            if (filled < stream_block_size && done < numbytes) {
+                continue;
+            }
+            const std::size_t length = round_up(filled);
+            std::memset(buffer.get() + filled, 0, length - filled);
+            pwrite_full(fd, buffer.get(), length, offset);
+            offset += filled;
+            filled = 0;
+        }
+        if (::ftruncate(fd, header_size + numbytes) != 0) {
+            throw Exception("Unable to truncate " + path.string() + ": " + std::strerror(errno));
+        }
+    }
+
+    void load_npy(const std::filesystem::path& path, const npy::Header& header, std::byte* data, bool allow_reshape, IoBackend backend) {
+        if (backend == IoBackend::Stream) {
+            npy::load(path, header, data, allow_reshape);
+            return;
+        }
+
+        bool direct = (backend == IoBackend::Direct);
+        const int fd = open_stream_fd(path, O_RDONLY, direct);
+        ScopeGuard close_guard { [&] { ::close(fd); } };
+        #ifdef POSIX_FADV_SEQUENTIAL
+            ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        #endif
+
+        // The first block contains the header, followed by the beginning of the data.
+        const std::size_t block_size = direct ? stream_block_size : header_probe_size;
+        const auto buffer = make_aligned_buffer(block_size);
+        const std::size_t first = pread_full(fd, buffer.get(), block_size, 0);
+        const auto [loaded_header, data_offset] = npy::load_header(buffer.get(), first);
+        const bool header_match = allow_reshape
+            ? npy::reshape_equal(loaded_header, header)
+            : (loaded_header == header);
+        if (!header_match) {
+            throw std::runtime_error("header information mismatch");
+        }
+
+        const std::size_t numbytes = header.numbytes();
+        std::size_t done = std::min<std::size_t>(first - data_offset, numbytes);
+        std::memcpy(data, buffer.get() + data_offset, done);
+        bool eof = (first < block_size);
+
+        off_t offset = first;
+        while (done < numbytes && !eof) {
+            if (direct) {
+                // Aligned reads into the buffer.
+                const std::size_t n = pread_full(fd, buffer.get(), block_size, offset);
+                const std::size_t count = std::min(n, numbytes - done);
+                std::memcpy(data + done, buffer.get(), count);
+                done += count;
+                offset += n;
+                eof = (n < block_size);
+            } else {
+                // Reads directly into the destination, dropping pages behind.
+                const std::size_t count = std::min(stream_block_size, numbytes - done);
+                const std::size_t n = pread_full(fd, data + done, count, data_offset + done);
+                #ifdef POSIX_FADV_DONTNEED
+                    ::posix_fadvise(fd, data_offset + done, n, POSIX_FADV_DONTNEED);
+                #endif
+                done += n;
+                eof = (n < count);
+            }
+        }
+        if (done < numbytes) {
+            throw Exception("npy file is truncated: " + path.string());
+        }
+    }
+
+#else
+
+    void save_npy(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, IoBackend backend, std::uint32_t* checksum) {
+        if (checksum) {
+            *checksum = crc32c(data, header.numbytes());
+        }
+        npy::save(path, header, data);
+    }
+
+    void load_npy(const std::filesystem::path& path, const npy::Header& header, std::byte* data, bool allow_reshape, IoBackend backend) {
+        npy::load(path, header, data, allow_reshape);
+    }
+
+#endif
+
+
+#ifndef _WIN32
+
+    namespace {
+        // Call transfer(offset, count) for the stripes of the file range [begin, end) concurrently on the pool.
+        // All tasks are finished before returning, so that buffers stay valid even if some of them fail.
+        void transfer_stripes(std::size_t begin, std::size_t end, std::size_t stripe_size, ThreadPool& pool, const std::function<void(std::size_t, std::size_t)>& transfer) {
+            const std::size_t first = begin / stripe_size;
+            const std::size_t last = (end + stripe_size - 1) / stripe_size;
+            const std::size_t num_tasks = std::min(pool.size(), last - first);
+
+            std::vector<std::function<void()>> tasks;
+            tasks.reserve(num_tasks);
+            for (std::size_t t = 0; t < num_tasks; ++t) {
+                tasks.push_back([&, t] {
+                    for (std::size_t s = first + t; s < last; s += num_tasks) {
+                        const std::size_t lo = std::max(begin, s * stripe_size);
+                        const std::size_t hi = std::min(end, (s + 1) * stripe_size);
+                        transfer(lo, hi - lo);
+                    }
+                });
+            }
+            run_tasks(tasks, &pool);
+        }
+    } // namespace
+
+    void save_npy_parallel(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, ThreadPool& pool, std::size_t stripe_size, std::uint32_t* checksum) {
+        const npy::Version version { 3, 0 };
+        const auto text = npy::internal::gen_header(version, header);
+        const std::size_t header_size = npy::internal::preamble_length(version) + text.length();
+        const std::size_t numbytes = header.numbytes();
+
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            throw Exception("Unable to open " + path.string() + ": " + std::strerror(errno));
+        }
+        ScopeGuard close_guard { [&] { ::close(fd); } };
+
+        std::vector<std::byte> head(header_size);
+        npy::internal::write_header(head.data(), version, text.view());
+        pwrite_full(fd, head.data(), head.size(), 0);
+        // Extend the file first, so that stripes can be written in any order.
+        if (::ftruncate(fd, header_size + numbytes) != 0) {
+            throw Exception("Unable to extend " + path.string() + ": " + std::strerror(errno));
+        }
+        // Stripes are hashed by the threads writing them, and the checksums are combined in file order afterwards.
+        const std::size_t first = header_size / stripe_size;
+        std::vector<std::uint32_t> stripe_checksums(checksum ? (header_size + numbytes + stripe_size - 1) / stripe_size - first : 0);
+        transfer_stripes(header_size, header_size + numbytes, stripe_size, pool, [&](std::size_t offset, std::size_t count) {
+            if (checksum) {
+                stripe_checksums[offset / stripe_size - first] = crc32c(data + (offset - header_size), count);
+            }
+            pwrite_full(fd, data + (offset - header_size), count, offset);
+        });
+        if (checksum) {
+            *checksum = 0;
+            for (std::size_t s = 0; s < stripe_checksums.size(); ++s) {
+                const std::size_t lo = std::max(header_size, (first + s) * stripe_size);
+                const std::size_t hi = std::min(header_size + numbytes, (first + s + 1) * stripe_size);
+                *checksum = crc32c_combine(*checksum, stripe_checksums[s], hi - lo);
+            }
+        }
+    }
+
+    void load_npy_parallel(const std::filesystem::path& path, const npy::Header& header, std::byte* data, bool allow_reshape, ThreadPool& pool, std::size_t stripe_size) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw Exception("Unable to open " + path.string() + ": " + std::strerror(errno));
+        }
+        ScopeGuard close_guard { [&] { ::close(fd); } };
+
+        std::vector<std::byte> head(header_probe_size);
+        const std::size_t first = pread_full(fd, head.data(), head.size(), 0);
+        const auto [loaded_header, data_offset] = npy::load_header(head.data(), first);
+        const bool header_match = allow_reshape
+            ? npy::reshape_equal(loaded_header, header)
+            : (loaded_header == header);
+        if (!header_match) {
+            throw std::runtime_error("header information mismatch");
+        }
+
+        const std::size_t numbytes = header.numbytes();
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            throw Exception("Unable to stat " + path.string() + ": " + std::strerror(errno));
+        }
+        if (static_cast<std::size_t>(st.st_size) < data_offset + numbytes) {
+            throw Exception("npy file is truncated: " + path.string());
+        }
+        transfer_stripes(data_offset, data_offset + numbytes, stripe_size, pool, [&](std::size_t offset, std::size_t count) {
+            if (pread_full(fd, data + (offset - data_offset), count, offset) < count) {
+                throw Exception("npy file is truncated: " + path.string());
+            }
+        });
+    }
+
+#else
+
+    void save_npy_parallel(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, ThreadPool& pool, std::size_t stripe_size, std::uint32_t* checksum) {
+        save_npy(path, header, data, IoBackend::Stream, checksum);
+    }
+
+    void load_npy_parallel(const std::filesystem::path& path, const npy::Header& header, std::byte* data, bool allow_reshape, ThreadPool& pool, std::size_t stripe_size) {
+        npy::load(path, header, data, allow_reshape);
+    }
+
+#endif
+
+
+    //----------------------------------
+    // Strided npy save.
+    //----------------------------------
+
+    namespace {
+        // Runs shorter than this are gathered into the staging buffer, instead of being written each from its own place.
+        constexpr std::size_t min_direct_run = 4 << 10;
+        constexpr std::size_t staging_size = 1 << 20;
+        // Maximum number of buffers per writev call, which is at least 1024 on Posix systems.
+        constexpr std::size_t max_write_buffers = 1024;
+
+        // Strided buffer in the order of the file, as rows of runs of contiguous bytes of the same size.
+        struct RunLayout {
+            std::size_t                 run_bytes = 0;
+            Size                        row_length = 1;
+            std::ptrdiff_t              row_stride = 0;
+            // Axes of rows, slowest first, with strides in bytes.
+            std::vector<Size>           outer_shape;
+            std::vector<std::ptrdiff_t> outer_strides;
+        };
+
+        RunLayout run_layout(const npy::Header& header, const std::vector<std::ptrdiff_t>& strides) {
+            const auto rank = header.shape.size();
+            if (strides.size() != rank) {
+                throw Exception("Number of strides does not match the rank of the array.");
+            }
+            const auto itemsize = static_cast<std::ptrdiff_t>(header.dtype.itemsize);
+            std::vector<Size> shape(header.shape.begin(), header.shape.end());
+            std::vector<std::ptrdiff_t> byte_strides;
+            byte_strides.reserve(rank);
+            for (auto stride : strides) {
+                byte_strides.push_back(stride * itemsize);
+            }
+            if (header.fortran_order) {
+                std::reverse(shape.begin(), shape.end());
+                std::reverse(byte_strides.begin(), byte_strides.end());
+            }
+
+            // Merge the fastest axes while they are contiguous.
+            RunLayout ret;
+            ret.run_bytes = header.dtype.itemsize;
+            auto k = rank;
+            while (k > 0 && (shape[k - 1] == 1 || byte_strides[k - 1] == static_cast<std::ptrdiff_t>(ret.run_bytes))) {
+                ret.run_bytes *= shape[k - 1];
+                --k;
+            }
+            if (k > 0) {
+                ret.row_length = shape[k - 1];
+                ret.row_stride = byte_strides[k - 1];
+                --k;
+            }
+            ret.outer_shape.assign(shape.begin(), shape.begin() + k);
+            ret.outer_strides.assign(byte_strides.begin(), byte_strides.begin() + k);
+            return ret;
+        }
+
+        // Call func with the first byte of each row, in the order of the file.
+        template< typename Func >
+        void for_each_row(const RunLayout& layout, const std::byte* data, Func&& func) {
+            const auto rank = layout.outer_shape.size();
+            std::vector<Size> index(rank, 0);
+            const std::byte* row = data;
+            while (true) {
+                func(row);
+                auto k = rank;
+                for (; k > 0; --k) {
+                    row += layout.outer_strides[k - 1];
+                    if (++index[k - 1] < layout.outer_shape[k - 1]) {
+                        break;
+                    }
+                    row -= layout.outer_strides[k - 1] * static_cast<std::ptrdiff_t>(index[k - 1]);
+                    index[k - 1] = 0;
+                }
+                if (k == 0) {
+                    return;
+                }
+            }
+        }
+
+        // Gather count runs of run_bytes bytes, stride bytes apart, into dst.
+        void gather_runs(std::byte* dst, const std::byte* src, Size count, std::ptrdiff_t stride, std::size_t run_bytes) {
+            with_fixed_size(run_bytes, [&](auto n) {
+                for (Size i = 0; i < count; ++i) {
+                    std::memcpy(dst + i * static_cast<std::size_t>(n), src + static_cast<std::ptrdiff_t>(i) * stride, n);
+                }
+            });
+        }
+
+        // Pass the array in the order of the file to write(buffer, count), as direct runs or as gathered pieces of the staging buffer.
+        // The staging buffer is reused after each call of write().
+        template< typename Write >
+        void write_strided(const RunLayout& layout, const std::byte* data, Write&& write) {
+            if (layout.run_bytes >= min_direct_run) {
+                for_each_row(layout, data, [&](const std::byte* row) {
+                    for (Size i = 0; i < layout.row_length; ++i) {
+                        write(row + static_cast<std::ptrdiff_t>(i) * layout.row_stride, layout.run_bytes);
+                    }
+                });
+                return;
+            }
+
+            // Kept across saves, so that small strided saves do not allocate.
+            thread_local npy::internal::MaxAlignCharVector staging;
+            staging.resize(std::max(staging.size(), staging_size));
+            const Size runs_per_buffer = staging.size() / layout.run_bytes;
+            std::size_t used = 0;
+            for_each_row(layout, data, [&](const std::byte* row) {
+                for (Size i = 0; i < layout.row_length; ) {
+                    if (used + layout.run_bytes > staging.size()) {
+                        write(staging.data(), used);
+                        used = 0;
+                    }
+                    const Size n = std::min(layout.row_length - i, runs_per_buffer - static_cast<Size>(used / layout.run_bytes));
+                    gather_runs(staging.data() + used, row + static_cast<std::ptrdiff_t>(i) * layout.row_stride, n, layout.row_stride, layout.run_bytes);
+                    used += n * layout.run_bytes;
+                    i += n;
+                }
+            });
+            if (used > 0) {
+                write(staging.data(), used);
+            }
+        }
+    } // namespace
+
+#ifndef _WIN32
+
+    namespace {
+        // Write all buffers of iovs in order, continuing after partial writes.
+        void writev_full(int fd, std::vector<iovec>& iovs) {
+            std::size_t first = 0;
+            while (first < iovs.size()) {
+                const auto n = ::writev(fd, iovs.data() + first, static_cast<int>(iovs.size() - first));
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw Exception(std::string("Unable to write file: ") + std::strerror(errno));
+                }
+                auto done = static_cast<std::size_t>(n);
+                while (first < iovs.size() && done >= iovs[first].iov_len) {
+                    done -= iovs[first].iov_len;
+                    ++first;
+                }
+                if (first < iovs.size()) {
+                    iovs[first].iov_base = static_cast<std::byte*>(iovs[first].iov_base) + done;
+                    iovs[first].iov_len -= done;
+                }
+            }
+            iovs.clear();
+        }
+    } // namespace
+
+    void save_npy_strided(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, const std::vector<std::ptrdiff_t>& strides, std::uint32_t* checksum) {
+        const auto layout = run_layout(header, strides);
+        if (checksum) {
+            *checksum = 0;
+        }
+        const npy::Version version { 3, 0 };
+        const auto text = npy::internal::gen_header(version, header);
+        std::vector<std::byte> head(npy::internal::preamble_length(version) + text.length());
+        npy::internal::write_header(head.data(), version, text.view());
+
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+        if (fd < 0) {
+            throw Exception("Unable to open " + path.string() + ": " + std::strerror(errno));
+        }
+        ScopeGuard close_guard { [&] { ::close(fd); } };
+
+        // Direct runs are batched into writev calls. The staging buffer is written before it is reused.
+        std::vector<iovec> iovs;
+        iovs.reserve(max_write_buffers);
+        iovs.push_back({ head.data(), head.size() });
+        if (header.numbytes() > 0) {
+            write_strided(layout, data, [&](const std::byte* buffer, std::size_t count) {
+                if (checksum) {
+                    *checksum = crc32c(*checksum, buffer, count);
+                }
+                iovs.push_back({ const_cast<std::byte*>(buffer), count });
+                if (iovs.size() == max_write_buffers || layout.run_bytes < min_direct_run) {
+                    writev_full(fd, iovs);
+                }
+            });
+        }
+        writev_full(fd, iovs);
+    }
+
+#else
+
+    void save_npy_strided(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, const std::vector<std::ptrdiff_t>& strides, std::uint32_t* checksum) {
+        const auto layout = run_layout(header, strides);
+        if (checksum) {
+            *checksum = 0;
+        }
+        auto ofs = npy::internal::open_file_for_save(path);
+        const npy::Version version { 3, 0 };
+        npy::internal::write_header(ofs, version, npy::internal::gen_header(version, header).view());
+        if (header.numbytes() > 0) {
+            write_strided(layout, data, [&](const std::byte* buffer, std::size_t count) {
+                if (checksum) {
+                    *checksum = crc32c(*checksum, buffer, count);
+                }
+                ofs.write(reinterpret_cast<const char*>(buffer), count);
+            });
+        }
+        if (!ofs) {
+            throw std::runtime_error("io error: failed writing file");
+        }
+    }
+
+#endif
+
+
+    //----------------------------------
+    // File status.
+    //----------------------------------
+
+#ifndef _WIN32
+
+    std::optional<FileStamp> file_stamp(const std::filesystem::path& path) {
+        struct stat st;
+        if (::stat(path.c_str(), &st) != 0) {
+            if (errno == ENOENT || errno == ENOTDIR) {
+                return std::nullopt;
+            }
+            throw Exception("Unable to stat " + path.string() + ": " + std::strerror(errno));
+        }
+        #ifdef __APPLE__
+            const auto& mtime = st.st_mtimespec;
+        #else
+            const auto& mtime = st.st_mtim;
+        #endif
+        return FileStamp {
+            static_cast<std::int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec,
+            static_cast<std::uint64_t>(st.st_size),
+        };
+    }
+
+#else
+
+    std::optional<FileStamp> file_stamp(const std::filesystem::path& path) {
+        std::error_code ec;
+        const auto size = std::filesystem::file_size(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        const auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec) {
+            return std::nullopt;
+        }
+        return FileStamp {
+            std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count(),
+            static_cast<std::uint64_t>(size),
+        };
+    }
+
+#endif
+
+
+    //----------------------------------
+    // File synchronization.
+    //----------------------------------
+
+#ifndef _WIN32
+
+    namespace {
+        void sync_path(const std::filesystem::path& path, int flags, bool data_only) {
+            const int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+            if (fd < 0) {
+                throw Exception("Unable to open " + path.string() + " for synchronization: " + std::strerror(errno));
+            }
+            ScopeGuard close_guard { [&] { ::close(fd); } };
+
+            int res;
+            do {
+                #ifdef __APPLE__
+                    // No fdatasync. Flush data and metadata.
+                    (void)data_only;
+                    res = ::fsync(fd);
+                #else
+                    res = data_only ? ::fdatasync(fd) : ::fsync(fd);
+                #endif
+            } while (res != 0 && errno == EINTR);
+            if (res != 0) {
+                throw Exception("Unable to synchronize " + path.string() + ": " + std::strerror(errno));
+            }
+        }
+    } // namespace
+
+    void sync_file(const std::filesystem::path& path) {
+        sync_path(path, O_RDONLY, true);
+    }
+
+    void sync_directory(const std::filesystem::path& path) {
+        sync_path(path, O_RDONLY | O_DIRECTORY, false);
+    }
+
+#else
+
+    void sync_file(const std::filesystem::path& path) {
+        throw NotImplementedError("File synchronization is not implemented on this platform.");
+    }
+
+    void sync_directory(const std::filesystem::path& path) {
+        // Directory entries are journaled with the file system metadata.
+    }
+
+#endif
+
+} // namespace poppel::core
@@ -1,18 +1,28 @@
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <complex>
 #include <cstdint>
+#include <exception>
 #include <fstream>
 #include <iterator>
 #include <iostream>
+#include <map>
+#include <optional>
+#include <random>
 #include <string_view>
+#include <unordered_set>
 #include <utility>
 
 #include <nlohmann/json.hpp>
 
+#include "poppel/core/checksum.hpp"
+#include "poppel/core/chunked.hpp"
 #include "poppel/core/npy.hpp"
 #include "poppel/core/exceptions.hpp"
 #include "poppel/core/operations.hpp"
+#include "poppel/core/transpose.hpp"
 
 namespace poppel::core {
 
@@ -36,6 +46,22 @@ namespace poppel::core {
     }
 
 
+    ThreadPool& get_io_pool(const FileStates& filestates) {
+        // I/O threads mostly wait for the file system, so the default is not limited to the number of cores.
+        constexpr std::size_t min_default_io_threads = 4;
+        constexpr std::size_t max_default_io_threads = 16;
+
+        std::lock_guard lock(filestates.mutex);
+        if (!filestates.io_pool) {
+            const auto num_threads = filestates.io_threads > 0
+                ? filestates.io_threads
+                : std::clamp<std::size_t>(std::thread::hardware_concurrency(), min_default_io_threads, max_default_io_threads);
+            filestates.io_pool = std::make_shared<ThreadPool>(num_threads);
+        }
+        return *filestates.io_pool;
+    }
+
+
     // Validate node relative (normalized) path.
     //
     // Precondition:
@@ -100,34 +126,252 @@ namespace poppel::core {
         }
     }
 
+    std::filesystem::path temp_file_path(const std::filesystem::path& path) {
+        // Unique temporary name, so that concurrent writers do not share the temporary file.
+        static std::atomic<std::uint64_t> counter { std::random_device{}() };
+        return path.parent_path() / ("." + path.filename().string() + ".tmp" + std::to_string(counter++));
+    }
+    bool is_temp_file_path(const std::filesystem::path& path) {
+        const auto name = path.filename().string();
+        const auto pos = name.rfind(".tmp");
+        return name.size() > 1 && name.front() == '.' && pos != std::string::npos && pos > 1 && pos + 4 < name.size()
+            && std::all_of(name.begin() + pos + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; });
+    }
+
+    void write_file_atomic(const std::filesystem::path& path, std::string_view content) {
+        const auto temppath = temp_file_path(path);
+        {
+            std::ofstream ofs(temppath, std::ios::binary);
+            ofs.write(content.data(), content.size());
+            ofs.close();
+            if (!ofs) {
+                std::error_code ec;
+                std::filesystem::remove(temppath, ec);
+                throw Exception("Failed to write file: " + path.string());
+            }
+        }
+        std::error_code ec;
+        std::filesystem::rename(temppath, path, ec);
+        if (ec) {
+            std::filesystem::remove(temppath, ec);
+            throw Exception("Failed to replace file: " + path.string());
+        }
+    }
+
+    void write_file(const std::filesystem::path& path, const FileStates& filestates, const std::function<void(const std::filesystem::path&)>& write) {
+        // Open handles would see the old file. Indexed headers are checked by stamp, but the stamp may not change within the clock resolution.
+        ScopeGuard handle_guard { [&] {
+            filestates.handle_pool.invalidate(path);
+            if (filestates.header_index.enabled) {
+                std::lock_guard lock(filestates.mutex);
+                filestates.header_index.entries.erase(path.string());
+            }
+        } };
+        if (!filestates.atomic_writes && !filestates.durable_writes) {
+            std::error_code ec;
+            if (std::filesystem::hard_link_count(path, ec) > 1) {
+                std::filesystem::remove(path);
+            }
+            write(path);
+            return;
+        }
+
+        const auto temppath = temp_file_path(path);
+        bool renamed = false;
+        ScopeGuard temp_guard { [&] {
+            if (!renamed) {
+                std::error_code ec;
+                std::filesystem::remove(temppath, ec);
+            }
+        } };
+        write(temppath);
+        if (filestates.durable_writes) {
+            sync_file(temppath);
+        }
+        std::filesystem::rename(temppath, path);
+        renamed = true;
+
+        if (filestates.durable_writes) {
+            std::lock_guard lock(filestates.mutex);
+            filestates.uncommitted_dirs.insert(path.parent_path().string());
+        }
+    }
+
+    void unshare_file(const std::filesystem::path& path, const FileStates& filestates) {
+        std::error_code ec;
+        if (std::filesystem::hard_link_count(path, ec) <= 1 || ec) {
+            return;
+        }
+        const auto temppath = temp_file_path(path);
+        bool renamed = false;
+        ScopeGuard temp_guard { [&] {
+            if (!renamed) {
+                std::filesystem::remove(temppath, ec);
+            }
+        } };
+        copy_file_contents(path, temppath);
+        if (filestates.durable_writes) {
+            sync_file(temppath);
+        }
+        std::filesystem::rename(temppath, path);
+        renamed = true;
+        filestates.handle_pool.invalidate(path);
+
+        if (filestates.durable_writes) {
+            std::lock_guard lock(filestates.mutex);
+            filestates.uncommitted_dirs.insert(path.parent_path().string());
+        }
+    }
+
+    void commit_writes(const FileStates& filestates) {
+        std::unordered_set<std::string> dirs;
+        {
+            std::lock_guard lock(filestates.mutex);
+            dirs.swap(filestates.uncommitted_dirs);
+        }
+        for (auto it = dirs.begin(); it != dirs.end(); it = dirs.erase(it)) {
+            std::error_code ec;
+            if (!std::filesystem::is_directory(*it, ec)) {
+                // Deleted since written. Nothing left to commit.
+                continue;
+            }
+            try {
+                sync_directory(*it);
+            } catch (...) {
+                // Keep the remaining directories for the next commit.
+                std::lock_guard lock(filestates.mutex);
+                filestates.uncommitted_dirs.insert(dirs.begin(), dirs.end());
+                throw;
+            }
+        }
+    }
+
 
     //----------------------------------
     // Node operations.
     //----------------------------------
 
-    NodeMeta read_node_meta(const std::filesystem::path& nodepath) {
+    Json read_node_json(const std::filesystem::path& nodepath) {
         std::ifstream file(nodepath / "poppel.json");
         if (!file.is_open()) {
             throw Exception("Unable to open poppel.json file.");
         }
         nlohmann::json json;
         file >> json;
-        return {
-            json["version"],
-            node_type(json["type"]),
-        };
+        return json;
     }
-    void write_node_meta(const std::filesystem::path& nodepath, const NodeMeta& meta) {
+    void write_node_json(const std::filesystem::path& nodepath, const Json& json) {
         std::ofstream file(nodepath / "poppel.json");
         if (!file.is_open()) {
             throw Exception("Unable to open poppel.json file.");
         }
-        nlohmann::json json;
-        json["version"] = meta.version;
-        json["type"] = text(meta.type);
         file << json;
     }
 
+    namespace {
+        NodeMeta node_meta_from_json(const Json& json) {
+            const auto layout = json.contains("layout")
+                ? dataset_layout(json["layout"]["type"].get<std::string>())
+                : DatasetLayout::Contiguous;
+            return {
+                json["version"],
+                node_type(json["type"].get<std::string>()),
+                layout,
+                json.contains("checksum"),
+            };
+        }
+    } // namespace
+
+    NodeMeta read_node_meta(const std::filesystem::path& nodepath) {
+        return node_meta_from_json(read_node_json(nodepath));
+    }
+    namespace {
+        Json node_meta_to_json(const NodeMeta& meta) {
+            nlohmann::json json;
+            json["version"] = meta.version;
+            json["type"] = text(meta.type);
+            return json;
+        }
+    } // namespace
+
+    void write_node_meta(const std::filesystem::path& nodepath, const NodeMeta& meta) {
+        write_node_json(nodepath, node_meta_to_json(meta));
+    }
+
+    NodeMeta read_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates) {
+        if (auto meta = find_node_meta(nodepath, filestates)) {
+            return *meta;
+        }
+        throw Exception("Unable to open poppel.json file.");
+    }
+    void write_node_meta(const std::filesystem::path& nodepath, const NodeMeta& meta, const FileStates& filestates) {
+        write_node_meta(nodepath, meta);
+        cache_node_meta(nodepath, meta, filestates);
+    }
+    void cache_node_meta(const std::filesystem::path& nodepath, const NodeMeta& meta, const FileStates& filestates) {
+        if (filestates.meta_cache.enabled) {
+            std::lock_guard lock(filestates.mutex);
+            filestates.meta_cache.entries[nodepath.string()] = meta;
+        }
+    }
+    std::optional<NodeMeta> find_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates) {
+        auto& cache = filestates.meta_cache;
+        const auto& inst = filestates.instrumentation;
+        if (!cache.enabled) {
+            count(inst, &IoStats::stat_calls);
+            if (!std::filesystem::is_directory(nodepath)) {
+                return std::nullopt;
+            }
+            count(inst, &IoStats::files_opened);
+            count(inst, &IoStats::meta_parses);
+            return read_node_meta(nodepath);
+        }
+
+        const auto key = nodepath.string();
+        {
+            std::lock_guard lock(filestates.mutex);
+            if (auto it = cache.entries.find(key); it != cache.entries.end()) {
+                if (it->second.type == NodeType::Unknown) {
+                    return std::nullopt;
+                }
+                return it->second;
+            }
+            if (cache.complete) {
+                return std::nullopt;
+            }
+        }
+
+        // Directories that are not nodes throw and are not cached.
+        NodeMeta meta;
+        count(inst, &IoStats::stat_calls);
+        if (std::filesystem::is_directory(nodepath)) {
+            count(inst, &IoStats::files_opened);
+            count(inst, &IoStats::meta_parses);
+            meta = read_node_meta(nodepath);
+        }
+        std::lock_guard lock(filestates.mutex);
+        cache.entries[key] = meta;
+        if (meta.type == NodeType::Unknown) {
+            return std::nullopt;
+        }
+        return meta;
+    }
+    void uncache_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates) {
+        auto& cache = filestates.meta_cache;
+        if (!cache.enabled) {
+            return;
+        }
+
+        const auto key = nodepath.string();
+        std::lock_guard lock(filestates.mutex);
+        for (auto it = cache.entries.begin(); it != cache.entries.end(); ) {
+            const auto& entry = it->first;
+            const bool is_descendant = entry.compare(0, key.size(), key) == 0
+                && (entry.size() == key.size() || entry[key.size()] == std::filesystem::path::preferred_separator);
+            it = is_descendant ? cache.entries.erase(it) : std::next(it);
+        }
+    }
+
     Node get_file_node(const std::filesystem::path& name) {
         assert_exists_directory(name);
 
@@ -168,12 +412,9 @@ namespace poppel::core {
         assert_is_valid_node_normalized_relpath(normalized_name);
 
         auto dirpath = node.path() / normalized_name;
-        if(!std::filesystem::is_directory(dirpath)) {
-            return false;
-        }
-
-        auto meta = read_node_meta(dirpath);
-        if(meta.type != nodetype) {
+        OperationTimer timer(filestates.instrumentation, Operation::NodeLookup, dirpath);
+        auto meta = find_node_meta(dirpath, filestates);
+        if(!meta || meta->type != nodetype) {
             return false;
         }
         return true;
@@ -185,14 +426,16 @@ namespace poppel::core {
         assert_is_valid_node_normalized_relpath(normalized_name);
 
         auto dirpath = node.path() / normalized_name;
-        assert_exists_directory(dirpath);
-
-        auto meta = read_node_meta(dirpath);
-        if(meta.type != nodetype) {
+        OperationTimer timer(filestates.instrumentation, Operation::NodeLookup, dirpath);
+        auto meta = find_node_meta(dirpath, filestates);
+        if(!meta) {
+            throw Exception("Path is not a directory.");
+        }
+        if(meta->type != nodetype) {
             throw Exception("Node is not of expected type.");
         }
 
-        return Node { meta, node.root, node.relpath / normalized_name, };
+        return Node { *meta, node.root, node.relpath / normalized_name, };
     }
     // Will not create nodes for intermediate directories.
     Node create_node_immediate(const Node& node, const std::filesystem::path& name, const FileStates& filestates, NodeType nodetype) {
@@ -207,7 +450,7 @@ namespace poppel::core {
         std::filesystem::create_directory(dirpath);
         NodeMeta meta;
         meta.type = nodetype;
-        write_node_meta(dirpath, meta);
+        write_node_meta(dirpath, meta, filestates);
 
         return Node{ meta, node.root, node.relpath / normalized_name, };
     }
@@ -224,8 +467,12 @@ namespace poppel::core {
             const NodeType required_node_type = std::next(it) == normalized_name.end() ? nodetype : NodeType::Group;
             const auto& part = *it;
 
-            if(std::filesystem::is_directory(cur_node.path() / part)) {
-                cur_node = get_node(cur_node, part, filestates, required_node_type);
+            auto meta = find_node_meta(cur_node.path() / part, filestates);
+            if(meta) {
+                if(meta->type != required_node_type) {
+                    throw Exception("Node is not of expected type.");
+                }
+                cur_node = Node { *meta, cur_node.root, cur_node.relpath / part, };
             } else {
                 cur_node = create_node_immediate(cur_node, part, filestates, required_node_type);
             }
@@ -245,6 +492,136 @@ namespace poppel::core {
         }
         return create_node_immediate(cur_node, normalized_name.filename(), filestates, nodetype);
     }
+    namespace {
+        // Content of poppel.json of a new node of the type, serialized once.
+        const std::string& new_node_json_content(NodeType nodetype) {
+            static const auto contents = [] {
+                std::array<std::string, 5> ret;
+                for (auto type : { NodeType::Group, NodeType::Dataset, NodeType::Raw }) {
+                    NodeMeta meta;
+                    meta.type = type;
+                    ret[static_cast<std::size_t>(type)] = node_meta_to_json(meta).dump();
+                }
+                return ret;
+            }();
+            return contents.at(static_cast<std::size_t>(nodetype));
+        }
+
+        void create_node_directory(const std::filesystem::path& dirpath, NodeType nodetype) {
+            std::filesystem::create_directory(dirpath);
+            const auto& content = new_node_json_content(nodetype);
+            std::ofstream file(dirpath / "poppel.json", std::ios::binary);
+            file.write(content.data(), content.size());
+            file.close();
+            if (!file) {
+                throw Exception("Unable to write poppel.json file.");
+            }
+        }
+    } // namespace
+
+    std::vector<Node> create_nodes(const Node& node, const std::vector<std::pair<std::filesystem::path, NodeType>>& names, const FileStates& filestates, bool concurrent) {
+        assert_file_writable(filestates);
+        assert_is_node_group(node);
+
+        // Every named node with its intermediate groups, each once. Parents are ordered before their children.
+        struct Entry {
+            NodeType    type;
+            // Named nodes must not exist. Intermediate groups may exist.
+            bool        named = false;
+            bool        exists = false;
+            // Number of new ancestors.
+            std::size_t depth = 0;
+        };
+        std::map<std::filesystem::path, Entry> entries;
+        std::vector<std::filesystem::path> normalized_names;
+        normalized_names.reserve(names.size());
+        for (const auto& [name, nodetype] : names) {
+            auto normalized_name = name.lexically_normal();
+            assert_is_valid_node_normalized_relpath(normalized_name);
+
+            std::filesystem::path relpath;
+            for (auto it = normalized_name.begin(); it != normalized_name.end(); ++it) {
+                relpath /= *it;
+                const bool named = std::next(it) == normalized_name.end();
+                const auto type = named ? nodetype : NodeType::Group;
+                auto [entry, inserted] = entries.try_emplace(relpath, Entry { type });
+                if (entry->second.type != type || (named && entry->second.named)) {
+                    throw Exception("Conflicting node " + relpath.string() + " in batch.");
+                }
+                entry->second.named = entry->second.named || named;
+            }
+            normalized_names.push_back(std::move(normalized_name));
+        }
+
+        // Check all nodes before creating any. Descendants of new nodes need no lookup.
+        // New nodes are split in levels by depth, so that parents are created before their children.
+        std::vector<std::vector<std::pair<std::filesystem::path, NodeType>>> levels;
+        for (auto& [relpath, entry] : entries) {
+            const auto parent = relpath.parent_path();
+            if (parent.empty() || entries.at(parent).exists) {
+                if (auto meta = find_node_meta(node.path() / relpath, filestates)) {
+                    if (entry.named) {
+                        throw Exception("Path is already occupied.");
+                    }
+                    if (meta->type != NodeType::Group) {
+                        throw Exception("Node is not of expected type.");
+                    }
+                    entry.exists = true;
+                    continue;
+                }
+            } else {
+                entry.depth = entries.at(parent).depth + 1;
+            }
+            if (levels.size() <= entry.depth) {
+                levels.resize(entry.depth + 1);
+            }
+            levels[entry.depth].emplace_back(relpath, entry.type);
+        }
+
+        // Nodes of a level are created concurrently in ranges, one per thread.
+        for (const auto& level : levels) {
+            const auto create_range = [&](std::size_t begin, std::size_t end) {
+                for (auto i = begin; i < end; ++i) {
+                    create_node_directory(node.path() / level[i].first, level[i].second);
+                }
+            };
+            const std::size_t num_tasks = concurrent ? std::min(level.size(), get_io_pool(filestates).size()) : 1;
+            std::vector<std::function<void()>> tasks;
+            tasks.reserve(num_tasks);
+            for (std::size_t t = 0; t < num_tasks; ++t) {
+                tasks.push_back([=] { create_range(level.size() * t / num_tasks, level.size() * (t + 1) / num_tasks); });
+            }
+            run_tasks(tasks, num_tasks > 1 ? &get_io_pool(filestates) : nullptr);
+        }
+
+        {
+            std::lock_guard lock(filestates.mutex);
+            for (const auto& level : levels) {
+                for (const auto& [relpath, nodetype] : level) {
+                    const auto dirpath = node.path() / relpath;
+                    if (filestates.meta_cache.enabled) {
+                        NodeMeta meta;
+                        meta.type = nodetype;
+                        filestates.meta_cache.entries[dirpath.string()] = meta;
+                    }
+                    // New directories and their metadata are flushed on commit, once per directory.
+                    if (filestates.durable_writes) {
+                        filestates.uncommitted_dirs.insert(dirpath.parent_path().string());
+                        filestates.uncommitted_dirs.insert(dirpath.string());
+                    }
+                }
+            }
+        }
+
+        std::vector<Node> ret;
+        ret.reserve(normalized_names.size());
+        for (auto& normalized_name : normalized_names) {
+            NodeMeta meta;
+            meta.type = entries.at(normalized_name).type;
+            ret.push_back(Node { meta, node.root, node.relpath / normalized_name, });
+        }
+        return ret;
+    }
     void delete_node(const Node& node, const std::filesystem::path& name, const FileStates& filestates) {
         assert_file_writable(filestates);
         assert_is_node_group(node);
@@ -254,53 +631,1058 @@ namespace poppel::core {
         auto dirpath = node.path() / normalized_name;
         assert_exists_directory(dirpath);
         std::filesystem::remove_all(dirpath);
+        uncache_node_meta(dirpath, filestates);
+        filestates.handle_pool.invalidate(dirpath);
+    }
+
+    Node copy_node(const Node& src, const FileStates& src_states, const Node& dst, const std::filesystem::path& name, const FileStates& dst_states, bool recursive, bool hard_links) {
+        assert_file_open(src_states);
+        assert_file_writable(dst_states);
+        assert_is_node_group(dst);
+        auto normalized_name = name.lexically_normal();
+        assert_is_valid_node_normalized_relpath(normalized_name);
+
+        auto parent = dst;
+        if (normalized_name.has_parent_path()) {
+            parent = require_node(dst, normalized_name.parent_path(), dst_states, NodeType::Group);
+        }
+        const auto dstpath = parent.path() / normalized_name.filename();
+        assert_not_exists(dstpath);
+        const auto srcpath = src.path();
+        if (const auto rel = dstpath.lexically_relative(srcpath); !rel.empty() && *rel.begin() != "..") {
+            throw Exception("Unable to copy a node into itself.");
+        }
+
+        bool copied = false;
+        ScopeGuard remove_guard { [&] {
+            if (!copied) {
+                std::error_code ec;
+                std::filesystem::remove_all(dstpath, ec);
+            }
+        } };
+
+        // Directories are created while listing. Files are copied after.
+        std::vector<std::filesystem::path> created_dirs;
+        std::vector<std::pair<std::filesystem::path, std::filesystem::path>> files;
+        std::vector<std::pair<std::filesystem::path, std::filesystem::path>> dirs { { srcpath, dstpath } };
+        while (!dirs.empty()) {
+            const auto [from, to] = dirs.back();
+            dirs.pop_back();
+            std::filesystem::create_directory(to);
+            created_dirs.push_back(to);
+            for (const auto& entry : std::filesystem::directory_iterator(from)) {
+                const auto filename = entry.path().filename();
+                // Temporary files of atomic writes, and the manifest of the source tree.
+                if (is_temp_file_path(filename) || filename == manifest_path({}).filename()) {
+                    continue;
+                }
+                std::error_code ec;
+                if (!entry.is_directory(ec)) {
+                    files.emplace_back(entry.path(), to / filename);
+                    continue;
+                }
+                if (!recursive && std::filesystem::exists(entry.path() / "poppel.json")) {
+                    if (const auto meta = find_node_meta(entry.path(), src_states); meta && meta->type == NodeType::Group) {
+                        continue;
+                    }
+                }
+                dirs.emplace_back(entry.path(), to / filename);
+            }
+        }
+
+        // Files of a copy are written once, so that they are flushed here rather than replaced by renaming.
+        const auto copy_range = [&](std::size_t begin, std::size_t end) {
+            for (auto i = begin; i < end; ++i) {
+                const auto& [from, to] = files[i];
+                // Only data files of contiguous datasets are linked, whose writes unlink or unshare them first.
+                // Other files are copied, because metadata and attribute files may be written in place.
+                clone_file(from, to, hard_links && from.filename() == "data.npy");
+                if (dst_states.durable_writes) {
+                    sync_file(to);
+                }
+            }
+        };
+        auto& pool = get_io_pool(dst_states);
+        const std::size_t num_tasks = std::min(files.size(), pool.size());
+        std::vector<std::function<void()>> tasks;
+        tasks.reserve(num_tasks);
+        for (std::size_t t = 0; t < num_tasks; ++t) {
+            tasks.push_back([&, t] { copy_range(files.size() * t / num_tasks, files.size() * (t + 1) / num_tasks); });
+        }
+        run_tasks(tasks, &pool);
+
+        // The root of a file becomes a group of the destination.
+        auto meta = src.meta;
+        if (meta.type == NodeType::File) {
+            meta.type = NodeType::Group;
+            write_node_meta(dstpath, meta);
+            if (dst_states.durable_writes) {
+                sync_file(dstpath / "poppel.json");
+            }
+        }
+
+        // Cached entries may tell that the directory does not exist, and complete caches must hold the copied nodes.
+        uncache_node_meta(dstpath, dst_states);
+        if (dst_states.meta_cache.enabled) {
+            for (const auto& dir : created_dirs) {
+                if (std::filesystem::exists(dir / "poppel.json")) {
+                    cache_node_meta(dir, read_node_meta(dir), dst_states);
+                }
+            }
+        }
+        dst_states.handle_pool.invalidate(dstpath);
+        if (dst_states.durable_writes) {
+            std::lock_guard lock(dst_states.mutex);
+            dst_states.uncommitted_dirs.insert(parent.path().string());
+            for (const auto& dir : created_dirs) {
+                dst_states.uncommitted_dirs.insert(dir.string());
+            }
+        }
+        commit_writes(dst_states);
+        copied = true;
+        return Node { meta, parent.root, parent.relpath / normalized_name.filename(), };
     }
 
     Attribute get_attribute(const Node& node, const FileStates& filestates) {
         assert_file_open(filestates);
-        auto jsonfilepath = node.root / node.relpath / "attributes.json";
+        auto attr = find_attribute(node.root / node.relpath, filestates.attr_encoding);
 
-        if(!std::filesystem::exists(jsonfilepath)) {
+        if(!std::filesystem::exists(attr.jsonfile)) {
             if(filestates.open_state == FileOpenState::ReadOnly) {
                 throw std::runtime_error("Cannot change data on file in read only mode");
             }
             else if(filestates.open_state == FileOpenState::ReadWrite) {
-                std::ofstream ofs { jsonfilepath };
-                ofs << "{}";
+                save_attr(Json::object(), attr);
+            }
+        }
+        return attr;
+    }
+
+    namespace {
+        std::optional<NodeMeta> find_cached_node_meta(const std::filesystem::path& nodepath, const FileStates& filestates) {
+            if (!filestates.meta_cache.enabled) {
+                return std::nullopt;
+            }
+            std::lock_guard lock(filestates.mutex);
+            const auto& entries = filestates.meta_cache.entries;
+            if (auto it = entries.find(nodepath.string()); it != entries.end() && it->second.type != NodeType::Unknown) {
+                return it->second;
+            }
+            return std::nullopt;
+        }
+
+        // Child nodes of the directory, sorted by path.
+        std::vector<NodeEntry> scan_child_nodes(const std::filesystem::path& dirpath, const std::filesystem::path& relpath, const FileStates& filestates, bool load_headers) {
+            std::vector<NodeEntry> ret;
+            for (const auto& entry : std::filesystem::directory_iterator(dirpath)) {
+                // File type is known from the directory listing on most platforms, without stat.
+                std::error_code ec;
+                if (!entry.is_directory(ec)) {
+                    continue;
+                }
+                const auto& childpath = entry.path();
+                NodeEntry child { relpath / childpath.filename(), NodeMeta {}, std::nullopt };
+
+                std::optional<Json> json;
+                if (auto meta = find_cached_node_meta(childpath, filestates)) {
+                    child.meta = *meta;
+                } else {
+                    std::ifstream file(childpath / "poppel.json");
+                    if (!file.is_open()) {
+                        continue;
+                    }
+                    count(filestates.instrumentation, &IoStats::files_opened);
+                    count(filestates.instrumentation, &IoStats::meta_parses);
+                    json.emplace(Json::parse(file));
+                    child.meta = node_meta_from_json(*json);
+                    cache_node_meta(childpath, child.meta, filestates);
+                }
+
+                if (load_headers && child.meta.type == NodeType::Dataset) {
+                    if (child.meta.layout == DatasetLayout::Chunked) {
+                        count(filestates.instrumentation, &IoStats::files_opened, json ? 0 : 1);
+                        child.header = json ? chunk_grid_from_json((*json)["layout"]).header : read_chunk_grid(childpath).header;
+                    } else if (child.meta.layout == DatasetLayout::Sharded) {
+                        count(filestates.instrumentation, &IoStats::files_opened, json ? 0 : 1);
+                        child.header = json ? shard_map_from_json((*json)["layout"]).header : read_shard_map(childpath).header;
+                    } else {
+                        child.header = load_indexed_header(childpath / "data.npy", filestates);
+                    }
+                }
+                ret.push_back(std::move(child));
+            }
+            std::sort(ret.begin(), ret.end(), [](const NodeEntry& a, const NodeEntry& b) { return a.relpath < b.relpath; });
+            return ret;
+        }
+    } // namespace
+
+    void visit_nodes(const Node& node, const FileStates& filestates, const std::function<void(const NodeEntry&)>& func, bool recursive, bool load_headers, bool concurrent) {
+        assert_file_open(filestates);
+        assert_is_node_group(node);
+
+        // Relative paths of the groups to scan in the current level.
+        std::vector<std::filesystem::path> level { std::filesystem::path() };
+        while (!level.empty()) {
+            std::vector<std::vector<NodeEntry>> results(level.size());
+            std::vector<std::function<void()>> tasks;
+            tasks.reserve(level.size());
+            for (std::size_t i = 0; i < level.size(); ++i) {
+                tasks.push_back([&, i] { results[i] = scan_child_nodes(node.path() / level[i], level[i], filestates, load_headers); });
+            }
+            run_tasks(tasks, concurrent && level.size() > 1 ? &get_io_pool(filestates) : nullptr);
+
+            std::vector<std::filesystem::path> next;
+            for (const auto& entries : results) {
+                for (const auto& entry : entries) {
+                    func(entry);
+                    if (recursive && entry.meta.type == NodeType::Group) {
+                        next.push_back(entry.relpath);
+                    }
+                }
             }
+            level = std::move(next);
         }
-        return Attribute { std::move(jsonfilepath) };
     }
 
+
+    //----------------------------------
+    // Consolidated manifest.
+    //----------------------------------
+
+    namespace {
+        Json header_to_json(const npy::Header& header) {
+            Json json;
+            json["descr"] = npy::internal::gen_descr(header.dtype);
+            json["fortran_order"] = header.fortran_order;
+            json["shape"] = header.shape;
+            return json;
+        }
+        npy::Header header_from_json(const Json& json) {
+            return npy::Header {
+                npy::internal::parse_descr(json["descr"].get<std::string>()),
+                json["fortran_order"].get<bool>(),
+                json["shape"].get<std::vector<Size>>(),
+            };
+        }
+    } // namespace
+
+    void write_manifest(const Node& root, const FileStates& filestates, bool include_attrs) {
+        assert_file_writable(filestates);
+        Json nodes = Json::object();
+        const auto add_node = [&](const std::filesystem::path& relpath, const NodeMeta& meta, const std::optional<npy::Header>& header) {
+            Json json;
+            json["type"] = text(meta.type);
+            if (meta.type == NodeType::Dataset) {
+                json["layout"] = text(meta.layout);
+            }
+            if (meta.checksum) {
+                json["checksum"] = true;
+            }
+            if (header) {
+                json["header"] = header_to_json(*header);
+                if (meta.layout == DatasetLayout::Contiguous) {
+                    if (auto stamp = file_stamp(dataset_data_path(Node { meta, root.root, relpath }))) {
+                        json["stamp"] = { { "mtime_ns", stamp->mtime_ns }, { "size", stamp->size } };
+                    }
+                }
+            }
+            if (include_attrs) {
+                auto attrs = load_node_attr(Node { meta, root.root, relpath }, filestates);
+                if (!attrs.empty()) {
+                    json["attrs"] = std::move(attrs);
+                }
+            }
+            nodes[relpath.generic_string()] = std::move(json);
+        };
+        add_node({}, root.meta, std::nullopt);
+        visit_nodes(root, filestates, [&](const NodeEntry& entry) {
+            add_node(entry.relpath, entry.meta, entry.header);
+        }, true, true);
+
+        Json json;
+        json["version"] = 1;
+        json["attrs"] = include_attrs;
+        json["nodes"] = std::move(nodes);
+        const auto content = json.dump();
+        write_file(manifest_path(root.path()), filestates, [&](const std::filesystem::path& path) {
+            std::ofstream ofs(path, std::ios::binary);
+            ofs.write(content.data(), content.size());
+            ofs.close();
+            if (!ofs) {
+                throw Exception("Failed to write file: " + path.string());
+            }
+        });
+    }
+
+    bool read_manifest(const Node& root, FileStates& filestates) {
+        std::ifstream file(manifest_path(root.path()));
+        if (!file.is_open()) {
+            return false;
+        }
+        const auto json = Json::parse(file);
+
+        Manifest manifest;
+        std::unordered_map<std::string, NodeMeta> entries;
+        manifest.has_attrs = json["attrs"].get<bool>();
+        for (const auto& [relpath, node] : json["nodes"].items()) {
+            const auto key = (relpath.empty() ? root.path() : root.path() / relpath).string();
+            NodeMeta meta;
+            meta.type = node_type(node["type"].get<std::string>());
+            if (node.contains("layout")) {
+                meta.layout = dataset_layout(node["layout"].get<std::string>());
+            }
+            // The value is read from poppel.json when verifying.
+            meta.checksum = node.contains("checksum");
+            entries[key] = meta;
+            if (node.contains("header")) {
+                manifest.headers[key] = header_from_json(node["header"]);
+            }
+            if (node.contains("attrs")) {
+                manifest.attrs[key] = node["attrs"];
+            }
+        }
+        manifest.trusted = true;
+
+        std::lock_guard lock(filestates.mutex);
+        filestates.meta_cache.enabled = true;
+        filestates.meta_cache.complete = true;
+        filestates.meta_cache.entries = std::move(entries);
+        filestates.manifest = std::move(manifest);
+        return true;
+    }
+
+    bool read_manifest_headers(const Node& root, const FileStates& filestates) {
+        std::ifstream file(manifest_path(root.path()));
+        if (!file.is_open()) {
+            return false;
+        }
+        const auto json = Json::parse(file);
+
+        std::lock_guard lock(filestates.mutex);
+        for (const auto& [relpath, node] : json["nodes"].items()) {
+            if (!node.contains("header") || !node.contains("stamp")) {
+                continue;
+            }
+            const auto datapath = root.path() / relpath / "data.npy";
+            const FileStamp stamp { node["stamp"]["mtime_ns"].get<std::int64_t>(), node["stamp"]["size"].get<std::uint64_t>() };
+            filestates.header_index.entries[datapath.string()] = { stamp, header_from_json(node["header"]) };
+        }
+        return true;
+    }
+
+
+    //----------------------------------
+    // Checksums.
+    //----------------------------------
+
+    namespace {
+        constexpr std::size_t checksum_block_size = 4 << 20;
+
+        std::optional<std::uint32_t> read_dataset_checksum(const std::filesystem::path& nodepath, const FileStates& filestates) {
+            count(filestates.instrumentation, &IoStats::files_opened);
+            count(filestates.instrumentation, &IoStats::meta_parses);
+            const auto json = read_node_json(nodepath);
+            if (!json.contains("checksum")) {
+                return std::nullopt;
+            }
+            if (json["checksum"]["type"] != "crc32c") {
+                throw Exception("Unsupported checksum type in " + nodepath.string() + ".");
+            }
+            return json["checksum"]["value"].get<std::uint32_t>();
+        }
+
+        void write_dataset_checksum(const Node& node, const FileStates& filestates, std::optional<std::uint32_t> checksum) {
+            auto meta = node.meta;
+            meta.checksum = checksum.has_value();
+            auto json = node_meta_to_json(meta);
+            if (checksum) {
+                json["checksum"] = { { "type", "crc32c" }, { "value", *checksum } };
+            }
+            const auto content = json.dump();
+            write_file(node.path() / "poppel.json", filestates, [&](const std::filesystem::path& path) {
+                std::ofstream ofs(path, std::ios::binary);
+                ofs.write(content.data(), content.size());
+                ofs.close();
+                if (!ofs) {
+                    throw Exception("Failed to write file: " + path.string());
+                }
+            });
+            cache_node_meta(node.path(), meta, filestates);
+        }
+    } // namespace
+
+    std::uint32_t npy_data_checksum(const std::filesystem::path& path) {
+        auto ifs = npy::internal::open_file_for_load(path);
+        const auto header = npy::load_header(ifs);
+        npy::internal::MaxAlignCharVector buffer;
+        buffer.resize(std::min<Size>(header.numbytes(), checksum_block_size));
+        std::uint32_t ret = 0;
+        for (Size done = 0; done < header.numbytes(); ) {
+            const Size n = std::min<Size>(buffer.size(), header.numbytes() - done);
+            ifs.read(reinterpret_cast<char*>(buffer.data()), n);
+            if (!ifs) {
+                throw std::runtime_error("io error: failed reading file");
+            }
+            ret = crc32c(ret, buffer.data(), n);
+            done += n;
+        }
+        return ret;
+    }
+
+    void update_dataset_checksum(const Node& node, const FileStates& filestates, std::optional<std::uint32_t> checksum) {
+        if (filestates.checksums) {
+            write_dataset_checksum(node, filestates, checksum ? *checksum : npy_data_checksum(dataset_data_path(node)));
+            return;
+        }
+        clear_dataset_checksum(node, filestates);
+    }
+
+    void extend_dataset_checksum(const Node& node, const FileStates& filestates, const std::byte* data, Size numbytes) {
+        if (filestates.checksums) {
+            if (const auto recorded = read_dataset_checksum(node.path(), filestates)) {
+                write_dataset_checksum(node, filestates, crc32c(*recorded, data, numbytes));
+                return;
+            }
+        }
+        update_dataset_checksum(node, filestates);
+    }
+
+    void clear_dataset_checksum(const Node& node, const FileStates& filestates) {
+        const auto cached = find_cached_node_meta(node.path(), filestates);
+        if (node.meta.checksum || (cached && cached->checksum)) {
+            write_dataset_checksum(node, filestates, std::nullopt);
+        }
+    }
+
+    std::vector<std::filesystem::path> verify_checksums(const Node& node, const FileStates& filestates, bool concurrent) {
+        std::vector<std::filesystem::path> relpaths;
+        visit_nodes(node, filestates, [&](const NodeEntry& entry) {
+            if (entry.meta.type == NodeType::Dataset && entry.meta.checksum) {
+                relpaths.push_back(entry.relpath);
+            }
+        }, true, false, concurrent);
+
+        // Datasets which fail to read count as mismatches.
+        std::vector<char> valid(relpaths.size(), 0);
+        const auto verify = [&](std::size_t i) {
+            const auto nodepath = node.path() / relpaths[i];
+            try {
+                const auto expected = read_dataset_checksum(nodepath, filestates);
+                count(filestates.instrumentation, &IoStats::files_opened);
+                valid[i] = expected && *expected == npy_data_checksum(nodepath / "data.npy");
+            } catch (const std::exception&) {
+                valid[i] = 0;
+            }
+        };
+        std::vector<std::function<void()>> tasks;
+        tasks.reserve(relpaths.size());
+        for (std::size_t i = 0; i < relpaths.size(); ++i) {
+            tasks.push_back([&verify, i] { verify(i); });
+        }
+        run_tasks(tasks, concurrent && relpaths.size() > 1 ? &get_io_pool(filestates) : nullptr);
+
+        std::vector<std::filesystem::path> ret;
+        for (std::size_t i = 0; i < relpaths.size(); ++i) {
+            if (!valid[i]) {
+                ret.push_back(relpaths[i]);
+            }
+        }
+        return ret;
+    }
+
+
     //----------------------------------
     // Dataset operations.
     //----------------------------------
 
+    namespace {
+        // Number of chunk files overlapping the hyperslab, or all chunk files if slab is null.
+        std::uint64_t num_chunk_files(const ChunkGrid& grid, const npy::Hyperslab* slab) {
+            std::uint64_t ret = 1;
+            const auto grid_shape = grid.grid_shape();
+            for (std::size_t i = 0; i < grid_shape.size(); ++i) {
+                if (!slab) {
+                    ret *= grid_shape[i];
+                } else if (slab->count[i] == 0) {
+                    return 0;
+                } else {
+                    const Size stride = slab->stride.empty() ? 1 : slab->stride[i];
+                    const Size first = slab->offset[i] / grid.chunk_shape[i];
+                    const Size last = (slab->offset[i] + (slab->count[i] - 1) * stride) / grid.chunk_shape[i];
+                    ret *= last - first + 1;
+                }
+            }
+            return ret;
+        }
+
+        ChunkGrid read_dataset_chunk_grid(const std::filesystem::path& nodepath, const FileStates& filestates) {
+            count(filestates.instrumentation, &IoStats::files_opened);
+            count(filestates.instrumentation, &IoStats::meta_parses);
+            return read_chunk_grid(nodepath);
+        }
+
+        // Number of shard files overlapping the bounding box of the hyperslab, or all shard files if slab is null.
+        std::uint64_t num_shard_files(const ShardMap& map, const npy::Hyperslab* slab) {
+            if (!slab) {
+                return map.shards.size();
+            }
+            std::uint64_t ret = 0;
+            for (const auto& shard : map.shards) {
+                bool intersects = true;
+                for (std::size_t i = 0; i < shard.shape.size() && intersects; ++i) {
+                    const Size stride = slab->stride.empty() ? 1 : slab->stride[i];
+                    const Size last = slab->offset[i] + (slab->count[i] - 1) * stride;
+                    intersects = slab->count[i] > 0 && shard.offset[i] <= last && slab->offset[i] < shard.offset[i] + shard.shape[i];
+                }
+                ret += intersects;
+            }
+            return ret;
+        }
+
+        ShardMap read_dataset_shard_map(const std::filesystem::path& nodepath, const FileStates& filestates) {
+            count(filestates.instrumentation, &IoStats::files_opened);
+            count(filestates.instrumentation, &IoStats::meta_parses);
+            return read_shard_map(nodepath);
+        }
+
+        void assert_not_sharded(const Node& node) {
+            if (node.meta.layout == DatasetLayout::Sharded) {
+                throw Exception("Operation is not supported for sharded datasets.");
+            }
+        }
+
+        // Handle of the data file of a contiguous dataset from the pool, opened on a miss.
+        FileHandlePool::HandlePtr acquire_data_handle(const Node& node, const FileStates& filestates) {
+            auto [handle, opened] = filestates.handle_pool.acquire(dataset_data_path(node));
+            if (opened) {
+                count(filestates.instrumentation, &IoStats::files_opened);
+            }
+            return handle;
+        }
+    } // namespace
+
+    npy::Header load_dataset_header(const Node& node, const FileStates& filestates) {
+        assert_file_open(filestates);
+        assert_is_node_dataset(node);
+        if (filestates.manifest.trusted) {
+            if (auto it = filestates.manifest.headers.find(node.path().string()); it != filestates.manifest.headers.end()) {
+                return it->second;
+            }
+        }
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            return read_dataset_chunk_grid(node.path(), filestates).header;
+        }
+        if (node.meta.layout == DatasetLayout::Sharded) {
+            return read_dataset_shard_map(node.path(), filestates).header;
+        }
+        if (filestates.header_index.enabled) {
+            return load_indexed_header(dataset_data_path(node), filestates);
+        }
+        if (filestates.handle_pool.enabled()) {
+            return acquire_data_handle(node, filestates)->header();
+        }
+        count(filestates.instrumentation, &IoStats::files_opened);
+        return npy::load_header(dataset_data_path(node));
+    }
+
+    npy::Header load_indexed_header(const std::filesystem::path& datapath, const FileStates& filestates) {
+        auto& index = filestates.header_index;
+        const auto& inst = filestates.instrumentation;
+        if (!index.enabled) {
+            count(inst, &IoStats::files_opened);
+            return npy::load_header(datapath);
+        }
+
+        count(inst, &IoStats::stat_calls);
+        const auto stamp = file_stamp(datapath);
+        const auto key = datapath.string();
+        if (!stamp) {
+            {
+                std::lock_guard lock(filestates.mutex);
+                index.entries.erase(key);
+            }
+            // Fails with the usual error of a missing file.
+            return npy::load_header(datapath);
+        }
+        {
+            std::lock_guard lock(filestates.mutex);
+            if (auto it = index.entries.find(key); it != index.entries.end() && it->second.first == *stamp) {
+                return it->second.second;
+            }
+        }
+
+        // Read without the lock. The stamp is taken before reading, so that a change during the read is seen on the next lookup.
+        count(inst, &IoStats::files_opened);
+        auto header = npy::load_header(datapath);
+        std::lock_guard lock(filestates.mutex);
+        index.entries[key] = { *stamp, header };
+        return header;
+    }
+
+    namespace {
+        void load_contiguous_dataset(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool allow_reshape, bool concurrent) {
+            if (concurrent && filestates.stripe_size > 0 && static_cast<std::size_t>(header.numbytes()) > filestates.stripe_size) {
+                count(filestates.instrumentation, &IoStats::files_opened);
+                load_npy_parallel(dataset_data_path(node), header, data, allow_reshape, get_io_pool(filestates), filestates.stripe_size);
+                return;
+            }
+            if (filestates.io_backend == IoBackend::Stream && filestates.handle_pool.enabled()) {
+                const auto handle = acquire_data_handle(node, filestates);
+                const bool header_match = allow_reshape
+                    ? npy::reshape_equal(handle->header(), header)
+                    : (handle->header() == header);
+                if (!header_match) {
+                    throw std::runtime_error("header information mismatch");
+                }
+                handle->read_data(data, header.numbytes(), 0);
+                return;
+            }
+            count(filestates.instrumentation, &IoStats::files_opened);
+            load_npy(dataset_data_path(node), header, data, allow_reshape, filestates.io_backend);
+        }
+    } // namespace
+
+    void load_dataset(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool allow_reshape, bool concurrent) {
+        assert_file_open(filestates);
+        assert_is_node_dataset(node);
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetLoad, nodepath);
+        timer.set_bytes(header.numbytes());
+        count(filestates.instrumentation, &IoStats::bytes_read, header.numbytes());
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            const auto grid = read_dataset_chunk_grid(nodepath, filestates);
+            const bool header_match = allow_reshape
+                ? npy::reshape_equal(grid.header, header)
+                : (grid.header == header);
+            if (!header_match) {
+                throw std::runtime_error("header information mismatch");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_chunk_files(grid, nullptr));
+            load_chunked(nodepath, grid, data, concurrent ? &get_io_pool(filestates) : nullptr);
+            return;
+        }
+        if (node.meta.layout == DatasetLayout::Sharded) {
+            const auto map = read_dataset_shard_map(nodepath, filestates);
+            const bool header_match = allow_reshape
+                ? npy::reshape_equal(map.header, header)
+                : (map.header == header);
+            if (!header_match) {
+                throw std::runtime_error("header information mismatch");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_shard_files(map, nullptr));
+            load_sharded(nodepath, map, data, concurrent ? &get_io_pool(filestates) : nullptr);
+            return;
+        }
+        load_contiguous_dataset(node, filestates, header, data, allow_reshape, concurrent);
+        if (filestates.checksums) {
+            if (auto expected = read_dataset_checksum(nodepath, filestates); expected && *expected != crc32c(data, header.numbytes())) {
+                throw Exception("Checksum mismatch of dataset " + nodepath.string() + ".");
+            }
+        }
+    }
+
+    void load_dataset_convert(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool allow_reshape, bool concurrent) {
+        assert_file_open(filestates);
+        assert_is_node_dataset(node);
+        assert_not_sharded(node);
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetLoad, nodepath);
+        timer.set_bytes(header.numbytes());
+        count(filestates.instrumentation, &IoStats::bytes_read, header.numbytes());
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            const auto grid = read_dataset_chunk_grid(nodepath, filestates);
+            const bool shape_match = allow_reshape
+                ? grid.header.length() == header.length()
+                : (grid.header.fortran_order == header.fortran_order && grid.header.shape == header.shape);
+            if (!shape_match) {
+                throw std::runtime_error("header information mismatch");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_chunk_files(grid, nullptr));
+            load_chunked_convert(nodepath, grid, header.dtype, data, concurrent ? &get_io_pool(filestates) : nullptr);
+            return;
+        }
+        count(filestates.instrumentation, &IoStats::files_opened);
+        npy::load_convert(dataset_data_path(node), header, data, allow_reshape);
+    }
+
+    void save_dataset(const Node& node, const FileStates& filestates, const npy::Header& header, const std::byte* data, bool concurrent) {
+        assert_file_writable(filestates);
+        assert_is_node_dataset(node);
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetSave, nodepath);
+        timer.set_bytes(header.numbytes());
+        count(filestates.instrumentation, &IoStats::bytes_written, header.numbytes());
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            const auto grid = read_dataset_chunk_grid(nodepath, filestates);
+            if (grid.header != header) {
+                throw Exception("Chunked dataset can only be saved with the same type, shape and index order.");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_chunk_files(grid, nullptr));
+            save_chunked(nodepath, grid, data, filestates, concurrent ? &get_io_pool(filestates) : nullptr);
+            return;
+        }
+        if (node.meta.layout == DatasetLayout::Sharded) {
+            const auto map = read_dataset_shard_map(nodepath, filestates);
+            if (map.header != header) {
+                throw Exception("Sharded dataset can only be saved with the same type, shape and index order.");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_shard_files(map, nullptr));
+            save_sharded(nodepath, map, data, filestates, concurrent ? &get_io_pool(filestates) : nullptr);
+            return;
+        }
+        count(filestates.instrumentation, &IoStats::files_opened);
+        const bool striped = concurrent && filestates.stripe_size > 0 && static_cast<std::size_t>(header.numbytes()) > filestates.stripe_size;
+        std::uint32_t checksum = 0;
+        write_file(dataset_data_path(node), filestates, [&](const std::filesystem::path& path) {
+            if (striped) {
+                save_npy_parallel(path, header, data, get_io_pool(filestates), filestates.stripe_size, filestates.checksums ? &checksum : nullptr);
+            } else {
+                save_npy(path, header, data, filestates.io_backend, filestates.checksums ? &checksum : nullptr);
+            }
+        });
+        update_dataset_checksum(node, filestates, filestates.checksums ? std::optional(checksum) : std::nullopt);
+    }
+
+    void save_dataset_strided(const Node& node, const FileStates& filestates, const npy::Header& header, const std::byte* data, const std::vector<std::ptrdiff_t>& strides) {
+        assert_file_writable(filestates);
+        assert_is_node_dataset(node);
+        if (node.meta.layout != DatasetLayout::Contiguous) {
+            throw Exception("Strided buffers can only be saved to contiguous datasets.");
+        }
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetSave, nodepath);
+        timer.set_bytes(header.numbytes());
+        count(filestates.instrumentation, &IoStats::bytes_written, header.numbytes());
+        count(filestates.instrumentation, &IoStats::files_opened);
+        std::uint32_t checksum = 0;
+        write_file(dataset_data_path(node), filestates, [&](const std::filesystem::path& path) {
+            save_npy_strided(path, header, data, strides, filestates.checksums ? &checksum : nullptr);
+        });
+        update_dataset_checksum(node, filestates, filestates.checksums ? std::optional(checksum) : std::nullopt);
+    }
+
+    void load_dataset_order(const Node& node, const FileStates& filestates, const npy::Header& header, std::byte* data, bool concurrent) {
+        assert_file_open(filestates);
+        assert_is_node_dataset(node);
+        assert_not_sharded(node);
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetLoad, nodepath);
+        timer.set_bytes(header.numbytes());
+        count(filestates.instrumentation, &IoStats::bytes_read, header.numbytes());
+        auto pool = concurrent ? &get_io_pool(filestates) : nullptr;
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            const auto grid = read_dataset_chunk_grid(nodepath, filestates);
+            if (grid.header.dtype != header.dtype || grid.header.shape != header.shape) {
+                throw std::runtime_error("header information mismatch");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_chunk_files(grid, nullptr));
+            if (grid.header.fortran_order == header.fortran_order) {
+                load_chunked(nodepath, grid, data, pool);
+                return;
+            }
+            // Chunks do not map to slabs of the other order, so the whole array is converted after loading.
+            npy::internal::MaxAlignCharVector buffer;
+            buffer.resize(header.numbytes());
+            load_chunked(nodepath, grid, buffer.data(), pool);
+            convert_order(buffer.data(), data, header.shape, grid.header.fortran_order, header.dtype.itemsize, pool);
+            return;
+        }
+        count(filestates.instrumentation, &IoStats::files_opened);
+        load_npy_order(dataset_data_path(node), header, data, pool);
+    }
+
+    void save_dataset_order(const Node& node, const FileStates& filestates, const npy::Header& header, const std::byte* data, bool fortran_order, bool concurrent) {
+        assert_file_writable(filestates);
+        assert_is_node_dataset(node);
+        assert_not_sharded(node);
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetSave, nodepath);
+        timer.set_bytes(header.numbytes());
+        count(filestates.instrumentation, &IoStats::bytes_written, header.numbytes());
+        auto pool = concurrent ? &get_io_pool(filestates) : nullptr;
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            const auto grid = read_dataset_chunk_grid(nodepath, filestates);
+            if (grid.header.dtype != header.dtype || grid.header.shape != header.shape) {
+                throw Exception("Chunked dataset can only be saved with the same type and shape.");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_chunk_files(grid, nullptr));
+            if (grid.header.fortran_order == header.fortran_order) {
+                save_chunked(nodepath, grid, data, filestates, pool);
+                return;
+            }
+            npy::internal::MaxAlignCharVector buffer;
+            buffer.resize(header.numbytes());
+            convert_order(data, buffer.data(), header.shape, header.fortran_order, header.dtype.itemsize, pool);
+            save_chunked(nodepath, grid, buffer.data(), filestates, pool);
+            return;
+        }
+        count(filestates.instrumentation, &IoStats::files_opened);
+        std::uint32_t checksum = 0;
+        write_file(dataset_data_path(node), filestates, [&](const std::filesystem::path& path) {
+            save_npy_order(path, header, data, fortran_order, pool, filestates.checksums ? &checksum : nullptr);
+        });
+        update_dataset_checksum(node, filestates, filestates.checksums ? std::optional(checksum) : std::nullopt);
+    }
+
+    npy::Header load_dataset_region(const Node& node, const FileStates& filestates, npy::Dtype dtype, const npy::Hyperslab& slab, std::byte* data, bool concurrent) {
+        assert_file_open(filestates);
+        assert_is_node_dataset(node);
+        const auto nodepath = node.path();
+        OperationTimer timer(filestates.instrumentation, Operation::DatasetLoad, nodepath);
+        const std::uint64_t numbytes = slab.length() * dtype.itemsize;
+        timer.set_bytes(numbytes);
+        count(filestates.instrumentation, &IoStats::bytes_read, numbytes);
+        if (node.meta.layout == DatasetLayout::Chunked) {
+            const auto grid = read_dataset_chunk_grid(nodepath, filestates);
+            if (grid.header.dtype != dtype) {
+                throw std::runtime_error("array dtype is not match");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_chunk_files(grid, &slab));
+            load_chunked_region(nodepath, grid, slab, data, concurrent ? &get_io_pool(filestates) : nullptr);
+            return npy::Header { dtype, grid.header.fortran_order, slab.count };
+        }
+        if (node.meta.layout == DatasetLayout::Sharded) {
+            const auto map = read_dataset_shard_map(nodepath, filestates);
+            if (map.header.dtype != dtype) {
+                throw std::runtime_error("array dtype is not match");
+            }
+            count(filestates.instrumentation, &IoStats::files_opened, num_shard_files(map, &slab));
+            load_sharded_region(nodepath, map, slab, data, concurrent ? &get_io_pool(filestates) : nullptr);
+            return npy::Header { dtype, map.header.fortran_order, slab.count };
+        }
+        if (filestates.handle_pool.enabled()) {
+            const auto handle = acquire_data_handle(node, filestates);
+            const auto& file_header = handle->header();
+            if (file_header.dtype != dtype) {
+                throw std::runtime_error("array dtype is not match");
+            }
+            npy::internal::assert_valid_hyperslab(file_header, slab);
+            if (slab.length() > 0) {
+                npy::internal::load_region_data_at([&](char* out, Size count, Size offset) {
+                    handle->read_data(reinterpret_cast<std::byte*>(out), count, offset);
+                }, file_header, slab, data);
+            }
+            return npy::Header { dtype, file_header.fortran_order, slab.count };
+        }
+        count(filestates.instrumentation, &IoStats::files_opened);
+        return npy::load_region(dataset_data_path(node), dtype, slab, data);
+    }
+
     void load_to(std::string& val, const std::filesystem::path& path) { npy::load(path, val); }
 
     void save_from(const std::string& val, const std::filesystem::path& path) { npy::save(path, val); }
 
+    //----------------------------------
+    // Raw operations.
+    //----------------------------------
+
+    namespace {
+        bool is_reserved_filename(const std::string& name) {
+            return name == "poppel.json"
+                || name == attribute_filename(AttributeEncoding::Json)
+                || name == attribute_filename(AttributeEncoding::Cbor)
+                || name == attribute_filename(AttributeEncoding::MessagePack)
+                || name.rfind(".", 0) == 0;
+        }
+    } // namespace
+
+    std::filesystem::path raw_file_path(const Node& node, const std::filesystem::path& name) {
+        assert_is_node_raw(node);
+        const auto normalized_name = name.lexically_normal();
+        assert_is_valid_node_normalized_relpath(normalized_name);
+        if (normalized_name != normalized_name.filename() || is_reserved_filename(normalized_name.string())) {
+            throw Exception("[" + name.string() + "] is not a valid raw file name.");
+        }
+        return node.path() / normalized_name;
+    }
+    std::vector<std::string> list_raw_files(const Node& node) {
+        assert_is_node_raw(node);
+        std::vector<std::string> ret;
+        for (const auto& entry : std::filesystem::directory_iterator(node.path())) {
+            auto name = entry.path().filename().string();
+            if (entry.is_regular_file() && !is_reserved_filename(name)) {
+                ret.push_back(std::move(name));
+            }
+        }
+        std::sort(ret.begin(), ret.end());
+        return ret;
+    }
+
+
     //----------------------------------
     // Attribute operations.
     //----------------------------------
 
+    Attribute find_attribute(const std::filesystem::path& nodepath, AttributeEncoding preferred) {
+        Attribute preferred_attr { nodepath / attribute_filename(preferred), preferred };
+        if (std::filesystem::exists(preferred_attr.jsonfile)) {
+            return preferred_attr;
+        }
+        for (auto encoding : { AttributeEncoding::Json, AttributeEncoding::Cbor, AttributeEncoding::MessagePack }) {
+            Attribute attr { nodepath / attribute_filename(encoding), encoding };
+            if (encoding != preferred && std::filesystem::exists(attr.jsonfile)) {
+                return attr;
+            }
+        }
+        return preferred_attr;
+    }
+
     Json load_attr(const Attribute& attr) {
-        std::ifstream ifs(attr.jsonfile);
+        std::ifstream ifs(attr.jsonfile, std::ios::binary);
         if (!ifs.is_open()) {
             throw std::runtime_error("Failed to open attribute file: " + attr.jsonfile.string());
         }
 
-        Json j;
-        ifs >> j;
-        return j;
+        switch (attr.encoding) {
+            case AttributeEncoding::Cbor:
+                return Json::from_cbor(ifs);
+            case AttributeEncoding::MessagePack:
+                return Json::from_msgpack(ifs);
+            default: {
+                Json j;
+                ifs >> j;
+                return j;
+            }
+        }
     }
     void save_attr(const Json& val, const Attribute& attr) {
-        std::ofstream ofs(attr.jsonfile);
-        if (!ofs.is_open()) {
-            throw std::runtime_error("Failed to open attribute file: " + attr.jsonfile.string());
+        switch (attr.encoding) {
+            case AttributeEncoding::Cbor: {
+                const auto bytes = Json::to_cbor(val);
+                write_file_atomic(attr.jsonfile, std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+                break;
+            }
+            case AttributeEncoding::MessagePack: {
+                const auto bytes = Json::to_msgpack(val);
+                write_file_atomic(attr.jsonfile, std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+                break;
+            }
+            default:
+                write_file_atomic(attr.jsonfile, val.dump());
+                break;
+        }
+    }
+
+    namespace {
+        Json read_node_attr_file(const std::filesystem::path& nodepath, AttributeEncoding preferred) {
+            const auto attr = find_attribute(nodepath, preferred);
+            if (!std::filesystem::exists(attr.jsonfile)) {
+                return Json::object();
+            }
+            return load_attr(attr);
+        }
+        // Write the attributes in the encoding, and remove files in other encodings which would be stale.
+        void write_node_attr_file(const std::filesystem::path& nodepath, const Json& val, AttributeEncoding encoding) {
+            save_attr(val, Attribute { nodepath / attribute_filename(encoding), encoding });
+            for (auto other : { AttributeEncoding::Json, AttributeEncoding::Cbor, AttributeEncoding::MessagePack }) {
+                if (other != encoding) {
+                    std::error_code ec;
+                    std::filesystem::remove(nodepath / attribute_filename(other), ec);
+                }
+            }
         }
+        // Open state of the attributes of the node, if any. Must be called with the file states locked.
+        std::shared_ptr<AttributeState> find_attribute_state(const std::filesystem::path& nodepath, const FileStates& filestates) {
+            auto it = filestates.attr_states.find(nodepath.string());
+            if (it == filestates.attr_states.end()) {
+                return nullptr;
+            }
+            auto state = it->second.lock();
+            if (!state) {
+                filestates.attr_states.erase(it);
+            }
+            return state;
+        }
+    } // namespace
+
+    Json load_node_attr(const Node& node, const FileStates& filestates) {
+        assert_file_open(filestates);
+        const auto nodepath = node.root / node.relpath;
+        std::shared_ptr<AttributeState> state;
+        {
+            std::lock_guard lock(filestates.mutex);
+            state = find_attribute_state(nodepath, filestates);
+        }
+        if (state) {
+            std::lock_guard lock(state->mutex);
+            return state->value;
+        }
+        if (filestates.manifest.trusted && filestates.manifest.has_attrs) {
+            const auto it = filestates.manifest.attrs.find(node.path().string());
+            return it != filestates.manifest.attrs.end() ? it->second : Json::object();
+        }
+        OperationTimer timer(filestates.instrumentation, Operation::AttrLoad, nodepath);
+        count(filestates.instrumentation, &IoStats::files_opened);
+        return read_node_attr_file(nodepath, filestates.attr_encoding);
+    }
+    void save_node_attr(const Json& val, const Node& node, const FileStates& filestates) {
+        assert_file_writable(filestates);
+        const auto nodepath = node.root / node.relpath;
+        std::shared_ptr<AttributeState> state;
+        {
+            std::lock_guard lock(filestates.mutex);
+            state = find_attribute_state(nodepath, filestates);
+        }
+        OperationTimer timer(filestates.instrumentation, Operation::AttrSave, nodepath);
+        count(filestates.instrumentation, &IoStats::files_opened);
+        count(filestates.instrumentation, &IoStats::attr_rewrites);
+        if (state) {
+            std::lock_guard lock(state->mutex);
+            write_node_attr_file(nodepath, val, state->encoding);
+            state->value = val;
+            state->dirty = false;
+        } else {
+            write_node_attr_file(nodepath, val, filestates.attr_encoding);
+        }
+    }
 
-        ofs << val;
+    std::shared_ptr<AttributeState> open_attribute_state(const Node& node, const FileStates& filestates) {
+        assert_file_open(filestates);
+        const auto nodepath = node.root / node.relpath;
+        std::lock_guard lock(filestates.mutex);
+        if (auto state = find_attribute_state(nodepath, filestates)) {
+            return state;
+        }
+        auto state = std::make_shared<AttributeState>();
+        state->nodepath = nodepath;
+        state->encoding = filestates.attr_encoding;
+        if (filestates.manifest.trusted && filestates.manifest.has_attrs) {
+            const auto it = filestates.manifest.attrs.find(node.path().string());
+            state->value = it != filestates.manifest.attrs.end() ? it->second : Json::object();
+        } else {
+            OperationTimer timer(filestates.instrumentation, Operation::AttrLoad, nodepath);
+            count(filestates.instrumentation, &IoStats::files_opened);
+            state->value = read_node_attr_file(nodepath, filestates.attr_encoding);
+        }
+        filestates.attr_states[nodepath.string()] = state;
+        return state;
+    }
+    void flush_attribute_state(AttributeState& state, const FileStates& filestates) {
+        std::lock_guard lock(state.mutex);
+        if (state.dirty) {
+            OperationTimer timer(filestates.instrumentation, Operation::AttrSave, state.nodepath);
+            count(filestates.instrumentation, &IoStats::files_opened);
+            count(filestates.instrumentation, &IoStats::attr_rewrites);
+            write_node_attr_file(state.nodepath, state.value, state.encoding);
+            state.dirty = false;
+        }
+    }
+    void close_attribute_states(const FileStates& filestates) {
+        std::vector<std::shared_ptr<AttributeState>> states;
+        {
+            std::lock_guard lock(filestates.mutex);
+            for (auto& [path, weak_state] : filestates.attr_states) {
+                if (auto state = weak_state.lock()) {
+                    states.push_back(std::move(state));
+                }
+            }
+            filestates.attr_states.clear();
+        }
+        for (auto& state : states) {
+            flush_attribute_state(*state, filestates);
+            std::lock_guard lock(state->mutex);
+            state->closed = true;
+        }
     }
 
 } // namespace poppel::core
@@ -0,0 +1,92 @@
+#include <algorithm>
+
+#include "poppel/core/stats.hpp"
+
+namespace poppel::core {
+
+    void LatencyHistogram::record(std::uint64_t ns) {
+        std::size_t bucket = 0;
+        while (bucket + 1 < num_buckets && (ns >> (bucket + 1)) != 0) {
+            ++bucket;
+        }
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        count.fetch_add(1, std::memory_order_relaxed);
+        total_ns.fetch_add(ns, std::memory_order_relaxed);
+        auto prev = max_ns.load(std::memory_order_relaxed);
+        while (prev < ns && !max_ns.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {}
+    }
+
+    std::uint64_t LatencyHistogram::quantile_ns(double q) const {
+        const auto n = count.load(std::memory_order_relaxed);
+        if (n == 0) {
+            return 0;
+        }
+        const auto rank = static_cast<std::uint64_t>(std::clamp(q, 0.0, 1.0) * (n - 1));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < num_buckets; ++i) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                return std::uint64_t { 2 } << i;
+            }
+        }
+        return max_ns.load(std::memory_order_relaxed);
+    }
+
+    void LatencyHistogram::reset() {
+        for (auto& bucket : buckets) {
+            bucket = 0;
+        }
+        count = 0;
+        total_ns = 0;
+        max_ns = 0;
+    }
+
+    nlohmann::json LatencyHistogram::to_json() const {
+        nlohmann::json json;
+        json["count"] = count.load();
+        json["total_ns"] = total_ns.load();
+        json["max_ns"] = max_ns.load();
+        json["p50_ns"] = quantile_ns(0.5);
+        json["p99_ns"] = quantile_ns(0.99);
+        // Trailing empty buckets are omitted.
+        auto& jbuckets = json["buckets"] = nlohmann::json::array();
+        std::size_t last = 0;
+        for (std::size_t i = 0; i < num_buckets; ++i) {
+            if (buckets[i].load() != 0) {
+                last = i + 1;
+            }
+        }
+        for (std::size_t i = 0; i < last; ++i) {
+            jbuckets.push_back(buckets[i].load());
+        }
+        return json;
+    }
+
+    void IoStats::reset() {
+        bytes_read = 0;
+        bytes_written = 0;
+        files_opened = 0;
+        meta_parses = 0;
+        stat_calls = 0;
+        attr_rewrites = 0;
+        for (auto& latency : latencies) {
+            latency.reset();
+        }
+    }
+
+    nlohmann::json IoStats::to_json() const {
+        nlohmann::json json;
+        json["bytes_read"] = bytes_read.load();
+        json["bytes_written"] = bytes_written.load();
+        json["files_opened"] = files_opened.load();
+        json["meta_parses"] = meta_parses.load();
+        json["stat_calls"] = stat_calls.load();
+        json["attr_rewrites"] = attr_rewrites.load();
+        auto& jlatencies = json["latencies"];
+        for (std::size_t i = 0; i < num_operations; ++i) {
+            jlatencies[text(static_cast<Operation>(i))] = latencies[i].to_json();
+        }
+        return json;
+    }
+
+} // namespace poppel::core
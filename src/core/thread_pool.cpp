@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+#include "poppel/core/thread_pool.hpp"
+
+namespace poppel::core {
+
+    ThreadPool::ThreadPool(std::size_t num_threads) {
+        num_threads = std::max<std::size_t>(num_threads, 1);
+        workers_.reserve(num_threads);
+        for (std::size_t i = 0; i < num_threads; ++i) {
+            workers_.emplace_back([this] { run_worker(); });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::run_worker() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                // Remaining tasks are drained before stopping.
+                if (tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    void run_tasks(std::vector<std::function<void()>>& tasks, ThreadPool* pool) {
+        if (!pool || tasks.size() <= 1) {
+            for (auto& task : tasks) {
+                task();
+            }
+            return;
+        }
+        std::vector<std::future<void>> futures;
+        futures.reserve(tasks.size());
+        for (auto& task : tasks) {
+            futures.push_back(pool->submit(std::move(task)));
+        }
+        std::exception_ptr error;
+        for (auto& future : futures) {
+            try {
+                future.get();
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+} // namespace poppel::core
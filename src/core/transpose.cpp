@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+
+#include "poppel/core/checksum.hpp"
+#include "poppel/core/io.hpp"
+#include "poppel/core/transpose.hpp"
+#include "poppel/core/utilities.hpp"
+
+namespace poppel::core {
+
+    namespace {
+        // Side of square tiles in items. Tiles of 16 x 16 items of up to 16 bytes fit in the L1 cache on both sides.
+        constexpr Size tile_size = 16;
+        // Target size of the slab buffer when converting while reading or writing.
+        constexpr Size slab_numbytes = 8 << 20;
+        // Slabs hold at least this many slices of the slowest axis, so that tiles are filled.
+        constexpr Size min_slab_slices = tile_size;
+        // Copies smaller than this are not split over the thread pool.
+        constexpr Size parallel_numbytes = 1 << 20;
+
+        // Copy an ni x nj plane, with strides in items on both sides, tile by tile.
+        template< typename ItemSize >
+        void copy_plane_tiles(const std::byte* src, Size src_si, Size src_sj, std::byte* dst, Size dst_si, Size dst_sj, Size ni, Size nj, ItemSize itemsize) {
+            const Size n = itemsize;
+            for (Size i0 = 0; i0 < ni; i0 += tile_size) {
+                const Size ie = std::min(ni, i0 + tile_size);
+                for (Size j0 = 0; j0 < nj; j0 += tile_size) {
+                    const Size je = std::min(nj, j0 + tile_size);
+                    for (Size i = i0; i < ie; ++i) {
+                        for (Size j = j0; j < je; ++j) {
+                            std::memcpy(dst + (i * dst_si + j * dst_sj) * n, src + (i * src_si + j * src_sj) * n, itemsize);
+                        }
+                    }
+                }
+            }
+        }
+
+        void copy_plane(const std::byte* src, Size src_si, Size src_sj, std::byte* dst, Size dst_si, Size dst_sj, Size ni, Size nj, Size itemsize) {
+            with_fixed_size(itemsize, [&](auto n) { copy_plane_tiles(src, src_si, src_sj, dst, dst_si, dst_sj, ni, nj, n); });
+        }
+
+        // Copy slices [j0, j0 + nj) of the slowest axis between a slab and the whole array in reversed axis order.
+        //
+        // Axes of shape are ordered fastest first in the slab, which holds the slices contiguously.
+        // The array has the reversed order, where the last axis of shape is the fastest.
+        // Each combination of middle axes indices is a plane of the first axis by the slices,
+        // which is contiguous along the first axis in the slab and along the slices in the array.
+        void copy_slab(const std::byte* src, std::byte* dst, const std::vector<Size>& shape, Size j0, Size nj, Size itemsize, bool src_is_slab, ThreadPool* pool) {
+            const auto rank = shape.size();
+            if (rank <= 1) {
+                // Both orders are the same.
+                const Size offset = rank == 0 ? 0 : j0 * itemsize;
+                const Size numbytes = (rank == 0 ? 1 : nj) * itemsize;
+                std::memcpy(dst + (src_is_slab ? offset : 0), src + (src_is_slab ? 0 : offset), numbytes);
+                return;
+            }
+
+            const Size n0 = shape[0];
+            Size num_middle = 1;
+            for (std::size_t k = 1; k + 1 < rank; ++k) {
+                num_middle *= shape[k];
+            }
+            const Size slab_sj = n0 * num_middle;
+            // Strides of the array in items.
+            std::vector<Size> array_strides(rank, 1);
+            for (std::size_t k = rank - 1; k-- > 0; ) {
+                array_strides[k] = array_strides[k + 1] * shape[k + 1];
+            }
+
+            const auto copy_range = [&](Size m_begin, Size m_end, Size i_begin, Size i_end) {
+                for (Size m = m_begin; m < m_end; ++m) {
+                    // Offset of the plane in the array, from the middle indices in slab order.
+                    Size array_offset = 0;
+                    for (std::size_t k = 1, rem = m; k + 1 < rank; ++k) {
+                        array_offset += (static_cast<Size>(rem) % shape[k]) * array_strides[k];
+                        rem /= shape[k];
+                    }
+                    const Size slab_offset = m * n0 + i_begin;
+                    array_offset += j0 + i_begin * array_strides[0];
+                    if (src_is_slab) {
+                        copy_plane(src + slab_offset * itemsize, 1, slab_sj, dst + array_offset * itemsize, array_strides[0], 1, i_end - i_begin, nj, itemsize);
+                    } else {
+                        copy_plane(src + array_offset * itemsize, array_strides[0], 1, dst + slab_offset * itemsize, 1, slab_sj, i_end - i_begin, nj, itemsize);
+                    }
+                }
+            };
+
+            const Size numbytes = slab_sj * nj * itemsize;
+            const Size num_tasks = pool && numbytes >= parallel_numbytes ? static_cast<Size>(pool->size()) : 1;
+            if (num_tasks <= 1) {
+                copy_range(0, num_middle, 0, n0);
+                return;
+            }
+
+            // Split the middle indices, or the first axis if there are not enough middle indices.
+            std::vector<std::function<void()>> tasks;
+            if (num_middle >= num_tasks) {
+                for (Size t = 0; t < num_tasks; ++t) {
+                    tasks.push_back([=] { copy_range(num_middle * t / num_tasks, num_middle * (t + 1) / num_tasks, 0, n0); });
+                }
+            } else {
+                const Size num_tiles = (n0 + tile_size - 1) / tile_size;
+                for (Size t = 0; t < num_tasks; ++t) {
+                    const Size i_begin = std::min(n0, num_tiles * t / num_tasks * tile_size);
+                    const Size i_end = std::min(n0, num_tiles * (t + 1) / num_tasks * tile_size);
+                    tasks.push_back([=] { copy_range(0, num_middle, i_begin, i_end); });
+                }
+            }
+            run_tasks(tasks, pool);
+        }
+
+        // Shape with axes ordered fastest first in the given index order.
+        std::vector<Size> fastest_first(const std::vector<Size>& shape, bool fortran_order) {
+            std::vector<Size> ret(shape);
+            if (!fortran_order) {
+                std::reverse(ret.begin(), ret.end());
+            }
+            return ret;
+        }
+
+        // Number of slices of the slowest axis in each slab, and the number of bytes of each slice.
+        std::pair<Size, Size> slab_slices(const std::vector<Size>& shape, Size itemsize) {
+            Size slice_numbytes = itemsize;
+            for (std::size_t k = 0; k + 1 < shape.size(); ++k) {
+                slice_numbytes *= shape[k];
+            }
+            const Size num_slices = shape.empty() ? 1 : shape.back();
+            return { std::min(num_slices, std::max(min_slab_slices, slab_numbytes / std::max<Size>(slice_numbytes, 1))), slice_numbytes };
+        }
+    } // namespace
+
+    void convert_order(const std::byte* src, std::byte* dst, const std::vector<Size>& shape, bool from_fortran, Size itemsize, ThreadPool* pool) {
+        const auto src_shape = fastest_first(shape, from_fortran);
+        copy_slab(src, dst, src_shape, 0, src_shape.empty() ? 1 : src_shape.back(), itemsize, true, pool);
+    }
+
+    void load_npy_order(const std::filesystem::path& path, const npy::Header& header, std::byte* data, ThreadPool* pool) {
+        auto ifs = npy::internal::open_file_for_load(path);
+        const auto loaded_header = npy::load_header(ifs);
+        if (loaded_header.dtype != header.dtype || loaded_header.shape != header.shape) {
+            throw std::runtime_error("header information mismatch");
+        }
+        const Size numbytes = header.numbytes();
+        if (loaded_header.fortran_order == header.fortran_order || header.shape.size() <= 1 || numbytes == 0) {
+            npy::load_data(ifs, data, numbytes);
+            return;
+        }
+
+        const auto shape = fastest_first(header.shape, loaded_header.fortran_order);
+        const auto [num_slices, slice_numbytes] = slab_slices(shape, header.dtype.itemsize);
+        npy::internal::MaxAlignCharVector slab;
+        slab.resize(num_slices * slice_numbytes);
+        for (Size j0 = 0; j0 < shape.back(); j0 += num_slices) {
+            const Size nj = std::min(num_slices, shape.back() - j0);
+            ifs.read(reinterpret_cast<char*>(slab.data()), nj * slice_numbytes);
+            if (!ifs) {
+                throw std::runtime_error("io error: failed reading file");
+            }
+            copy_slab(slab.data(), data, shape, j0, nj, header.dtype.itemsize, true, pool);
+        }
+    }
+
+    void save_npy_order(const std::filesystem::path& path, const npy::Header& header, const std::byte* data, bool fortran_order, ThreadPool* pool, std::uint32_t* checksum) {
+        const npy::Header file_header { header.dtype, fortran_order, header.shape };
+        const Size numbytes = header.numbytes();
+        if (header.fortran_order == fortran_order || header.shape.size() <= 1 || numbytes == 0) {
+            save_npy(path, file_header, data, IoBackend::Stream, checksum);
+            return;
+        }
+        if (checksum) {
+            *checksum = 0;
+        }
+
+        auto ofs = npy::internal::open_file_for_save(path);
+        const npy::Version version { 3, 0 };
+        npy::internal::write_header(ofs, version, npy::internal::gen_header(version, file_header).view());
+
+        const auto shape = fastest_first(header.shape, fortran_order);
+        const auto [num_slices, slice_numbytes] = slab_slices(shape, header.dtype.itemsize);
+        npy::internal::MaxAlignCharVector slab;
+        slab.resize(num_slices * slice_numbytes);
+        for (Size j0 = 0; j0 < shape.back(); j0 += num_slices) {
+            const Size nj = std::min(num_slices, shape.back() - j0);
+            copy_slab(data, slab.data(), shape, j0, nj, header.dtype.itemsize, false, pool);
+            if (checksum) {
+                *checksum = crc32c(*checksum, slab.data(), nj * slice_numbytes);
+            }
+            ofs.write(reinterpret_cast<const char*>(slab.data()), nj * slice_numbytes);
+        }
+        if (!ofs) {
+            throw std::runtime_error("io error: failed writing file");
+        }
+    }
+
+} // namespace poppel::core
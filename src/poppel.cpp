@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <exception>
+#include <future>
+
 #include "poppel/core/operations.hpp"
 #include "poppel/poppel.hpp"
 
@@ -31,4 +35,203 @@ namespace poppel {
         core::delete_node(node_, name, *pstates_);
     }
 
+    // Raw management.
+    bool Group::has_raw(const std::filesystem::path& name) const {
+        return core::has_node(node_, name, *pstates_, core::NodeType::Raw);
+    }
+    Raw Group::get_raw(const std::filesystem::path& name) const {
+        return Raw(core::get_node(node_, name, *pstates_, core::NodeType::Raw), pstates_);
+    }
+    Raw Group::create_raw(const std::filesystem::path& name) const {
+        return Raw(core::create_node(node_, name, *pstates_, core::NodeType::Raw), pstates_);
+    }
+    Raw Group::require_raw(const std::filesystem::path& name) const {
+        return Raw(core::require_node(node_, name, *pstates_, core::NodeType::Raw), pstates_);
+    }
+    void Group::delete_raw(const std::filesystem::path& name) const {
+        core::delete_node(node_, name, *pstates_);
+    }
+
+    // Node iteration.
+    std::vector<core::NodeEntry> Group::children(bool load_headers) const {
+        std::vector<core::NodeEntry> ret;
+        core::visit_nodes(node_, *pstates_, [&](const core::NodeEntry& entry) { ret.push_back(entry); }, false, load_headers);
+        return ret;
+    }
+    void Group::visit(const std::function<void(const core::NodeEntry&)>& func, bool recursive, bool load_headers) const {
+        core::visit_nodes(node_, *pstates_, func, recursive, load_headers);
+    }
+
+    // Batch I/O.
+    std::vector<std::future<npy::NumpyArray>> Group::load_many(const std::vector<std::filesystem::path>& names) const {
+        auto& pool = core::get_io_pool(*pstates_);
+        std::vector<std::future<npy::NumpyArray>> ret;
+        ret.reserve(names.size());
+        for (const auto& name : names) {
+            ret.push_back(pool.submit([node = node_, pstates = pstates_, name] {
+                const auto dataset_node = core::get_node(node, name, *pstates, core::NodeType::Dataset);
+                npy::NumpyArray ret;
+                ret.header = core::load_dataset_header(dataset_node, *pstates);
+                ret.rawdata.resize(ret.header.numbytes());
+                core::load_dataset(dataset_node, *pstates, ret.header, ret.rawdata.data(), false, false);
+                return ret;
+            }));
+        }
+        return ret;
+    }
+    std::vector<std::future<void>> Group::load_many(std::vector<LoadRequest> requests) const {
+        auto& pool = core::get_io_pool(*pstates_);
+        std::vector<std::future<void>> ret;
+        ret.reserve(requests.size());
+        for (auto& request : requests) {
+            ret.push_back(pool.submit([node = node_, pstates = pstates_, request = std::move(request)] {
+                const auto dataset_node = core::get_node(node, request.name, *pstates, core::NodeType::Dataset);
+                core::load_dataset(dataset_node, *pstates, request.header, request.data, request.allow_reshape, false);
+            }));
+        }
+        return ret;
+    }
+    std::vector<std::future<void>> Group::save_many(std::vector<SaveRequest> requests) const {
+        core::assert_file_writable(*pstates_);
+        auto& pool = core::get_io_pool(*pstates_);
+        std::vector<std::future<void>> ret;
+        ret.reserve(requests.size());
+        for (auto& request : requests) {
+            // Nodes are created in order on this thread, because siblings may share parent groups to create.
+            core::Node dataset_node;
+            try {
+                dataset_node = core::require_node(node_, request.name, *pstates_, core::NodeType::Dataset);
+            } catch (...) {
+                std::promise<void> failed;
+                failed.set_exception(std::current_exception());
+                ret.push_back(failed.get_future());
+                continue;
+            }
+            ret.push_back(pool.submit([dataset_node = std::move(dataset_node), pstates = pstates_, request = std::move(request)] {
+                core::save_dataset(dataset_node, *pstates, request.header, request.data, false);
+            }));
+        }
+        return ret;
+    }
+
+    // Batch.
+    void Batch::run() {
+        const auto nodes = core::create_nodes(node_, nodes_, *pstates_);
+        std::vector<std::function<void()>> tasks;
+        tasks.reserve(saves_.size());
+        for (const auto& [index, request] : saves_) {
+            tasks.push_back([&node = nodes[index], pstates = pstates_, &request = request] {
+                core::save_dataset(node, *pstates, request.header, request.data, false);
+            });
+        }
+        // The batch is cleared even if some writes fail.
+        core::ScopeGuard clear_guard { [&] {
+            nodes_.clear();
+            saves_.clear();
+        } };
+        core::run_tasks(tasks, &core::get_io_pool(*pstates_));
+        core::commit_writes(*pstates_);
+    }
+
+    // Prefetcher.
+    Prefetcher::Prefetcher(core::Node node, core::FileStates* pstates, std::vector<PrefetchItem> plan, std::size_t depth) :
+        node_(std::move(node)), pstates_(pstates), plan_(std::move(plan)), depth_(std::max<std::size_t>(depth, 1))
+    {
+        core::assert_file_open(*pstates_);
+        fill_();
+    }
+
+    std::vector<PrefetchItem> Prefetcher::slab_plan(const std::filesystem::path& name, const std::vector<Size>& shape, Size count) {
+        if (shape.empty() || count <= 0) {
+            throw Exception("Slabs need a dataset of at least one axis and a positive count.");
+        }
+        std::vector<PrefetchItem> ret;
+        for (Size i = 0; i < shape[0]; i += count) {
+            std::vector<Size> offset(shape.size(), 0);
+            std::vector<Size> slab_count(shape);
+            offset[0] = i;
+            slab_count[0] = std::min(count, shape[0] - i);
+            ret.emplace_back(name, std::move(offset), std::move(slab_count));
+        }
+        return ret;
+    }
+
+    void Prefetcher::fill_() {
+        auto& pool = core::get_io_pool(*pstates_);
+        while (pending_.size() < depth_ && next_load_ < plan_.size()) {
+            npy::NumpyArray buffer;
+            if (!free_.empty()) {
+                buffer = std::move(free_.back());
+                free_.pop_back();
+            }
+            pending_.push_back(pool.submit([node = node_, pstates = pstates_, &item = plan_[next_load_], buffer = std::move(buffer)]() mutable {
+                const auto dataset_node = core::get_node(node, item.name, *pstates, core::NodeType::Dataset);
+                const auto header = core::load_dataset_header(dataset_node, *pstates);
+                if (item.slab.count.empty()) {
+                    buffer.rawdata.resize(header.numbytes());
+                    core::load_dataset(dataset_node, *pstates, header, buffer.rawdata.data(), false, false);
+                    buffer.header = header;
+                } else {
+                    buffer.rawdata.resize(item.slab.length() * header.dtype.itemsize);
+                    buffer.header = core::load_dataset_region(dataset_node, *pstates, header.dtype, item.slab, buffer.rawdata.data(), false);
+                }
+                return std::move(buffer);
+            }));
+            ++next_load_;
+        }
+    }
+
+    void Prefetcher::wait_() {
+        for (auto& future : pending_) {
+            future.wait();
+        }
+        pending_.clear();
+    }
+
+    npy::NumpyArray Prefetcher::next() {
+        if (done()) {
+            throw Exception("No more items to prefetch.");
+        }
+        auto future = std::move(pending_.front());
+        pending_.pop_front();
+        ++next_;
+        // Refill before waiting, so that the freed slot is loading while this item finishes.
+        fill_();
+        return future.get();
+    }
+
+    void Prefetcher::recycle(npy::NumpyArray array) {
+        if (free_.size() < depth_) {
+            free_.push_back(std::move(array));
+        }
+    }
+
+    Prefetcher Group::prefetch(std::vector<PrefetchItem> plan, std::size_t depth) const {
+        return Prefetcher(node_, pstates_, std::move(plan), depth);
+    }
+    Prefetcher Group::prefetch(std::size_t depth) const {
+        std::vector<PrefetchItem> plan;
+        core::visit_nodes(node_, *pstates_, [&](const core::NodeEntry& entry) {
+            if (entry.meta.type == core::NodeType::Dataset) {
+                plan.emplace_back(entry.relpath);
+            }
+        }, false, false);
+        return Prefetcher(node_, pstates_, std::move(plan), depth);
+    }
+
+    // Copying.
+    Group Group::copy_to(const Group& dest, const std::filesystem::path& name, bool recursive, bool hard_links) const {
+        return Group(core::copy_node(node_, *pstates_, dest.node_, name, *dest.pstates_, recursive, hard_links), dest.pstates_);
+    }
+    void Group::copy(const std::filesystem::path& name, const Group& dest, const std::filesystem::path& dest_name, bool recursive, bool hard_links) const {
+        const auto normalized_name = name.lexically_normal();
+        core::assert_is_valid_node_normalized_relpath(normalized_name);
+        const auto meta = core::find_node_meta(node_.path() / normalized_name, *pstates_);
+        if (!meta) {
+            throw Exception("Node does not exist.");
+        }
+        const core::Node child { *meta, node_.root, node_.relpath / normalized_name, };
+        core::copy_node(child, *pstates_, dest.node_, dest_name, *dest.pstates_, recursive, hard_links);
+    }
+
 } // namespace poppel
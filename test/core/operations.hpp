@@ -5,7 +5,9 @@
 
 #include <catch2/catch.hpp>
 
+#include <poppel/core/checksum.hpp>
 #include <poppel/core/operations.hpp>
+#include <poppel/core/transpose.hpp>
 
 TEST_CASE("Poppel operations", "[operation]") {
     using namespace poppel;
@@ -47,8 +49,10 @@ TEST_CASE("Poppel operations", "[operation]") {
         CHECK(!is_valid_node_normalized_relpath(".."));
         CHECK(!is_valid_node_normalized_relpath("/"));
         CHECK(!is_valid_node_normalized_relpath("//"));
+        #ifdef _WIN32
         CHECK(!is_valid_node_normalized_relpath("\\"));
         CHECK(!is_valid_node_normalized_relpath("C:\\"));
+        #endif
         CHECK(!is_valid_node_normalized_relpath("c/"));
         CHECK(!is_valid_node_normalized_relpath("../c"));
         CHECK( is_valid_node_normalized_relpath("c"));
@@ -89,6 +93,17 @@ TEST_CASE("Poppel operations", "[operation]") {
         CHECK_THROWS (assert_not_exists(tfile1));
         CHECK_NOTHROW(assert_exists_directory(pfile1));
         CHECK_THROWS (assert_exists_directory(tfile1));
+
+        // Checksums, with the check value of CRC32C.
+        {
+            const std::string text = "123456789";
+            const auto* bytes = reinterpret_cast<const std::byte*>(text.data());
+            CHECK(crc32c(bytes, text.size()) == 0xe3069283);
+            CHECK(crc32c(crc32c(bytes, 4), bytes + 4, text.size() - 4) == 0xe3069283);
+            CHECK(crc32c(bytes, 0) == 0);
+            CHECK(crc32c_combine(crc32c(bytes, 4), crc32c(bytes + 4, text.size() - 4), text.size() - 4) == 0xe3069283);
+            CHECK(crc32c_combine(0xe3069283, 0, 0) == 0xe3069283);
+        }
     }
 
     SECTION("Node operations.") {
@@ -170,6 +185,33 @@ TEST_CASE("Poppel operations", "[operation]") {
                 CHECK(!has_node(f1n11, "d1", fs_r, NodeType::Dataset));
             }
         }
+
+        SECTION("Cached node metadata.") {
+            cleanup();
+            auto f1 = create_file_node(pfile1);
+            FileStates fs_cached { FileOpenState::ReadWrite };
+            fs_cached.meta_cache.enabled = true;
+
+            CHECK(!has_node(f1, "g1", fs_cached, NodeType::Group));
+            auto f1n11 = require_node(f1, "g1/g1", fs_cached, NodeType::Group);
+            CHECK(has_node(f1, "g1/g1", fs_cached, NodeType::Group));
+            CHECK(!has_node(f1, "g1/g1", fs_cached, NodeType::Dataset));
+            require_node(f1, "g1/g1/d1", fs_cached, NodeType::Dataset);
+            CHECK_THROWS(require_node(f1, "g1/g1/d1/d1", fs_cached, NodeType::Dataset));
+            CHECK(has_node(f1n11, "d1", fs_cached, NodeType::Dataset));
+
+            // Cached lookups do not read the file system.
+            std::filesystem::remove_all(pfile1 / "g1");
+            CHECK(has_node(f1, "g1/g1", fs_cached, NodeType::Group));
+            CHECK(!has_node(f1, "g1/g1", fs_rw, NodeType::Group));
+
+            // Deletion invalidates descendants.
+            std::filesystem::create_directories(pfile1 / "g1");
+            delete_node(f1, "g1", fs_cached);
+            CHECK(!has_node(f1, "g1", fs_cached, NodeType::Group));
+            CHECK(!has_node(f1, "g1/g1", fs_cached, NodeType::Group));
+            CHECK(fs_cached.meta_cache.entries.size() == 2);
+        }
     }
 
     SECTION("Dataset operations.") {
@@ -302,6 +344,307 @@ TEST_CASE("Poppel operations", "[operation]") {
                 CHECK_THROWS(load_to(val2.data(), fortran_order, shape_bad, npyfile1, false));
                 CHECK_THROWS(load_to(val2.data(), fortran_order, shape_bad, npyfile1, true));
             }
+
+            // Memory mapping.
+            {
+                const auto mapped = map_npy<double>(npyfile1);
+                CHECK(mapped.fortran_order());
+                CHECK(mapped.shape() == shape);
+                REQUIRE(mapped.length() == 9);
+                CHECK(reinterpret_cast<std::uintptr_t>(mapped.data()) % npy::internal::header_alignment == 0);
+                CHECK(std::equal(val1.begin(), val1.end(), mapped.data()));
+
+                CHECK_THROWS(map_npy<float>(npyfile1));
+            }
+        }
+
+        // Hyperslab of 4x5x6 array of int, in both index orders.
+        for (const bool fortran_order : { false, true }) {
+            const std::vector<Size> shape { 4, 5, 6 };
+            const auto linear = [&](Size i, Size j, Size k) {
+                return fortran_order ? i + 4 * (j + 5 * k) : k + 6 * (j + 5 * i);
+            };
+            std::vector<int> val1(4 * 5 * 6);
+            for (Size i = 0; i < static_cast<Size>(val1.size()); ++i) {
+                val1[i] = static_cast<int>(i);
+            }
+            save_from(val1.data(), fortran_order, shape, npyfile1);
+
+            const auto check_slab = [&](const npy::Hyperslab& slab) {
+                std::vector<int> val2(slab.length());
+                const auto region = load_slice_to(val2.data(), slab, npyfile1);
+                CHECK(region.fortran_order == fortran_order);
+                CHECK(region.shape == slab.count);
+
+                const auto stride = [&](Size axis) { return slab.stride.empty() ? 1 : slab.stride[axis]; };
+                bool all_match = true;
+                for (Size i = 0; i < slab.count[0]; ++i) {
+                    for (Size j = 0; j < slab.count[1]; ++j) {
+                        for (Size k = 0; k < slab.count[2]; ++k) {
+                            const auto out = fortran_order
+                                ? i + slab.count[0] * (j + slab.count[1] * k)
+                                : k + slab.count[2] * (j + slab.count[1] * i);
+                            const auto expected = val1[linear(slab.offset[0] + i * stride(0), slab.offset[1] + j * stride(1), slab.offset[2] + k * stride(2))];
+                            all_match = all_match && val2[out] == expected;
+                        }
+                    }
+                }
+                CHECK(all_match);
+            };
+            check_slab({ { 0, 0, 0 }, { 4, 5, 6 }, {} });
+            check_slab({ { 1, 0, 0 }, { 2, 5, 6 }, {} });
+            check_slab({ { 1, 2, 3 }, { 3, 2, 3 }, {} });
+            check_slab({ { 0, 1, 1 }, { 2, 2, 3 }, { 3, 2, 2 } });
+            check_slab({ { 3, 4, 5 }, { 1, 1, 1 }, {} });
+            check_slab({ { 0, 0, 0 }, { 0, 5, 6 }, {} });
+
+            std::vector<int> val2(4 * 5 * 6);
+            CHECK_THROWS(load_slice_to(val2.data(), { { 0, 0 }, { 1, 1 }, {} }, npyfile1));
+            CHECK_THROWS(load_slice_to(val2.data(), { { 0, 0, 1 }, { 4, 5, 6 }, {} }, npyfile1));
+            CHECK_THROWS(load_slice_to(val2.data(), { { 0, 0, 0 }, { 4, 5, 4 }, { 1, 1, 2 } }, npyfile1));
+            CHECK_THROWS(load_slice_to(reinterpret_cast<float*>(val2.data()), { { 0, 0, 0 }, { 1, 1, 1 }, {} }, npyfile1));
+        }
+
+        // Header codec, with shapes stored inline and spilled to the heap.
+        {
+            const npy::Header header1 { npy::internal::dtype(double{}), true, { 3, 1, 4 } };
+            const auto text1 = npy::internal::gen_header(npy::Version { 3, 0 }, header1);
+            const std::string_view expected1 = "{'descr': '<f8', 'fortran_order': True, 'shape': (3, 1, 4), }";
+            CHECK(text1.view().substr(0, expected1.length()) == expected1);
+            CHECK(text1.view().find_first_not_of(' ', expected1.length()) == text1.length() - 1);
+            CHECK((npy::internal::preamble_length(npy::Version { 3, 0 }) + text1.length()) % npy::internal::header_alignment == 0);
+            CHECK(npy::internal::parse_header(text1) == header1);
+
+            const npy::Header header2 { npy::internal::dtype(std::int8_t{}), false, { 7 } };
+            CHECK(npy::internal::parse_header(npy::internal::gen_header(npy::Version { 1, 0 }, header2)).shape == std::vector<Size> { 7 });
+            const npy::Header header3 { npy::internal::dtype(float{}), false, {} };
+            CHECK(npy::internal::parse_header(npy::internal::gen_header(npy::Version { 1, 0 }, header3, 400)) == header3);
+            CHECK_THROWS(npy::internal::parse_header("{'descr': '<f4', 'fortran_order': False, 'shape': (2x, 3), }\n"));
+
+            const std::vector<Size> shape(12, 2);
+            npy::Shape shape1 = shape;
+            CHECK(shape1.size() == 12);
+            CHECK(shape1 == shape);
+            shape1.resize(3);
+            CHECK(shape1 == npy::Shape { 2, 2, 2 });
+            shape1.push_back(5);
+            CHECK(std::vector<Size>(shape1) == std::vector<Size> { 2, 2, 2, 5 });
+
+            std::vector<std::uint8_t> val1(1 << 12, 3);
+            save_from(val1.data(), false, shape, npyfile1);
+            CHECK(load_npy_header(npyfile1).shape == shape);
+            std::vector<std::uint8_t> val2(1 << 12);
+            load_to(val2.data(), false, shape, npyfile1, false);
+            CHECK(val2 == val1);
+        }
+
+        // Conversion on load.
+        {
+            // Big-endian 16-bit integers, converted to native integers and widened to float.
+            const std::vector<std::int16_t> val1 { 1, -2, 300, -32768, 32767, 0, 7, 1000, -1000 };
+            std::vector<std::int16_t> swapped(9);
+            for (std::size_t i = 0; i < val1.size(); ++i) {
+                swapped[i] = static_cast<std::int16_t>(npy::internal::byteswap(static_cast<std::uint16_t>(val1[i])));
+            }
+            const char other_endian = npy::internal::char_host_endian == '<' ? '>' : '<';
+            npy::save(npyfile1, npy::Header { { other_endian, 'i', 2 }, false, { 3, 3 } }, reinterpret_cast<const std::byte*>(swapped.data()));
+
+            std::vector<std::int16_t> val2(9);
+            CHECK_THROWS(load_to(val2.data(), false, { 3, 3 }, npyfile1, false));
+            load_convert_to(val2.data(), false, { 3, 3 }, npyfile1, false);
+            CHECK(val2 == val1);
+
+            std::vector<float> val3(9);
+            load_convert_to(val3.data(), false, { 3, 3 }, npyfile1, false);
+            for (std::size_t i = 0; i < val1.size(); ++i) {
+                CHECK(val3[i] == static_cast<float>(val1[i]));
+            }
+            CHECK_THROWS(load_convert_to(val3.data(), true, { 3, 3 }, npyfile1, false));
+            load_convert_to(val3.data(), true, { 9 }, npyfile1, true);
+
+            // Narrowing across several conversion blocks.
+            const auto length = npy::internal::convert_block_length * 2 + 5;
+            std::vector<double> val4(length);
+            for (Size i = 0; i < length; ++i) {
+                val4[i] = i * 0.5;
+            }
+            save_from(val4.data(), false, { length }, npyfile1);
+            std::vector<float> val5(length);
+            load_convert_to(val5.data(), false, { length }, npyfile1, false);
+            CHECK(val5[0] == 0.0f);
+            CHECK(val5[length - 1] == static_cast<float>(val4[length - 1]));
+            std::vector<std::int32_t> val6(length);
+            load_convert_to(val6.data(), false, { length }, npyfile1, false);
+            CHECK(val6[length - 1] == static_cast<std::int32_t>(val4[length - 1]));
+
+            std::vector<std::complex<double>> val7(length);
+            load_convert_to(val7.data(), false, { length }, npyfile1, false);
+            CHECK(val7[3] == std::complex<double>(1.5, 0.0));
+            save_from(val7.data(), false, { length }, npyfile1);
+            CHECK_THROWS(load_convert_to(val4.data(), false, { length }, npyfile1, false));
+        }
+
+        // Appending to (n, 3) array of float.
+        {
+            const std::vector<float> row { 1.0f, 2.0f, 3.0f };
+            save_appendable_from<float>(nullptr, false, { 0, 3 }, npyfile1);
+            CHECK(load_npy_header(npyfile1).shape == std::vector<Size> { 0, 3 });
+            const auto data_start = std::filesystem::file_size(npyfile1);
+
+            append_from(row.data(), 1, npyfile1);
+            {
+                auto appender = get_appender<float>(npyfile1, 256);
+                for (int i = 0; i < 99; ++i) {
+                    appender.append(row.data(), 1);
+                }
+                CHECK(appender.header().shape == std::vector<Size> { 100, 3 });
+                CHECK_THROWS(appender.append(reinterpret_cast<const double*>(row.data()), 1));
+            }
+            CHECK_THROWS(append_from(reinterpret_cast<const std::int32_t*>(row.data()), 1, npyfile1));
+
+            std::vector<float> val2(300);
+            load_to(val2.data(), false, { 100, 3 }, npyfile1, false);
+            CHECK(std::filesystem::file_size(npyfile1) == data_start + 300 * sizeof(float));
+            CHECK(val2[0] == 1.0f);
+            CHECK(val2[298] == 2.0f);
+            CHECK(val2[299] == 3.0f);
+
+            // Move assignment flushes the batched data of the replaced appender.
+            const auto npyfile2 = temp_dir / "file2.npy";
+            ScopeGuard npyfile2_guard { [&] { std::filesystem::remove(npyfile2); } };
+            save_appendable_from<float>(nullptr, false, { 0, 3 }, npyfile2);
+            {
+                auto appender = get_appender<float>(npyfile1, 256);
+                appender.append(row.data(), 1);
+                appender = get_appender<float>(npyfile2, 256);
+                CHECK(load_npy_header(npyfile1).shape == std::vector<Size> { 101, 3 });
+                appender.append(row.data(), 1);
+            }
+            CHECK(load_npy_header(npyfile2).shape == std::vector<Size> { 1, 3 });
+        }
+
+        // Index order conversion.
+        {
+            // Element (i, j, k, l) of shape (3, 5, 7, 2) in both orders.
+            const std::vector<Size> shape { 3, 5, 7, 2 };
+            std::vector<std::int16_t> fval(210), cval(210), res(210);
+            for (Size i = 0; i < 3; ++i) for (Size j = 0; j < 5; ++j) for (Size k = 0; k < 7; ++k) for (Size l = 0; l < 2; ++l) {
+                const auto v = static_cast<std::int16_t>(1000 * i + 100 * j + 10 * k + l);
+                fval[i + 3 * (j + 5 * (k + 7 * l))] = v;
+                cval[((i * 5 + j) * 7 + k) * 2 + l] = v;
+            }
+            convert_order(reinterpret_cast<const std::byte*>(fval.data()), reinterpret_cast<std::byte*>(res.data()), shape, true, 2);
+            CHECK(res == cval);
+            convert_order(reinterpret_cast<const std::byte*>(cval.data()), reinterpret_cast<std::byte*>(res.data()), shape, false, 2);
+            CHECK(res == fval);
+
+            save_from(fval.data(), true, shape, npyfile1);
+            std::fill(res.begin(), res.end(), 0);
+            load_npy_order(npyfile1, npy::create_header<std::int16_t>(false, shape), reinterpret_cast<std::byte*>(res.data()));
+            CHECK(res == cval);
+            CHECK_THROWS(load_npy_order(npyfile1, npy::create_header<std::int16_t>(false, { 5, 3, 7, 2 }), reinterpret_cast<std::byte*>(res.data())));
+
+            // Several slabs, split over threads.
+            ThreadPool pool(3);
+            const Size rows = 700000, cols = 20;
+            std::vector<std::uint8_t> big(rows * cols), big_res(rows * cols);
+            for (Size i = 0; i < rows * cols; ++i) {
+                big[i] = static_cast<std::uint8_t>(i * 31 + i / 7);
+            }
+            save_npy_order(npyfile1, npy::create_header<std::uint8_t>(false, { rows, cols }), reinterpret_cast<const std::byte*>(big.data()), true, &pool);
+            CHECK(load_npy_header(npyfile1).fortran_order);
+            load_npy_order(npyfile1, npy::create_header<std::uint8_t>(false, { rows, cols }), reinterpret_cast<std::byte*>(big_res.data()), &pool);
+            CHECK(big_res == big);
+            load_to(big_res.data(), true, { rows, cols }, npyfile1, false);
+            CHECK(big_res[1] == big[cols]);
+            CHECK(big_res[rows] == big[1]);
+        }
+
+        // Whole arrays, reusing buffers.
+        {
+            const std::vector<double> val { 1, 2, 3, 4, 5, 6 };
+            save_from(val.data(), false, { 2, 3 }, npyfile1);
+
+            npy::NumpyArray array;
+            load_to(array, npyfile1);
+            CHECK(array.header.shape == std::vector<Size> { 2, 3 });
+            CHECK(array.data<double>()[5] == 6.0);
+            CHECK(reinterpret_cast<std::uintptr_t>(array.data()) % alignof(std::max_align_t) == 0);
+
+            // Smaller loads keep the buffer.
+            const auto* prev = array.data();
+            save_from(val.data(), 4, npyfile1);
+            load_to(array, npyfile1);
+            CHECK(array.data() == prev);
+            CHECK(array.rawdata.size() == 4 * sizeof(double));
+            CHECK(array.data<double>()[3] == 4.0);
+
+            // Buffers from a memory resource.
+            std::vector<std::byte> storage(1 << 10);
+            std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size(), std::pmr::null_memory_resource());
+            auto parray = npy::load(npyfile1, &arena);
+            CHECK(parray.rawdata.get_allocator().resource == &arena);
+            CHECK(parray.data<double>()[0] == 1.0);
+            npy::PmrNumpyArray parray2 { npy::internal::PmrMaxAlignByteAllocator(&arena) };
+            load_to(parray2, npyfile1);
+            CHECK(parray2.data<double>()[2] == 3.0);
+            CHECK_THROWS_AS(npy::load(npyfile1, std::pmr::null_memory_resource()), std::bad_alloc);
+
+            // Truncated data fails instead of returning uninitialized bytes.
+            std::filesystem::resize_file(npyfile1, std::filesystem::file_size(npyfile1) - 1);
+            CHECK_THROWS(load_to(array, npyfile1));
+            CHECK_THROWS(npy::load(npyfile1));
+        }
+
+        // Strided buffers.
+        {
+            // 3 x 4 block at (1, 2) of a 6 x 10 matrix in C order, saved in place.
+            std::vector<std::int32_t> mat(6 * 10);
+            for (std::size_t i = 0; i < mat.size(); ++i) {
+                mat[i] = static_cast<std::int32_t>(i);
+            }
+            std::vector<std::int32_t> res(12);
+            save_npy_strided(npyfile1, npy::create_header<std::int32_t>(false, { 3, 4 }), reinterpret_cast<const std::byte*>(mat.data() + 12), { 10, 1 });
+            load_to(res.data(), false, { 3, 4 }, npyfile1, false);
+            CHECK(res == std::vector<std::int32_t> { 12, 13, 14, 15, 22, 23, 24, 25, 32, 33, 34, 35 });
+
+            // Columns, transposed and reversed views.
+            save_npy_strided(npyfile1, npy::create_header<std::int32_t>(false, { 6 }), reinterpret_cast<const std::byte*>(mat.data() + 3), { 10 });
+            load_to(res.data(), false, { 6 }, npyfile1, false);
+            CHECK(std::vector<std::int32_t>(res.begin(), res.begin() + 6) == std::vector<std::int32_t> { 3, 13, 23, 33, 43, 53 });
+            save_npy_strided(npyfile1, npy::create_header<std::int32_t>(true, { 3, 4 }), reinterpret_cast<const std::byte*>(mat.data()), { 1, 10 });
+            load_to(res.data(), true, { 3, 4 }, npyfile1, false);
+            CHECK(res[1] == 1);
+            CHECK(res[3] == 10);
+            save_npy_strided(npyfile1, npy::create_header<std::int32_t>(false, { 2, 2 }), reinterpret_cast<const std::byte*>(mat.data() + 59), { -10, -1 });
+            load_to(res.data(), false, { 2, 2 }, npyfile1, false);
+            CHECK(std::vector<std::int32_t>(res.begin(), res.begin() + 4) == std::vector<std::int32_t> { 59, 58, 49, 48 });
+            CHECK_THROWS(save_npy_strided(npyfile1, npy::create_header<std::int32_t>(false, { 2, 2 }), reinterpret_cast<const std::byte*>(mat.data()), { 10 }));
+
+            // Long runs written in place, and small runs over many staging buffers.
+            const Size rows = 300, cols = 3000;
+            std::vector<std::int16_t> big(rows * cols), big_res(rows * (cols / 2));
+            for (Size i = 0; i < rows * cols; ++i) {
+                big[i] = static_cast<std::int16_t>(i * 7);
+            }
+            save_npy_strided(npyfile1, npy::create_header<std::int16_t>(false, { rows, cols / 2 }), reinterpret_cast<const std::byte*>(big.data() + 1), { cols, 1 });
+            load_to(big_res.data(), false, { rows, cols / 2 }, npyfile1, false);
+            CHECK(big_res[0] == big[1]);
+            CHECK(big_res[rows * (cols / 2) - 1] == big[(rows - 1) * cols + cols / 2]);
+            save_npy_strided(npyfile1, npy::create_header<std::int16_t>(false, { rows * (cols / 2) }), reinterpret_cast<const std::byte*>(big.data()), { 2 });
+            load_to(big_res.data(), false, { rows * (cols / 2) }, npyfile1, false);
+            bool all_equal = true;
+            for (Size i = 0; i < rows * (cols / 2); ++i) {
+                all_equal = all_equal && big_res[i] == big[2 * i];
+            }
+            CHECK(all_equal);
+
+            // Checksums computed while writing match those of the file.
+            std::uint32_t checksum = 1;
+            save_npy_strided(npyfile1, npy::create_header<std::int32_t>(false, { 3, 4 }), reinterpret_cast<const std::byte*>(mat.data() + 12), { 10, 1 }, &checksum);
+            load_to(res.data(), false, { 3, 4 }, npyfile1, false);
+            CHECK(checksum == crc32c(reinterpret_cast<const std::byte*>(res.data()), 12 * sizeof(std::int32_t)));
+            CHECK(checksum == npy_data_checksum(npyfile1));
         }
     }
 
@@ -2,6 +2,7 @@
 #include <catch2/catch.hpp>
 
 #include "test/core/operations.hpp"
+#include "test/poppel.hpp"
 
 int main(int argc, char* argv[]) {
     int result = Catch::Session().run( argc, argv );
@@ -0,0 +1,1036 @@
+#ifndef POPPEL_TEST_POPPEL_HPP
+#define POPPEL_TEST_POPPEL_HPP
+
+#include <catch2/catch.hpp>
+
+#include <poppel/poppel.hpp>
+
+TEST_CASE("Poppel file interface", "[poppel]") {
+    using namespace poppel;
+
+    auto temp_dir = std::filesystem::temp_directory_path();
+    INFO("Temp directory path is " << temp_dir);
+    auto pfile1  = temp_dir / "file1-interface.poppel";
+    auto cleanup = [&]() {
+        std::filesystem::remove_all(pfile1);
+    };
+    cleanup();
+    core::ScopeGuard cleanup_guard { cleanup };
+
+    File f1(pfile1, File::CreateWrite);
+
+    SECTION("Dataset access.") {
+        const std::vector<std::int16_t> val1 { 1, 2, 3, 4, 5, 6 };
+        auto d1 = f1.create_dataset("g1/d1", val1.data(), false, std::vector<Size> { 2, 3 });
+        // 🗂️ f1 (File)
+        // └─ 📂 g1
+        //    └─ 🔢 d1
+
+        {
+            const auto mapped = d1.map<std::int16_t>();
+            REQUIRE(mapped.length() == 6);
+            CHECK(mapped[5] == 6);
+        }
+        {
+            std::vector<std::int16_t> val2(2);
+            d1.load_slice(val2.data(), { 0, 1 }, { 2, 1 });
+            CHECK(val2 == std::vector<std::int16_t> { 2, 5 });
+        }
+    }
+
+    SECTION("Appendable dataset.") {
+        const std::vector<double> val1 { 1, 2 };
+        auto d1 = f1.create_appendable_dataset("d1", val1.data(), true, std::vector<Size> { 2, 1 });
+        d1.append_from(val1.data(), 1);
+        {
+            auto appender = d1.appender<double>();
+            appender.append(val1.data(), 1);
+        }
+        CHECK(d1.load_npy_header().shape == std::vector<Size> { 2, 3 });
+
+        std::vector<double> val2(6);
+        d1.load_to(val2.data(), true, { 2, 3 });
+        CHECK(val2 == std::vector<double> { 1, 2, 1, 2, 1, 2 });
+    }
+
+    SECTION("Chunked dataset.") {
+        // 5x7 array in chunks of 2x3, in both index orders.
+        for (const bool fortran_order : { false, true }) {
+            std::vector<float> val1(35);
+            for (int i = 0; i < 35; ++i) {
+                val1[i] = static_cast<float>(i);
+            }
+            const std::string name = fortran_order ? "df" : "dc";
+            auto d1 = f1.create_chunked_dataset(name, val1.data(), fortran_order, { 5, 7 }, { 2, 3 });
+            CHECK(d1.is_chunked());
+            CHECK(f1.get_dataset(name).is_chunked());
+            CHECK(d1.chunk_grid().grid_shape() == std::vector<Size> { 3, 3 });
+            CHECK(d1.load_npy_header().shape == std::vector<Size> { 5, 7 });
+            CHECK(std::filesystem::exists(pfile1 / name / "chunk.2.2.npy"));
+            CHECK(!std::filesystem::exists(d1.filepath()));
+            CHECK_THROWS(d1.map<float>());
+
+            std::vector<float> val2(35);
+            d1.load_to(val2.data(), fortran_order, { 5, 7 });
+            CHECK(val2 == val1);
+            CHECK_THROWS(d1.load_to(val2.data(), !fortran_order, { 5, 7 }));
+            {
+                std::vector<double> val3(35);
+                d1.load_convert_to(val3.data(), fortran_order, { 5, 7 });
+                CHECK(std::equal(val3.begin(), val3.end(), val1.begin()));
+            }
+
+            // Element (i, j) of the array.
+            const auto at = [&](Size i, Size j) { return fortran_order ? i + 5 * j : j + 7 * i; };
+            {
+                std::vector<float> val3(4);
+                const auto region = d1.load_slice(val3.data(), { 1, 2 }, { 2, 2 }, { 3, 2 });
+                CHECK(region.shape == std::vector<Size> { 2, 2 });
+                const auto out = [&](Size i, Size j) { return fortran_order ? i + 2 * j : j + 2 * i; };
+                CHECK(val3[out(0, 0)] == val1[at(1, 2)]);
+                CHECK(val3[out(0, 1)] == val1[at(1, 4)]);
+                CHECK(val3[out(1, 0)] == val1[at(4, 2)]);
+                CHECK(val3[out(1, 1)] == val1[at(4, 4)]);
+            }
+
+            // In-place update of a region across chunk boundaries.
+            {
+                const std::vector<float> patch(6, -1.0f);
+                d1.save_region_from(patch.data(), { 1, 2 }, { 2, 3 });
+                d1.load_to(val2.data(), fortran_order, { 5, 7 });
+                CHECK(val2[at(1, 2)] == -1.0f);
+                CHECK(val2[at(2, 4)] == -1.0f);
+                CHECK(val2[at(0, 2)] == val1[at(0, 2)]);
+                CHECK(val2[at(1, 5)] == val1[at(1, 5)]);
+            }
+
+            // Single chunks. Missing chunks read as zeros.
+            {
+                std::vector<float> chunk(1 * 1);
+                d1.load_chunk({ 2, 2 }, chunk.data());
+                CHECK(chunk[0] == val1[at(4, 6)]);
+                std::filesystem::remove(pfile1 / name / "chunk.2.2.npy");
+                d1.load_chunk({ 2, 2 }, chunk.data());
+                CHECK(chunk[0] == 0.0f);
+                chunk[0] = 42.0f;
+                d1.save_chunk({ 2, 2 }, chunk.data());
+                d1.load_to(val2.data(), fortran_order, { 5, 7 });
+                CHECK(val2[at(4, 6)] == 42.0f);
+                CHECK_THROWS(d1.save_chunk({ 3, 0 }, chunk.data()));
+            }
+        }
+    }
+
+    SECTION("Filtered chunked dataset.") {
+        std::vector<std::int32_t> val1(6 * 5);
+        for (int i = 0; i < 30; ++i) {
+            val1[i] = i * 1000;
+        }
+        Json filters = Json::array({ core::shuffle_filter() });
+        for (const auto& extra : { core::zstd_filter(), core::lz4_filter() }) {
+            if (core::has_filter(extra["id"].get<std::string>())) {
+                filters.push_back(extra);
+            }
+        }
+        auto d1 = f1.create_chunked_dataset("d1", val1.data(), false, { 6, 5 }, { 4, 2 }, filters);
+        CHECK(d1.chunk_grid().filters == filters);
+        CHECK(std::filesystem::exists(pfile1 / "d1" / "chunk.1.2.bin"));
+        CHECK(!std::filesystem::exists(pfile1 / "d1" / "chunk.1.2.npy"));
+
+        std::vector<std::int32_t> val2(30);
+        f1.get_dataset("d1").load_to(val2.data(), false, { 6, 5 });
+        CHECK(val2 == val1);
+
+        std::vector<std::int32_t> val3(3 * 2);
+        d1.load_slice(val3.data(), { 1, 0 }, { 3, 2 }, { 2, 3 });
+        CHECK(val3 == std::vector<std::int32_t> { 5000, 8000, 15000, 18000, 25000, 28000 });
+
+        const std::vector<std::int32_t> patch { -1, -2, -3, -4 };
+        d1.save_region_from(patch.data(), { 3, 1 }, { 2, 2 });
+        d1.load_to(val2.data(), false, { 6, 5 });
+        CHECK(val2[16] == -1);
+        CHECK(val2[22] == -4);
+        CHECK(val2[15] == val1[15]);
+
+        std::filesystem::remove(pfile1 / "d1" / "chunk.0.0.bin");
+        d1.load_to(val2.data(), false, { 6, 5 });
+        CHECK(val2[0] == 0);
+        CHECK(val2[6] == 0);
+
+        CHECK_THROWS_AS(f1.create_chunked_dataset<std::int32_t>("d2", nullptr, false, { 2 }, { 1 }, Json::array({ Json { { "id", "unknown" } } })), NotImplementedError);
+    }
+
+    SECTION("Attribute handle.") {
+        auto g1 = f1.create_group("g1");
+        const auto jsonfile = pfile1 / "g1" / "attributes.json";
+        {
+            auto attrs = g1.attrs();
+            for (int i = 0; i < 10; ++i) {
+                attrs.set("key" + std::to_string(i), i);
+            }
+            CHECK(attrs.get<int>("key3") == 3);
+            CHECK(!std::filesystem::exists(jsonfile));
+            // Other handles and whole loads see the changes before they are written.
+            CHECK(f1.get_group("g1").attrs().contains("key9"));
+            CHECK(g1.load_attr()["key5"] == 5);
+            attrs.erase("key0");
+            CHECK(!attrs.contains("key0"));
+        }
+        CHECK(std::filesystem::exists(jsonfile));
+        CHECK(core::load_attr(core::Attribute { jsonfile }).size() == 9);
+
+        // Whole saves update open handles.
+        auto attrs = g1.attrs();
+        g1.save_attr({ { "a", 1 } });
+        CHECK(attrs.load() == Json { { "a", 1 } });
+
+        // Pending changes are written back when the file is closed.
+        attrs.set("b", 2);
+        f1.close();
+        CHECK(core::load_attr(core::Attribute { jsonfile }) == Json { { "a", 1 }, { "b", 2 } });
+        CHECK_THROWS(attrs.set("c", 3));
+    }
+
+    SECTION("Binary attributes.") {
+        const Json table = Json { { "calibration", std::vector<double>(1000, 0.25) }, { "name", "probe" } };
+        auto d1 = f1.create_dataset("d1", 1.0);
+        d1.save_attr(table);
+        CHECK(std::filesystem::exists(pfile1 / "d1" / "attributes.json"));
+
+        for (const auto encoding : { core::AttributeEncoding::Cbor, core::AttributeEncoding::MessagePack }) {
+            f1.set_attr_encoding(encoding);
+            d1.save_attr(table);
+            CHECK(std::filesystem::exists(pfile1 / "d1" / core::attribute_filename(encoding)));
+            CHECK(!std::filesystem::exists(pfile1 / "d1" / "attributes.json"));
+            CHECK(std::filesystem::file_size(pfile1 / "d1" / core::attribute_filename(encoding)) < table.dump().size());
+            CHECK(d1.load_attr() == table);
+        }
+
+        // Encoding is detected when reading with another default.
+        f1.set_attr_encoding(core::AttributeEncoding::Json);
+        CHECK(d1.load_attr() == table);
+        CHECK(d1.attrs().get<std::string>("name") == "probe");
+    }
+
+    SECTION("Raw node.") {
+        auto r1 = f1.create_raw("g1/r1");
+        CHECK(f1.get_group("g1").has_raw("r1"));
+        CHECK(!f1.has_dataset("g1/r1"));
+        CHECK_THROWS(r1.filepath("poppel.json"));
+        CHECK_THROWS(r1.filepath("sub/blob.bin"));
+
+        {
+            auto writer = r1.open_writer("blob.bin");
+            for (int i = 0; i < 1000; ++i) {
+                writer << "frame" << i << '\n';
+            }
+        }
+        r1.save_attr({ { "codec", "text" } });
+        CHECK(r1.list_files() == std::vector<std::string> { "blob.bin" });
+
+        const auto size = std::filesystem::file_size(r1.filepath("blob.bin"));
+        {
+            const auto mapped = r1.map("blob.bin");
+            REQUIRE(mapped.size() == static_cast<Size>(size));
+            CHECK(std::string_view(reinterpret_cast<const char*>(mapped.data()), 7) == "frame0\n");
+        }
+
+        // Import and export.
+        const auto external = temp_dir / "raw-interface-export.bin";
+        core::ScopeGuard external_guard { [&] { std::filesystem::remove(external); } };
+        r1.export_file("blob.bin", external);
+        CHECK(std::filesystem::file_size(external) == size);
+        auto r2 = f1.require_raw("r2");
+        r2.import_file(external, "copy.bin");
+        {
+            auto reader = r2.open_reader("copy.bin");
+            std::string line;
+            std::getline(reader, line);
+            CHECK(line == "frame0");
+        }
+        CHECK(r2.has_file("copy.bin"));
+        r2.delete_file("copy.bin");
+        CHECK(!r2.has_file("copy.bin"));
+        CHECK_THROWS(r2.delete_file("copy.bin"));
+    }
+
+    SECTION("Batch I/O.") {
+        f1.set_io_threads(3);
+        std::vector<std::vector<std::int32_t>> vals(20);
+        std::vector<SaveRequest> save_requests;
+        for (int i = 0; i < 20; ++i) {
+            vals[i].assign(i + 1, i);
+            save_requests.emplace_back("g" + std::to_string(i % 3) + "/d" + std::to_string(i), vals[i].data(), false, std::vector<Size> { i + 1 });
+        }
+        save_requests.emplace_back("/bad/path", vals[0].data(), false, std::vector<Size> { 1 });
+        auto save_futures = f1.save_many(std::move(save_requests));
+        REQUIRE(save_futures.size() == 21);
+        for (int i = 0; i < 20; ++i) {
+            CHECK_NOTHROW(save_futures[i].get());
+        }
+        CHECK_THROWS(save_futures[20].get());
+
+        std::vector<std::vector<std::int32_t>> vals2(20);
+        std::vector<LoadRequest> load_requests;
+        for (int i = 0; i < 20; ++i) {
+            vals2[i].resize(i + 1);
+            load_requests.emplace_back("g" + std::to_string(i % 3) + "/d" + std::to_string(i), vals2[i].data(), false, std::vector<Size> { i + 1 });
+        }
+        for (auto& future : f1.load_many(std::move(load_requests))) {
+            CHECK_NOTHROW(future.get());
+        }
+        CHECK(vals2 == vals);
+
+        auto array_futures = f1.get_group("g1").load_many({ "d1", "d4", "missing" });
+        const auto array = array_futures[1].get();
+        CHECK(array.header.shape == std::vector<Size> { 5 });
+        CHECK(array.data<std::int32_t>()[4] == 4);
+        CHECK_THROWS(array_futures[2].get());
+
+        // Truncated data fails instead of returning uninitialized bytes.
+        const auto d4path = f1.get_dataset("g1/d4").filepath();
+        std::filesystem::resize_file(d4path, std::filesystem::file_size(d4path) - 1);
+        CHECK_THROWS(f1.get_group("g1").load_many({ "d4" })[0].get());
+    }
+
+    SECTION("Atomic dataset writes.") {
+        const auto pfile2 = temp_dir / "file2-interface.poppel";
+        core::ScopeGuard file2_guard { [&] { std::filesystem::remove_all(pfile2); } };
+        const std::vector<std::int32_t> val1 { 1, 2, 3 };
+        const std::vector<std::int32_t> val2 { 4, 5, 6, 7 };
+
+        {
+            File f2(pfile2, File::Overwrite | File::Durable);
+            auto d1 = f2.create_dataset("g1/d1", val1);
+            f2.create_dataset("g1/d2", val1.data(), false, std::vector<Size> { 3 });
+            f2.commit();
+
+            // Replacing renames a new file, so that a link to the old file keeps the old data.
+            const auto old_link = pfile2 / "g1" / "d1" / "old.npy";
+            std::filesystem::create_hard_link(d1.filepath(), old_link);
+            d1.save_from(val2);
+            std::vector<std::int32_t> res;
+            core::load_to(res, old_link);
+            CHECK(res == val1);
+            d1.load_to(res);
+            CHECK(res == val2);
+            std::filesystem::remove(old_link);
+
+            // No temporary file is left behind.
+            for (const auto& entry : std::filesystem::directory_iterator(pfile2 / "g1" / "d1")) {
+                CHECK(entry.path().filename().string().rfind(".data.npy.tmp", 0) == std::string::npos);
+            }
+            f2.get_dataset("g1/d2").save_from(val2.data(), val2.size());
+
+            // Chunk files are replaced as well.
+            auto c1 = f2.create_chunked_dataset("c1", val1.data(), false, { 3 }, { 2 });
+            const auto old_chunk = pfile2 / "old-chunk.npy";
+            std::filesystem::create_hard_link(pfile2 / "c1" / "chunk.0.npy", old_chunk);
+            c1.save_chunk({ 0 }, val2.data());
+            c1.save_region_from(val2.data(), { 1 }, { 2 });
+            std::vector<std::int32_t> chunk(2);
+            core::load_to(chunk.data(), false, std::vector<Size> { 2 }, old_chunk, false);
+            CHECK(chunk == std::vector<std::int32_t> { 1, 2 });
+            std::filesystem::remove(old_chunk);
+            for (const auto& entry : std::filesystem::directory_iterator(pfile2 / "c1")) {
+                CHECK_FALSE(core::is_temp_file_path(entry.path()));
+            }
+        }
+
+        File f2(pfile2, File::ReadOnly);
+        std::vector<std::int32_t> res;
+        f2.get_dataset("g1/d2").load_to(res);
+        CHECK(res == val2);
+    }
+
+    SECTION("I/O backends.") {
+        // Sizes around the header probe and the transfer block, and not a multiple of the alignment.
+        for (const Size size : { Size(0), Size(1), Size(100000), Size((9 << 20) + 3) }) {
+            std::vector<std::uint8_t> val(size);
+            for (Size i = 0; i < size; ++i) {
+                val[i] = static_cast<std::uint8_t>(i * 7);
+            }
+            for (const auto backend : { core::IoBackend::Posix, core::IoBackend::Direct }) {
+                f1.set_io_backend(backend);
+                auto d1 = f1.require_dataset("d1", val.data(), size);
+                d1.save_from(val.data(), size);
+                std::vector<std::uint8_t> res(size);
+                d1.load_to(res.data(), size);
+                CHECK(res == val);
+                CHECK_THROWS(d1.load_to(res.data(), size + 1));
+
+                // Readable by the stream backend.
+                f1.set_io_backend(core::IoBackend::Stream);
+                std::vector<std::uint8_t> res2;
+                d1.load_to(res2);
+                CHECK(res2 == val);
+            }
+        }
+    }
+
+    SECTION("Node iteration.") {
+        const std::vector<std::int32_t> val { 1, 2, 3, 4, 5, 6 };
+        f1.create_dataset("d1", val.data(), false, std::vector<Size> { 2, 3 });
+        f1.create_group("g1");
+        f1.create_raw("g1/r1");
+        f1.create_chunked_dataset("g1/g2/d2", val.data(), false, std::vector<Size> { 6 }, std::vector<Size> { 4 });
+        // Not a node.
+        std::filesystem::create_directories(pfile1 / "g1" / "misc");
+
+        const auto children = f1.children();
+        REQUIRE(children.size() == 2);
+        CHECK(children[0].relpath == "d1");
+        CHECK(children[0].meta.type == core::NodeType::Dataset);
+        CHECK(!children[0].header);
+        CHECK(children[1].relpath == "g1");
+        CHECK(children[1].meta.type == core::NodeType::Group);
+
+        for (const bool cache : { false, true }) {
+            File f2(pfile1, cache ? File::ReadOnly | File::CacheMeta : File::ReadOnly);
+            std::vector<core::NodeEntry> entries;
+            f2.visit([&](const core::NodeEntry& entry) { entries.push_back(entry); }, true, true);
+            REQUIRE(entries.size() == 5);
+            CHECK(entries[0].header->shape == std::vector<Size> { 2, 3 });
+            CHECK(entries[2].relpath == std::filesystem::path("g1") / "g2");
+            CHECK(entries[3].relpath == std::filesystem::path("g1") / "r1");
+            CHECK(entries[3].meta.type == core::NodeType::Raw);
+            CHECK(entries[4].relpath == std::filesystem::path("g1") / "g2" / "d2");
+            CHECK(entries[4].meta.layout == core::DatasetLayout::Chunked);
+            CHECK(entries[4].header->shape == std::vector<Size> { 6 });
+        }
+
+        CHECK(f1.get_group("g1").children().size() == 2);
+    }
+
+    SECTION("Consolidated manifest.") {
+        const std::vector<std::int32_t> val { 1, 2, 3, 4, 5, 6 };
+        const auto pfile2 = temp_dir / "file2-interface.poppel";
+        core::ScopeGuard file2_guard { [&] { std::filesystem::remove_all(pfile2); } };
+        {
+            File f2(pfile2, File::Overwrite | File::Consolidated);
+            f2.create_dataset("g1/d1", val.data(), false, std::vector<Size> { 2, 3 }).save_attr({ { "unit", "m" } });
+            f2.create_chunked_dataset("g1/d2", val.data(), false, std::vector<Size> { 6 }, std::vector<Size> { 4 });
+            f2.create_raw("r1");
+            f2.save_attr({ { "title", "run" } });
+        }
+        REQUIRE(std::filesystem::exists(core::manifest_path(pfile2)));
+
+        // Lookups are answered by the manifest only.
+        std::filesystem::remove(pfile2 / "g1" / "poppel.json");
+        {
+            File f2(pfile2, File::ReadOnly | File::Consolidated);
+            CHECK(f2.has_group("g1"));
+            CHECK(!f2.has_group("g2"));
+            CHECK(!f2.has_dataset("g1/d3"));
+            CHECK(f2.has_raw("r1"));
+            auto d1 = f2.get_dataset("g1/d1");
+            CHECK(d1.load_npy_header().shape == std::vector<Size> { 2, 3 });
+            CHECK(d1.load_attr()["unit"] == "m");
+            CHECK(f2.get_dataset("g1/d2").load_npy_header().shape == std::vector<Size> { 6 });
+            CHECK(f2.attrs().get<std::string>("title") == "run");
+            std::vector<std::int32_t> res(6);
+            d1.load_to(res.data(), false, std::vector<Size> { 2, 3 });
+            CHECK(res == val);
+        }
+
+        // Without the flag, the file system is used.
+        CHECK_THROWS(File(pfile2, File::ReadOnly).has_group("g1"));
+
+        // Opening for writing removes the manifest.
+        File(pfile2, File::ReadWrite);
+        CHECK(!std::filesystem::exists(core::manifest_path(pfile2)));
+    }
+
+    SECTION("I/O statistics.") {
+        CHECK(f1.stats() == nullptr);
+        f1.enable_stats();
+        std::vector<core::Operation> traced;
+        f1.set_tracer([&](core::Operation op, const std::filesystem::path&, std::chrono::nanoseconds, std::uint64_t) {
+            traced.push_back(op);
+        });
+
+        const std::vector<std::int32_t> val { 1, 2, 3, 4, 5, 6 };
+        auto d1 = f1.create_dataset("g1/d1", val.data(), val.size());
+        std::vector<std::int32_t> res(6);
+        f1.get_dataset("g1/d1").load_to(res.data(), res.size());
+        d1.save_attr({ { "unit", "m" } });
+        d1.load_attr();
+        f1.create_chunked_dataset("d2", val.data(), false, std::vector<Size> { 6 }, std::vector<Size> { 4 });
+
+        const auto& stats = *f1.stats();
+        CHECK(stats.bytes_written == 48);
+        CHECK(stats.bytes_read == 24);
+        CHECK(stats.attr_rewrites == 1);
+        CHECK(stats.meta_parses >= 2);
+        CHECK(stats.stat_calls >= 2);
+        CHECK(stats.latency(core::Operation::DatasetSave).count == 2);
+        CHECK(stats.latency(core::Operation::DatasetLoad).count == 1);
+        CHECK(stats.latency(core::Operation::NodeLookup).count == 1);
+        CHECK(stats.latency(core::Operation::AttrLoad).quantile_ns(0.5) > 0);
+        CHECK(stats.to_json()["latencies"]["attr_save"]["count"] == 1);
+        CHECK(std::count(traced.begin(), traced.end(), core::Operation::DatasetSave) == 2);
+
+        f1.stats()->reset();
+        CHECK(stats.files_opened == 0);
+        f1.set_tracer({});
+        f1.enable_stats(false);
+        CHECK(f1.stats() == nullptr);
+    }
+
+    SECTION("Index order conversion.") {
+        // 2 x 3 matrix in both orders.
+        const std::vector<double> cval { 1, 2, 3, 4, 5, 6 };
+        const std::vector<double> fval { 1, 4, 2, 5, 3, 6 };
+        auto d1 = f1.create_dataset("d1", fval.data(), true, std::vector<Size> { 2, 3 });
+        std::vector<double> res(6);
+        CHECK_THROWS(d1.load_to(res.data(), false, std::vector<Size> { 2, 3 }));
+        d1.load_order_to(res.data(), false, std::vector<Size> { 2, 3 });
+        CHECK(res == cval);
+
+        d1.save_order_from(cval.data(), false, std::vector<Size> { 2, 3 }, true);
+        CHECK(d1.load_npy_header().fortran_order);
+        d1.load_to(res.data(), true, std::vector<Size> { 2, 3 });
+        CHECK(res == fval);
+
+        auto d2 = f1.create_chunked_dataset("d2", cval.data(), false, std::vector<Size> { 2, 3 }, std::vector<Size> { 1, 2 });
+        d2.load_order_to(res.data(), true, std::vector<Size> { 2, 3 });
+        CHECK(res == fval);
+        d2.save_order_from(res.data(), true, std::vector<Size> { 2, 3 }, true);
+        d2.load_to(res.data(), false, std::vector<Size> { 2, 3 });
+        CHECK(res == cval);
+    }
+
+    SECTION("File handle pool.") {
+        f1.set_handle_pool_size(2);
+        f1.enable_stats();
+        const std::vector<float> val { 1, 2, 3, 4, 5, 6 };
+        auto d1 = f1.create_dataset("d1", val.data(), false, std::vector<Size> { 2, 3 });
+        auto d2 = f1.create_dataset("d2", val.data(), false, std::vector<Size> { 6 });
+        auto d3 = f1.create_dataset("d3", val.data(), false, std::vector<Size> { 3, 2 });
+
+        // Repeated loads open the file once.
+        std::vector<float> res(6);
+        auto& files_opened = f1.stats()->files_opened;
+        files_opened = 0;
+        for (int i = 0; i < 3; ++i) {
+            d1.load_to(res.data(), false, std::vector<Size> { 2, 3 });
+        }
+        CHECK(res == val);
+        CHECK(d1.load_npy_header().shape == std::vector<Size> { 2, 3 });
+        std::vector<float> col(2);
+        d1.load_slice(col.data(), std::vector<Size> { 0, 1 }, std::vector<Size> { 2, 1 });
+        CHECK(col == std::vector<float> { 2, 5 });
+        CHECK(files_opened == 1);
+        CHECK_THROWS(d1.load_to(res.data(), false, std::vector<Size> { 3, 2 }));
+
+        // Least recently used handles are closed beyond the limit.
+        d2.load_to(res.data(), 6);
+        d3.load_to(res.data(), false, std::vector<Size> { 3, 2 });
+        CHECK(files_opened == 3);
+        d1.load_to(res.data(), false, std::vector<Size> { 2, 3 });
+        CHECK(files_opened == 4);
+
+        // Writes invalidate the handle.
+        const std::vector<float> val2 { 6, 5, 4, 3, 2, 1 };
+        d1.save_from(val2.data(), false, std::vector<Size> { 3, 2 });
+        d1.load_to(res.data(), false, std::vector<Size> { 3, 2 });
+        CHECK(res == val2);
+
+        // Appending is detected by the file size.
+        auto d4 = f1.create_appendable_dataset("d4", val.data(), false, std::vector<Size> { 6 });
+        d4.load_to(res.data(), 6);
+        d4.append_from(val2.data(), 6);
+        std::vector<float> res2(12);
+        d4.load_to(res2.data(), 12);
+        CHECK(res2[6] == 6.0f);
+
+        // Concurrent readers share the handle.
+        std::vector<std::thread> threads;
+        std::atomic<int> mismatches { 0 };
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&] {
+                std::vector<float> local(6);
+                for (int i = 0; i < 50; ++i) {
+                    d3.load_to(local.data(), false, std::vector<Size> { 3, 2 });
+                    mismatches += (local != val);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        CHECK(mismatches == 0);
+
+        f1.set_handle_pool_size(0);
+        d1.load_to(res.data(), false, std::vector<Size> { 3, 2 });
+        CHECK(res == val2);
+    }
+
+    SECTION("Typed datasets.") {
+        const std::vector<float> val { 1, 2, 3, 4, 5, 6 };
+        f1.create_dataset("d1", val.data(), false, std::vector<Size> { 2, 3 });
+        f1.create_chunked_dataset("d2", val.data(), true, std::vector<Size> { 3, 2 }, std::vector<Size> { 2, 2 });
+
+        auto d1 = f1.get_dataset<float, 2>("d1");
+        CHECK(d1.shape() == std::array<Size, 2> { 2, 3 });
+        CHECK(d1.length() == 6);
+        CHECK_FALSE(d1.fortran_order());
+        CHECK_THROWS(f1.get_dataset<double, 2>("d1"));
+        CHECK_THROWS(f1.get_dataset<float, 1>("d1"));
+        CHECK_THROWS(f1.get_dataset<float, 2>("missing"));
+
+        std::vector<float> res(6);
+        d1.load(res.data());
+        CHECK(res == val);
+        std::vector<float> col(2);
+        d1.load_slice(col.data(), { 0, 2 }, { 2, 1 });
+        CHECK(col == std::vector<float> { 3, 6 });
+        d1.load_slice(col.data(), { 1, 0 }, { 1, 2 }, { 1, 2 });
+        CHECK(col == std::vector<float> { 4, 6 });
+
+        const std::vector<float> val2 { 6, 5, 4, 3, 2, 1 };
+        d1.save(val2.data());
+        f1.get_dataset("d1").load_to(res.data(), false, std::vector<Size> { 2, 3 });
+        CHECK(res == val2);
+
+        // Chunked datasets, through the same interface.
+        auto d2 = f1.get_dataset<float, 2>("d2");
+        CHECK(d2.fortran_order());
+        d2.load(res.data());
+        CHECK(res == val);
+        d2.load_slice(col.data(), { 2, 0 }, { 1, 2 });
+        CHECK(col == std::vector<float> { 3, 6 });
+        CHECK(d2.dataset().is_chunked());
+    }
+
+    SECTION("Striped transfer.") {
+        f1.set_io_threads(3);
+        f1.set_stripe_size(4096);
+        std::vector<std::int32_t> val(100000);
+        for (std::size_t i = 0; i < val.size(); ++i) {
+            val[i] = static_cast<std::int32_t>(i * 7 - 3);
+        }
+        auto d1 = f1.create_dataset("d1", val.data(), false, std::vector<Size> { 250, 400 });
+
+        // The file format does not change.
+        std::vector<std::int32_t> res(val.size());
+        npy::load(d1.filepath(), npy::create_header<std::int32_t>(false, { 250, 400 }), reinterpret_cast<std::byte*>(res.data()), false);
+        CHECK(res == val);
+        std::fill(res.begin(), res.end(), 0);
+        d1.load_to(res.data(), false, std::vector<Size> { 250, 400 });
+        CHECK(res == val);
+        d1.load_to(res.data(), true, std::vector<Size> { 400, 250 }, true);
+        CHECK(res == val);
+        CHECK_THROWS(d1.load_to(res.data(), false, std::vector<Size> { 400, 250 }));
+
+        // Truncated files are detected.
+        std::filesystem::resize_file(d1.filepath(), std::filesystem::file_size(d1.filepath()) - 1);
+        CHECK_THROWS(d1.load_to(res.data(), false, std::vector<Size> { 250, 400 }));
+
+        // Small datasets are transferred at once.
+        const std::vector<std::int32_t> small { 1, 2, 3 };
+        auto d2 = f1.create_dataset("d2", small.data(), false, std::vector<Size> { 3 });
+        std::vector<std::int32_t> small_res(3);
+        d2.load_to(small_res.data(), 3);
+        CHECK(small_res == small);
+    }
+
+    SECTION("Sharded datasets.") {
+        // 5 x 7 array in 2 x 3 blocks, as written by six processes.
+        const auto shards = core::block_shards({ 5, 7 }, { 2, 3 });
+        REQUIRE(shards.size() == 6);
+        CHECK(shards[0].offset == std::vector<Size> { 0, 0 });
+        CHECK(shards[0].shape == std::vector<Size> { 3, 3 });
+        CHECK(shards[5].offset == std::vector<Size> { 3, 5 });
+        CHECK(shards[5].shape == std::vector<Size> { 2, 2 });
+        CHECK_THROWS(f1.create_sharded_dataset<std::int32_t>("bad", false, { 5, 7 }, { core::Shard { { 0, 0 }, { 3, 3 } }, core::Shard { { 2, 2 }, { 3, 3 } } }));
+        CHECK_THROWS(f1.create_sharded_dataset<std::int32_t>("bad", false, { 5, 7 }, { core::Shard { { 3, 0 }, { 3, 3 } } }));
+
+        std::vector<std::int32_t> val(35);
+        for (std::size_t i = 0; i < val.size(); ++i) {
+            val[i] = static_cast<std::int32_t>(i);
+        }
+        auto d1 = f1.create_sharded_dataset<std::int32_t>("d1", false, { 5, 7 }, shards);
+        CHECK(d1.is_sharded());
+        CHECK(d1.load_npy_header().shape == std::vector<Size> { 5, 7 });
+
+        // Each writer saves only its own block. Unwritten shards are zeros.
+        {
+            File f2(pfile1, File::ReadWrite);
+            auto writer = f2.get_dataset("d1");
+            for (Size s = 0; s < 5; ++s) {
+                std::vector<std::int32_t> block(shards[s].length());
+                for (Size i = 0; i < shards[s].shape[0]; ++i) {
+                    for (Size j = 0; j < shards[s].shape[1]; ++j) {
+                        block[i * shards[s].shape[1] + j] = val[(shards[s].offset[0] + i) * 7 + shards[s].offset[1] + j];
+                    }
+                }
+                writer.save_shard(s, block.data());
+            }
+            CHECK_THROWS(writer.save_shard(6, val.data()));
+            CHECK_THROWS(writer.save_shard(0, std::vector<float>(9).data()));
+        }
+        std::vector<std::int32_t> res(35);
+        d1.load_to(res.data(), false, std::vector<Size> { 5, 7 });
+        CHECK(res[0] == 0);
+        CHECK(res[25] == 25);
+        CHECK(res[26] == 0);
+        CHECK(res[34] == 0);
+        std::vector<std::int32_t> block(4);
+        d1.load_shard(5, block.data());
+        CHECK(block == std::vector<std::int32_t>(4, 0));
+
+        // Whole saves write all shards, and slices cross shard boundaries.
+        d1.save_from(val.data(), false, std::vector<Size> { 5, 7 });
+        d1.load_to(res.data(), false, std::vector<Size> { 5, 7 });
+        CHECK(res == val);
+        std::vector<std::int32_t> slice(6);
+        d1.load_slice(slice.data(), { 1, 2 }, { 3, 2 }, { 1, 2 });
+        CHECK(slice == std::vector<std::int32_t> { 9, 11, 16, 18, 23, 25 });
+        CHECK_THROWS(d1.map<std::int32_t>());
+        CHECK_THROWS(d1.load_convert_to(std::vector<double>(35).data(), false, std::vector<Size> { 5, 7 }));
+
+        // Listed with the whole header.
+        const auto children = f1.children(true);
+        const auto it = std::find_if(children.begin(), children.end(), [](const core::NodeEntry& e) { return e.relpath == "d1"; });
+        REQUIRE(it != children.end());
+        CHECK(it->meta.layout == core::DatasetLayout::Sharded);
+        CHECK(it->header->shape == std::vector<Size> { 5, 7 });
+
+        // Atomic writes replace shard files, so that a link to the old file keeps the old data.
+        {
+            const auto old_link = temp_dir / "old-shard-interface.npy";
+            core::ScopeGuard link_guard { [&] { std::filesystem::remove(old_link); } };
+            std::filesystem::create_hard_link(pfile1 / "d1" / "shard.0.npy", old_link);
+            File f2(pfile1, File::ReadWrite | File::Atomic);
+            auto writer = f2.get_dataset("d1");
+            writer.save_shard(0, std::vector<std::int32_t>(shards[0].length(), -1).data());
+            std::vector<std::int32_t> old_block(shards[0].length());
+            core::load_to(old_block.data(), false, shards[0].shape, old_link, false);
+            CHECK(old_block[0] == 0);
+            writer.save_from(val.data(), false, std::vector<Size> { 5, 7 });
+            CHECK(std::filesystem::hard_link_count(old_link) == 1);
+            core::load_to(old_block.data(), false, shards[0].shape, old_link, false);
+            CHECK(old_block[0] == 0);
+        }
+    }
+
+    SECTION("Batch creation.") {
+        f1.create_group("g1");
+        std::vector<std::vector<std::int32_t>> vals;
+        for (std::int32_t i = 0; i < 40; ++i) {
+            vals.push_back({ i, i + 1, i + 2 });
+        }
+
+        auto batch = f1.batch();
+        for (std::size_t i = 0; i < vals.size(); ++i) {
+            batch.create_dataset("g1/a/d" + std::to_string(i), vals[i].data(), false, { 3 });
+        }
+        batch.create_group("g2/b/c").create_raw("g2/r").create_group("g1/a/e");
+        CHECK(batch.size() == 43);
+        batch.run();
+        CHECK(batch.size() == 0);
+
+        CHECK(f1.has_group("g1/a"));
+        CHECK(f1.has_group("g2/b/c"));
+        CHECK(f1.has_raw("g2/r"));
+        CHECK(f1.get_group("g1/a").children().size() == 41);
+        std::vector<std::int32_t> res(3);
+        f1.get_dataset("g1/a/d17").load_to(res.data(), false, std::vector<Size> { 3 });
+        CHECK(res == vals[17]);
+        // Written metadata is read back by other instances.
+        {
+            File f2(pfile1, File::Read);
+            CHECK(f2.has_dataset("g1/a/d39"));
+            CHECK(f2.has_group("g2/b"));
+        }
+
+        // Conflicts and existing names fail before any change.
+        CHECK_THROWS(f1.batch().create_group("g3").create_dataset("g3/x/y", vals[0].data(), false, { 3 }).create_raw("g3/x").run());
+        CHECK_THROWS(f1.batch().create_group("g4").create_group("g4").run());
+        CHECK_THROWS(f1.batch().create_group("g5").create_group("g1/a/d0/x").run());
+        CHECK_THROWS(f1.batch().create_group("g6").create_group("g2/b").run());
+        CHECK_FALSE(f1.has_group("g3"));
+        CHECK_FALSE(f1.has_group("g4"));
+        CHECK_FALSE(f1.has_group("g5"));
+        CHECK_FALSE(f1.has_group("g6"));
+    }
+
+    SECTION("Prefetching.") {
+        for (std::int32_t i = 0; i < 12; ++i) {
+            const std::vector<std::int32_t> val { i, i * 10 };
+            f1.create_dataset("run/" + std::to_string(100 + i), val.data(), false, std::vector<Size> { 2 });
+        }
+        f1.create_group("run/sub");
+
+        // Child datasets in name order, with buffers reused.
+        auto reader = f1.get_group("run").prefetch(3);
+        CHECK(reader.size() == 12);
+        for (std::int32_t i = 0; i < 12; ++i) {
+            CHECK(reader.position() == static_cast<std::size_t>(i));
+            auto array = reader.next();
+            CHECK(array.header.shape == std::vector<Size> { 2 });
+            CHECK(array.data<std::int32_t>()[1] == i * 10);
+            reader.recycle(std::move(array));
+        }
+        CHECK(reader.done());
+        CHECK_THROWS(reader.next());
+
+        // Failed items do not stop the following ones.
+        auto planned = f1.prefetch({ PrefetchItem("run/105"), PrefetchItem("run/none"), PrefetchItem("run/100", { 1 }, { 1 }) }, 2);
+        CHECK(planned.next().data<std::int32_t>()[0] == 5);
+        CHECK_THROWS(planned.next());
+        const auto slab = planned.next();
+        CHECK(slab.header.shape == std::vector<Size> { 1 });
+        CHECK(slab.data<std::int32_t>()[0] == 0);
+
+        // Slabs of one dataset from start to end.
+        std::vector<std::int32_t> val(7 * 3);
+        for (std::size_t i = 0; i < val.size(); ++i) {
+            val[i] = static_cast<std::int32_t>(i);
+        }
+        f1.create_dataset("series", val.data(), false, std::vector<Size> { 7, 3 });
+        const auto plan = Prefetcher::slab_plan("series", { 7, 3 }, 3);
+        REQUIRE(plan.size() == 3);
+        auto slabs = f1.prefetch(plan);
+        std::vector<std::int32_t> res;
+        while (!slabs.done()) {
+            const auto array = slabs.next();
+            res.insert(res.end(), array.data<std::int32_t>(), array.data<std::int32_t>() + array.header.numbytes() / 4);
+        }
+        CHECK(res == val);
+        CHECK_THROWS(Prefetcher::slab_plan("series", {}, 3));
+    }
+
+    SECTION("Header index.") {
+        const std::vector<float> val(6);
+        for (int i = 0; i < 5; ++i) {
+            f1.create_dataset("h/d" + std::to_string(i), val.data(), false, std::vector<Size> { 2, 3 });
+        }
+        f1.close();
+        {
+            File f2(pfile1, File::ReadWrite | File::Consolidated);
+        }
+
+        // Seeded from the manifest, so that listing and headers open no data files.
+        File f3(pfile1, File::ReadOnly | File::IndexHeaders);
+        f3.enable_stats();
+        const auto& stats = *f3.stats();
+        const auto children = f3.get_group("h").children(true);
+        REQUIRE(children.size() == 5);
+        CHECK(children[2].header->shape == std::vector<Size> { 2, 3 });
+        // Only poppel.json files were opened.
+        CHECK(stats.files_opened == stats.meta_parses);
+        auto d4 = f3.get_dataset("h/d4");
+        auto d1 = f3.get_dataset("h/d1");
+        f3.stats()->reset();
+        CHECK(d4.load_npy_header().dtype == npy::internal::dtype(float{}));
+        CHECK(stats.files_opened == 0);
+
+        // Changed files are read again.
+        {
+            File f4(pfile1, File::ReadWrite);
+            const std::vector<float> longer(8);
+            f4.get_dataset("h/d1").save_from(longer.data(), false, std::vector<Size> { 8 });
+        }
+        CHECK(d1.load_npy_header().shape == std::vector<Size> { 8 });
+        CHECK(stats.files_opened == 1);
+        CHECK(d1.load_npy_header().shape == std::vector<Size> { 8 });
+        CHECK(stats.files_opened == 1);
+
+        // Writes through the same file update the index.
+        File f5(pfile1, File::ReadWrite | File::IndexHeaders);
+        auto d0 = f5.get_dataset("h/d0");
+        CHECK(d0.load_npy_header().shape == std::vector<Size> { 2, 3 });
+        d0.save_from(val.data(), false, std::vector<Size> { 3, 2 });
+        CHECK(d0.load_npy_header().shape == std::vector<Size> { 3, 2 });
+        f5.delete_dataset("h/d2");
+        CHECK_THROWS(f3.get_dataset("h/d2"));
+    }
+
+    SECTION("Strided saves.") {
+        std::vector<double> mat(4 * 5);
+        for (std::size_t i = 0; i < mat.size(); ++i) {
+            mat[i] = static_cast<double>(i);
+        }
+        // Column block of a row major matrix.
+        auto d1 = f1.create_dataset("d1", mat.data() + 1, false, std::vector<Size> { 4, 2 }, std::vector<std::ptrdiff_t> { 5, 1 });
+        std::vector<double> res(8);
+        d1.load_to(res.data(), false, std::vector<Size> { 4, 2 });
+        CHECK(res == std::vector<double> { 1, 2, 6, 7, 11, 12, 16, 17 });
+
+        auto chunked = f1.create_chunked_dataset<double>("c1", nullptr, false, { 4, 2 }, { 2, 2 });
+        CHECK_THROWS(chunked.save_from(mat.data(), false, std::vector<Size> { 4, 2 }, std::vector<std::ptrdiff_t> { 5, 1 }));
+    }
+
+    SECTION("Checksums.") {
+        f1.close();
+        File f2(pfile1, File::CreateWrite | File::Checksums);
+        std::vector<std::int64_t> val(1000);
+        for (std::size_t i = 0; i < val.size(); ++i) {
+            val[i] = static_cast<std::int64_t>(i * i);
+        }
+        auto d1 = f2.create_dataset("g/d1", val.data(), false, std::vector<Size> { 1000 });
+        auto d2 = f2.create_dataset("g/d2", std::vector<float> { 1, 2, 3 });
+        auto d3 = f2.create_appendable_dataset("d3", val.data(), false, std::vector<Size> { 10, 100 });
+        d3.append_from(val.data(), 2);
+        // Appends extend the recorded checksum.
+        for (int i = 0; i < 3; ++i) {
+            d3.append_from(val.data() + 100 * i, 1);
+        }
+        CHECK(core::read_node_json(d3.filepath().parent_path())["checksum"]["value"] == core::npy_data_checksum(d3.filepath()));
+        CHECK(core::read_node_json(d1.filepath().parent_path()).contains("checksum"));
+        CHECK(core::read_node_json(d2.filepath().parent_path()).contains("checksum"));
+        CHECK(f2.verify().empty());
+
+        std::vector<std::int64_t> res(1000);
+        d1.load_to(res.data(), false, std::vector<Size> { 1000 });
+        CHECK(res == val);
+
+        // Corrupt one byte of the data.
+        {
+            std::fstream fs(d1.filepath(), std::ios::in | std::ios::out | std::ios::binary);
+            fs.seekp(-3, std::ios::end);
+            fs.put('x');
+        }
+        CHECK(f2.verify() == std::vector<std::filesystem::path> { "g/d1" });
+        CHECK_THROWS(d1.load_to(res.data(), false, std::vector<Size> { 1000 }));
+
+        // Saves record the new checksum, and saves without checksums remove it.
+        d1.save_from(val.data(), false, std::vector<Size> { 1000 });
+        CHECK(f2.verify().empty());
+
+        // Checksums computed while writing match the written file on every save path.
+        const auto checksum_recorded = [&] {
+            return core::read_node_json(d1.filepath().parent_path())["checksum"]["value"] == core::npy_data_checksum(d1.filepath());
+        };
+        for (const auto backend : { core::IoBackend::Stream, core::IoBackend::Posix, core::IoBackend::Direct }) {
+            f2.set_io_backend(backend);
+            d1.save_from(val.data(), false, std::vector<Size> { 1000 });
+            CHECK(checksum_recorded());
+        }
+        f2.set_io_backend(core::IoBackend::Stream);
+        f2.set_stripe_size(1000);
+        d1.save_from(val.data(), false, std::vector<Size> { 1000 });
+        CHECK(checksum_recorded());
+        f2.set_stripe_size(0);
+        d1.save_order_from(val.data(), false, std::vector<Size> { 10, 100 }, true);
+        CHECK(checksum_recorded());
+        d1.save_from(val);
+        CHECK(checksum_recorded());
+        d1.save_from(std::int64_t { 7 });
+        CHECK(checksum_recorded());
+        d1.save_from(std::string("checksum"));
+        CHECK(checksum_recorded());
+        d3.save_appendable_from(val.data(), false, std::vector<Size> { 10, 100 });
+        CHECK(core::read_node_json(d3.filepath().parent_path())["checksum"]["value"] == core::npy_data_checksum(d3.filepath()));
+        d1.save_from(val.data(), false, std::vector<Size> { 1000 });
+        f2.close();
+        File f3(pfile1, File::ReadWrite);
+        f3.get_dataset("g/d1").save_from(val.data(), false, std::vector<Size> { 500 });
+        CHECK_FALSE(core::read_node_json(d1.filepath().parent_path()).contains("checksum"));
+        CHECK(f3.verify().empty());
+        f3.close();
+
+        // Datasets listed in a consolidated manifest keep their checksums.
+        File(pfile1, File::ReadWrite | File::Consolidated).close();
+        {
+            std::fstream fs(d2.filepath(), std::ios::in | std::ios::out | std::ios::binary);
+            fs.seekp(-1, std::ios::end);
+            fs.put('x');
+        }
+        CHECK(File(pfile1, File::ReadOnly | File::Checksums).verify() == std::vector<std::filesystem::path> { "g/d2" });
+        CHECK(File(pfile1, File::ReadOnly | File::Checksums | File::Consolidated).verify() == std::vector<std::filesystem::path> { "g/d2" });
+    }
+
+    SECTION("Copying.") {
+        const auto pfile2 = temp_dir / "file2-interface.poppel";
+        core::ScopeGuard file2_guard { [&] { std::filesystem::remove_all(pfile2); } };
+        const std::vector<std::int32_t> val1 { 1, 2, 3 };
+        const std::vector<float> val2(100000, 1.5f);
+        auto g1 = f1.create_group("g1");
+        g1.save_attr(Json { { "a", 1 } });
+        g1.create_dataset("d1", val1);
+        g1.create_dataset("g2/d2", val2);
+        // Files placed directly, such as hidden files of raw nodes, are copied, but temporary files of atomic writes are not.
+        g1.create_raw("r1");
+        std::ofstream(pfile1 / "g1" / "r1" / ".keep") << "kept";
+        std::ofstream(pfile1 / "g1" / "d1" / ".data.npy.tmp12") << "partial";
+        const std::vector<std::int32_t> val3(6 * 6, 1);
+        g1.create_chunked_dataset("c1", val3.data(), false, { 6, 6 }, { 3, 3 });
+        g1.create_appendable_dataset("a1", val1.data(), false, std::vector<Size> { 3 });
+        // 🗂️ f1 (File)
+        // └─ 📂 g1
+        //    ├─ 🔢 a1
+        //    ├─ 🔢 c1
+        //    ├─ 🔢 d1
+        //    ├─ 📂 g2
+        //    │  └─ 🔢 d2
+        //    └─ 📄 r1
+
+        // Within the file.
+        auto g3 = g1.copy_to(f1.root(), "g3");
+        CHECK(g3.load_attr() == Json { { "a", 1 } });
+        std::vector<std::int32_t> res1;
+        g3.get_dataset("d1").load_to(res1);
+        CHECK(res1 == val1);
+        std::vector<float> res2;
+        g3.get_dataset("g2/d2").load_to(res2);
+        CHECK(res2 == val2);
+        CHECK(std::filesystem::exists(pfile1 / "g3" / "r1" / ".keep"));
+        CHECK_FALSE(std::filesystem::exists(pfile1 / "g3" / "d1" / ".data.npy.tmp12"));
+        CHECK_THROWS(g1.copy_to(f1.root(), "g3"));
+        CHECK_THROWS(g1.copy_to(g1, "g4"));
+        CHECK_THROWS(f1.copy("g5", f1.root(), "g6"));
+
+        // Across files, without child groups, and with linked data.
+        {
+            File f2(pfile2, File::Overwrite | File::Durable | File::Atomic);
+            auto g4 = g1.copy_to(f2.root(), "a/g4", false, true);
+            CHECK(g4.has_dataset("d1"));
+            CHECK_FALSE(g4.has_group("g2"));
+            CHECK(std::filesystem::hard_link_count(g4.get_dataset("d1").filepath()) == 2);
+            CHECK(std::filesystem::hard_link_count(pfile2 / "a" / "g4" / "poppel.json") == 1);
+            f1.copy("g1/g2/d2", f2.root(), "d2");
+            f2.get_dataset("d2").load_to(res2);
+            CHECK(res2 == val2);
+
+            // Atomic writes replace the linked file, so that the source keeps its data.
+            g4.get_dataset("d1").save_from(std::vector<std::int32_t> { 4, 5 });
+            g1.get_dataset("d1").load_to(res1);
+            CHECK(res1 == val1);
+
+            // Writes in place give the copy its own file first.
+            CHECK(std::filesystem::hard_link_count(g4.get_dataset("a1").filepath()) == 2);
+            g4.get_dataset("a1").append_from(val1.data(), 2);
+            g1.get_dataset("a1").load_to(res1);
+            CHECK(res1 == val1);
+            g4.get_dataset("a1").load_to(res1);
+            CHECK(res1.size() == 5);
+            const std::vector<std::int32_t> chunk(9, 9);
+            g4.get_dataset("c1").save_chunk({ 0, 0 }, chunk.data());
+            std::vector<std::int32_t> res3(9);
+            g1.get_dataset("c1").load_chunk({ 0, 0 }, res3.data());
+            CHECK(res3 == std::vector<std::int32_t>(9, 1));
+
+            // The root of a file is copied as a group.
+            auto g5 = f1.copy_to(f2.root(), "f1");
+            CHECK(f2.has_group("f1"));
+            CHECK(g5.has_dataset("g3/g2/d2"));
+        }
+        {
+            File f2(pfile2, File::ReadWrite);
+            auto d1 = g1.copy_to(f2.root(), "g6", true, true).get_dataset("d1");
+            CHECK(std::filesystem::hard_link_count(d1.filepath()) == 2);
+            d1.save_from(std::vector<std::int32_t> { 7 });
+            CHECK(std::filesystem::hard_link_count(d1.filepath()) == 1);
+            g1.get_dataset("d1").load_to(res1);
+            CHECK(res1 == val1);
+        }
+        File f2(pfile2, File::ReadOnly);
+        f2.get_dataset("f1/g1/g2/d2").load_to(res2);
+        CHECK(res2 == val2);
+    }
+}
+
+#endif